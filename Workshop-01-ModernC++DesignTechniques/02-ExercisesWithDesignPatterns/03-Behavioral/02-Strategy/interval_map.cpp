@@ -1,10 +1,15 @@
 #include <map>
 #include <iostream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
 
 template<typename K, typename V>
 class IntervalMap {
 private:
-    std::map<K, V> intervals;
+    // Boundaries: from each key up to the next one the value is the mapped one; std::nullopt marks
+    // where an interval ends without another one starting
+    std::map<K, std::optional<V>> intervals;
 
 public:
     void set(const K& start, const K& end, const V& value) {
@@ -12,43 +17,38 @@ public:
             return; // Invalid interval, return or throw an exception.
         }
 
-        // Simplified logic for setting intervals:
-        // - Overwrite intervals that are fully contained within the new interval
-        // - Adjust the start and end of overlapping intervals
-        auto itLow = intervals.lower_bound(start);
-        auto itHigh = intervals.upper_bound(end);
-
-        // Erase fully contained intervals
-        intervals.erase(itLow, itHigh);
+        // The value in effect at end must still hold from end on
+        auto itEnd = intervals.upper_bound(end);
+        const std::optional<V> after = itEnd == intervals.begin() ? std::nullopt : std::prev(itEnd)->second;
 
-        // Insert the new interval
-        intervals[start] = value;
+        // Erase the boundaries inside [start, end]
+        auto itLow = intervals.lower_bound(start);
+        const std::optional<V> before = itLow == intervals.begin() ? std::nullopt : std::prev(itLow)->second;
+        auto itHigh = intervals.erase(itLow, itEnd);
 
-        // If necessary, adjust the end of the previous interval
-        if (itLow != intervals.begin() && std::prev(itLow)->second == value) {
-            auto itPrev = std::prev(itLow);
-            intervals.erase(itPrev);
-            intervals[start] = value;
+        // Insert boundaries only where the value changes, so that equal neighbours merge
+        if (after != value) {
+            itHigh = intervals.emplace_hint(itHigh, end, after);
         }
-
-        // If necessary, adjust the start of the following interval
-        if (itHigh != intervals.end() && itHigh->second == value) {
-            intervals[end] = itHigh->second;
+        if (before != value) {
+            intervals.emplace_hint(itHigh, start, value);
         }
     }
 
     V get(const K& key) const {
         auto it = intervals.upper_bound(key);
-        if (it == intervals.begin()) {
-            throw std::out_of_range("Key is below the first interval.");
+        if (it == intervals.begin() || !std::prev(it)->second) {
+            throw std::out_of_range("Key is not in any interval.");
         }
         --it;
-        return it->second;
+        return *it->second;
     }
 
     void print() const {
-        for (const auto& interval : intervals) {
-            std::cout << "[" << interval.first << "): " << interval.second << "\n";
+        for (auto it = intervals.begin(); it != intervals.end(); ++it) {
+            if (it->second && std::next(it) != intervals.end()) {
+                std::cout << "[" << it->first << ", " << std::next(it)->first << "): " << *it->second << "\n";
+            }
         }
     }
 };
@@ -1,47 +1,388 @@
-#include <map>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <functional>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <thread>
 #include <vector>
 
+// Build: g++ -std=c++20 -O2 -pthread interval_map_strategy.cpp
+//
+// Writes are rare and lookups come from many threads, so get() never takes a lock. set() applies the
+// change to a master std::map under the writer mutex, then publishes an immutable flat copy of the
+// boundaries (read-copy-update). A reader claims a free slot with a compare-and-swap that announces the
+// version it starts from, loads the current snapshot with one atomic load and searches it; a replaced
+// snapshot is freed once no slot can still be reading it (epoch-based reclamation). Readers wait only
+// when more threads than slots read at the same time.
+//
+// The price is on the write side: every set() copies all n boundaries into the new snapshot, O(n) under
+// the writer mutex, milliseconds at a million boundaries. That suits a table written a few times per
+// second and read millions of times; a write-heavy table would publish from a persistent tree instead,
+// sharing the unchanged nodes between versions (see 02-intervalmap/persistent_interval_map.hpp in
+// Workshop-02).
+//
+// Observers are not called by set(). It records the changed range in a set of dirty ranges, where
+// overlapping and adjacent ranges merge, and a dispatcher thread hands them to the observers every flush
+// interval, as the pieces the current snapshot holds in them. A slow observer delays later notifications,
+// not writers or readers, and a burst of writes to one region becomes one batch of changes.
 template<typename K, typename V>
 class IntervalMap {
 private:
-    std::map<K, V> intervals;
-    std::mutex intervalsMutex; // Mutex to protect the map for thread-safety
+    // Immutable copy of the boundaries: from keys[i] up to keys[i + 1] the value is values[i]
+    struct Snapshot {
+        std::vector<K> keys;
+        std::vector<std::optional<V>> values;
+    };
+
+    struct Retired {
+        std::uint64_t version;
+        std::unique_ptr<const Snapshot> snapshot;
+    };
+
+    // One per reader thread, on its own cache line so readers do not contend
+    struct alignas(64) ReaderSlot {
+        std::atomic<std::uint64_t> version{quiescent};
+    };
+
+    static constexpr std::uint64_t quiescent = std::numeric_limits<std::uint64_t>::max();
+
+    // Claims a quiescent reader slot, announcing version in it; the search starts at a per-thread slot so
+    // that threads spread over the slots
+    std::atomic<std::uint64_t>& claimSlot(std::uint64_t version) const {
+        thread_local const std::size_t home = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        for (std::size_t attempt = 0;; ++attempt) {
+            std::atomic<std::uint64_t>& slot = readers[(home + attempt) % readers.size()].version;
+            std::uint64_t expected = quiescent;
+            if (slot.compare_exchange_strong(expected, version)) {
+                return slot;
+            }
+            if ((attempt + 1) % readers.size() == 0) {
+                std::this_thread::yield(); // Every slot busy: more readers than slots
+            }
+        }
+    }
+
+    // Master copy, only touched under writeMutex; std::nullopt marks where an interval ends
+    std::map<K, std::optional<V>> intervals;
+    std::mutex writeMutex;
+
+    mutable std::vector<ReaderSlot> readers;
+    std::atomic<std::uint64_t> publishedVersion{0};
+    std::atomic<const Snapshot*> current;
+    std::vector<Retired> retired;
 
     using MergeStrategy = std::function<bool(const V&, const V&)>;
     MergeStrategy mergeStrategy; // Strategy Pattern for merging intervals
 
-    // Observer Pattern
+    // Observer Pattern, called on the dispatcher thread
     std::vector<std::function<void(const K&, const K&, const V&)>> observers;
+    std::mutex observerMutex; // Guards the list, not held while observers run
+
+    // Ranges set since the last flush: start -> end, disjoint and not touching
+    std::map<K, K> dirty;
+    std::uint64_t dirtySequence = 0;     // set() calls recorded so far
+    std::uint64_t deliveredSequence = 0; // set() calls the observers have seen
+    bool flushRequested = false;
+    bool stopping = false;
+    std::mutex dirtyMutex;
+    std::condition_variable dirtyChanged;
+    std::condition_variable delivered;
+
+    ReaderSlot dispatcherSlot;
+    std::chrono::milliseconds flushInterval;
+
+    // Whether a boundary is needed between a neighbour holding `left` and one holding `right`
+    bool separates(const std::optional<V>& left, const std::optional<V>& right) const {
+        if (!left || !right) {
+            return left.has_value() || right.has_value();
+        }
+        return !mergeStrategy(*left, *right);
+    }
+
+    void publishLocked() {
+        auto next = std::make_unique<Snapshot>();
+        next->keys.reserve(intervals.size());
+        next->values.reserve(intervals.size());
+        for (const auto& [key, value] : intervals) {
+            next->keys.push_back(key);
+            next->values.push_back(value);
+        }
+        const Snapshot* previous = current.exchange(next.release());
+        const std::uint64_t version = publishedVersion.load();
+        publishedVersion.store(version + 1);
+        retired.push_back({version, std::unique_ptr<const Snapshot>(previous)});
+
+        // A reader announcing version v may hold snapshot v or newer, never older
+        std::uint64_t oldestInUse = dispatcherSlot.version.load();
+        for (const auto& reader : readers) {
+            oldestInUse = std::min(oldestInUse, reader.version.load());
+        }
+        std::erase_if(retired, [oldestInUse](const Retired& entry) { return entry.version < oldestInUse; });
+    }
+
+    // Adds [start, end) to the dirty ranges, merging it with those it overlaps or touches
+    void markDirty(const K& start, const K& end) {
+        std::lock_guard<std::mutex> lock(dirtyMutex);
+        K low = start;
+        K high = end;
+        auto it = dirty.upper_bound(start);
+        if (it != dirty.begin() && !(std::prev(it)->second < start)) {
+            --it;
+        }
+        while (it != dirty.end() && !(end < it->first)) {
+            low = std::min(low, it->first);
+            high = std::max(high, it->second);
+            it = dirty.erase(it);
+        }
+        dirty.emplace_hint(it, low, high);
+        ++dirtySequence;
+    }
+
+    // Calls the observers with what the current snapshot holds in each dirty range. They are called on a
+    // copy of the list, without observerMutex, so an observer may add another (heard from the next batch).
+    void notifyObservers(const std::map<K, K>& ranges) {
+        if (ranges.empty()) {
+            return;
+        }
+        std::vector<std::function<void(const K&, const K&, const V&)>> listeners;
+        {
+            std::lock_guard<std::mutex> lock(observerMutex);
+            listeners = observers;
+        }
+        dispatcherSlot.version.store(publishedVersion.load());
+        const Snapshot& snapshot = *current.load();
+        for (const auto& [start, end] : ranges) {
+            auto it = std::upper_bound(snapshot.keys.begin(), snapshot.keys.end(), start);
+            std::size_t index = static_cast<std::size_t>(it - snapshot.keys.begin());
+            K from = start;
+            // from lies in piece index - 1, which holds values[index - 1] up to keys[index]
+            while (from < end && index <= snapshot.keys.size()) {
+                const K to = index < snapshot.keys.size() ? std::min(end, snapshot.keys[index]) : end;
+                if (index > 0 && snapshot.values[index - 1]) {
+                    const V& value = *snapshot.values[index - 1];
+                    for (auto& observer : listeners) {
+                        observer(from, to, value);
+                    }
+                }
+                from = to;
+                ++index;
+            }
+        }
+        dispatcherSlot.version.store(quiescent, std::memory_order_release);
+    }
+
+    void dispatch() {
+        std::unique_lock<std::mutex> lock(dirtyMutex);
+        while (true) {
+            dirtyChanged.wait_for(lock, flushInterval, [this] { return stopping || flushRequested; });
+            flushRequested = false;
+            std::map<K, K> ranges;
+            ranges.swap(dirty);
+            const std::uint64_t sequence = dirtySequence;
+            lock.unlock();
+            notifyObservers(ranges);
+            lock.lock();
+            deliveredSequence = sequence;
+            delivered.notify_all();
+            if (stopping && dirty.empty()) {
+                return;
+            }
+        }
+    }
 
 public:
-    IntervalMap(MergeStrategy strategy) : mergeStrategy(strategy) {}
+    // readerCount: number of reader slots, i.e. threads that can be inside get() at the same time without
+    // waiting for one another. flushInterval: how often changes are handed to the observers.
+    IntervalMap(MergeStrategy strategy, std::size_t readerCount = 1,
+                std::chrono::milliseconds flushInterval = std::chrono::milliseconds(10))
+        : readers(std::max<std::size_t>(readerCount, 1)), current(new Snapshot()), mergeStrategy(strategy),
+          flushInterval(flushInterval), dispatcher([this] { dispatch(); }) {}
 
+    IntervalMap(const IntervalMap&) = delete;
+    IntervalMap& operator=(const IntervalMap&) = delete;
+
+    // Delivers what is still pending before returning
+    ~IntervalMap() {
+        {
+            std::lock_guard<std::mutex> lock(dirtyMutex);
+            stopping = true;
+        }
+        dirtyChanged.notify_one();
+        dispatcher.join();
+        delete current.load();
+    }
+
+    // The observer is called on the dispatcher thread with the ranges changed since the previous flush,
+    // split where their values differ; it must not throw. It may call set(), flush() and addObserver().
     void addObserver(std::function<void(const K&, const K&, const V&)> observer) {
+        std::lock_guard<std::mutex> lock(observerMutex);
         observers.push_back(observer);
     }
 
-    void notifyObservers(const K& start, const K& end, const V& value) {
-        for (auto& observer : observers) {
-            observer(start, end, value);
+    // Returns once the observers have seen every set() that returned before this call. Called from an
+    // observer, it only requests the next flush and returns: waiting there would wait for itself.
+    void flush() {
+        std::unique_lock<std::mutex> lock(dirtyMutex);
+        if (std::this_thread::get_id() == dispatcher.get_id()) {
+            flushRequested = true;
+            return;
         }
+        const std::uint64_t target = dirtySequence;
+        flushRequested = true;
+        dirtyChanged.notify_one();
+        delivered.wait(lock, [&] { return deliveredSequence >= target; });
     }
 
+    // Neighbours that the merge strategy merges become one interval holding the left one's value: with a
+    // strategy coarser than equality, set() may leave keys holding the left neighbour's value, not value
     void set(const K& start, const K& end, const V& value) {
-        std::unique_lock<std::mutex> lock(intervalsMutex);
-        // Implementation with merge strategy...
-        // Notify observers after the interval is set
-        notifyObservers(start, end, value);
+        if (!(start < end)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(writeMutex);
+
+        // The value in effect at end must still hold from end on
+        auto itEnd = intervals.upper_bound(end);
+        const std::optional<V> after = itEnd == intervals.begin() ? std::nullopt : std::prev(itEnd)->second;
+
+        auto itLow = intervals.lower_bound(start);
+        const bool changesBefore = itLow == intervals.begin() || separates(std::prev(itLow)->second, value);
+        auto itHigh = intervals.erase(itLow, itEnd);
+
+        if (separates(value, after)) {
+            itHigh = intervals.emplace_hint(itHigh, end, after);
+        }
+        if (changesBefore) {
+            intervals.emplace_hint(itHigh, start, value);
+        }
+        publishLocked();
+
+        // Observers hear about it from the dispatcher, after the snapshot holding it is published
+        markDirty(start, end);
     }
 
-    V get(const K& key) {
-        std::unique_lock<std::mutex> lock(intervalsMutex);
-        // Implementation...
+    // Lookup without a lock, from any thread. Throws std::out_of_range if no interval contains key.
+    V get(const K& key) const {
+        // Announce first, then load: a writer that misses the announcement has already published a newer
+        // snapshot, so the load below cannot return one it is about to free
+        std::atomic<std::uint64_t>& slot = claimSlot(publishedVersion.load());
+        const Snapshot& snapshot = *current.load();
+
+        const auto it = std::upper_bound(snapshot.keys.begin(), snapshot.keys.end(), key);
+        std::optional<V> value;
+        if (it != snapshot.keys.begin()) {
+            value = snapshot.values[static_cast<std::size_t>(it - snapshot.keys.begin()) - 1];
+        }
+        slot.store(quiescent, std::memory_order_release);
+
+        if (!value) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return *value;
+    }
+
+    // The single-mutex lookup this map used to have, kept for comparison in the benchmark
+    V getSerialized(const K& key) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        auto it = intervals.upper_bound(key);
+        if (it == intervals.begin() || !std::prev(it)->second) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return *std::prev(it)->second;
     }
+
+private:
+    std::thread dispatcher; // Last, so that it starts once everything it reads is initialized
 };
 
+constexpr int keySpace = 100'000;
+
+// Lookups per second over all readers, with a writer changing one range every millisecond meanwhile
+template<typename Lookup>
+double lookupsPerSecond(IntervalMap<int, int>& imap, std::size_t readerCount, Lookup lookup) {
+    constexpr int lookupsPerReader = 1'000'000;
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        std::mt19937 random(1);
+        while (!done.load()) {
+            const int start = static_cast<int>(random() % keySpace);
+            imap.set(start, start + 100, static_cast<int>(random() % 16));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    const auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    std::atomic<long long> checksum{0};
+    for (std::size_t reader = 0; reader < readerCount; ++reader) {
+        threads.emplace_back([&, reader] {
+            std::mt19937 random(static_cast<unsigned>(reader));
+            long long sum = 0;
+            for (int count = 0; count < lookupsPerReader; ++count) {
+                sum += lookup(static_cast<int>(random() % keySpace));
+            }
+            checksum += sum;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    done = true;
+    writer.join();
+    return static_cast<double>(lookupsPerReader) * static_cast<double>(readerCount) / seconds;
+}
+
+// Average set() latency with an observer that takes 100 us per change
+void writeLatency() {
+    constexpr int writes = 2'000;
+    IntervalMap<int, int> imap([](const int& a, const int& b) { return a == b; }, 1, std::chrono::milliseconds(5));
+    std::atomic<int> changes{0};
+    imap.addObserver([&](const int&, const int&, const int&) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        ++changes;
+    });
+
+    std::mt19937 random(2);
+    const auto begin = std::chrono::steady_clock::now();
+    for (int count = 0; count < writes; ++count) {
+        const int start = static_cast<int>(random() % 1'000) * 10; // A hot region, as bursts of writes tend to be
+        imap.set(start, start + 20, static_cast<int>(random() % 4));
+    }
+    const double microseconds =
+        std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count() / writes;
+    imap.flush();
+    std::cout << "\nset() with a 100 us observer: " << microseconds << " us per write; " << writes
+              << " writes delivered as " << changes.load() << " changes\n";
+}
+
+void benchmark() {
+    constexpr std::size_t maxReaders = 8;
+    IntervalMap<int, int> imap([](const int& a, const int& b) { return a == b; }, maxReaders);
+    for (int start = 0; start < keySpace; start += 10) {
+        imap.set(start, start + 10, start / 10 % 16); // Covers every key the benchmark looks up
+    }
+
+    std::cout << "\nLookups with a concurrent writer, " << std::thread::hardware_concurrency() << " cores:\n";
+    for (std::size_t readerCount = 1; readerCount <= maxReaders; readerCount *= 2) {
+        const double lockFree = lookupsPerSecond(imap, readerCount, [&](int key) { return imap.get(key); });
+        const double serialized = lookupsPerSecond(imap, readerCount, [&](int key) { return imap.getSerialized(key); });
+        std::cout << "  " << readerCount << " readers: lock-free " << lockFree / 1e6 << " M/s, single mutex "
+                  << serialized / 1e6 << " M/s\n";
+    }
+}
+
 // Use case example
 int main() {
     // Define merge strategy for intervals with the same value
@@ -58,6 +399,17 @@ int main() {
 
     imap.set(1, 5, 'A');
     imap.set(6, 10, 'B');
+    imap.set(5, 6, 'A'); // Merges with [1, 5)
+    imap.flush();         // The three changes arrive as one batch: [1, 6) and [6, 10)
+    std::cout << "Get 3: " << imap.get(3) << ", get 5: " << imap.get(5) << ", get 7: " << imap.get(7) << "\n";
+
+    // A strategy coarser than equality: set() can leave the left neighbour's value in place of its own
+    IntervalMap<int, char> caseless([](const char& a, const char& b) { return std::tolower(a) == std::tolower(b); });
+    caseless.set(1, 5, 'A');
+    caseless.set(5, 8, 'a'); // Merges into [1, 8), which keeps 'A'
+    std::cout << "Case-insensitive merge, after set(5, 8, 'a'): get 6: " << caseless.get(6) << "\n";
 
+    writeLatency();
+    benchmark();
     return 0;
-}
\ No newline at end of file
+}
@@ -1,105 +1,19 @@
 #include <iostream>
+#include <span>
 #include <vector>
-#include <map>
-#include <set>
-#include <thread>
-#include <mutex>
 
-// Define PacketType as an enum for simplicity
-enum class PacketType {
-    HTTP,
-    FTP,
-    SSH,
-    // ... other packet types
-};
-
-// Packet structure
-struct Packet {
-    PacketType type;
-    std::string content; // Simplified content representation
-};
-
-// SubscriberId type
-using SubscriberId = int;
+#include "packet_analyzer.hpp"
 
-// Define a simple Subscriber class
-class Subscriber {
+// Receives its notifications in batches from the analyzer's dispatcher thread
+class PrintingSubscriber : public Subscriber {
 public:
-    SubscriberId id;
-    // ... other subscriber details
-
-    Subscriber(SubscriberId id) : id(id) {}
-
-    void notify(const Packet& packet) {
+    void onNotifications(SubscriberId id, std::span<const Notification> batch) override {
         // Placeholder for the notification logic
-        std::cout << "Subscriber " << id << " received packet: " << packet.content << std::endl;
-    }
-};
-
-// Forward declaration for Subscriber
-class Subscriber;
-
-class PacketAnalyzer {
-    std::map<SubscriberId, std::set<PacketType>> subscriberPreferences;
-    std::multimap<PacketType, SubscriberId> packetTypeSubscribers;
-    std::mutex notifyMutex; // Mutex for thread-safe subscriber notification
-
-public:
-    void subscribe(SubscriberId subscriberId, PacketType packetType) {
-        subscriberPreferences[subscriberId].insert(packetType);
-        packetTypeSubscribers.insert({packetType, subscriberId});
-    }
-
-    void unsubscribe(SubscriberId subscriberId, PacketType packetType) {
-        subscriberPreferences[subscriberId].erase(packetType);
-        auto range = packetTypeSubscribers.equal_range(packetType);
-        for (auto it = range.first; it != range.second;) {
-            if (it->second == subscriberId) {
-                it = packetTypeSubscribers.erase(it);
-            } else {
-                ++it;
-            }
+        std::cout << "Subscriber " << id << " received a batch of " << batch.size() << " notifications:";
+        for (const Notification& notification : batch) {
+            std::cout << " type " << static_cast<int>(notification.type);
         }
-    }
-
-    void processPackets(const std::vector<Packet>& packets) {
-        // Divide packets by type
-        std::map<PacketType, std::vector<Packet>> packetsByType;
-        for (const auto& packet : packets) {
-            packetsByType[packet.type].push_back(packet);
-        }
-
-        // Vector to hold the threads
-        std::vector<std::thread> threads;
-
-        // Create a thread for each packet type
-        for (const auto& [packetType, packetsOfType] : packetsByType) {
-            threads.emplace_back([this, packetType, packetsOfType]() {
-                // Notify subscribers interested in this packet type
-                auto subscribers = packetTypeSubscribers.equal_range(packetType);
-                for (const auto& packet : packetsOfType) {
-                    for (auto it = subscribers.first; it != subscribers.second; ++it) {
-                        notifySubscriber(it->second, packet);
-                    }
-                }
-            });
-        }
-
-        // Join all threads to ensure completion of packet processing
-        for (std::thread& thread : threads) {
-            if (thread.joinable()) {
-                thread.join();
-            }
-        }
-    }
-
-    void notifySubscriber(SubscriberId subscriberId, const Packet& packet) {
-        std::lock_guard<std::mutex> guard(notifyMutex); // Ensure thread safety
-        // Notify the subscriber about the packet
-        // In a real-world scenario, you'd have more sophisticated notification logic here.
-        // For this example, simply print the notification to the console.
-        std::cout << "Subscriber " << subscriberId << " notified about packet of type "
-                  << static_cast<int>(packet.type) << std::endl;
+        std::cout << std::endl;
     }
 };
 
@@ -112,17 +26,43 @@ int main() {
     analyzer.subscribe(alice, PacketType::HTTP);
     analyzer.subscribe(bob, PacketType::FTP);
 
-    // Create a list of packets to be processed
+    // Carol wants web traffic on the standard ports only, whatever the payload
+    SubscriberId carol = 3;
+    analyzer.subscribeFilter(carol, "type == HTTP && dport in {80, 443} && length > 0");
+
+    // Create a list of packets to be processed; the flow decides which worker handles a packet
     std::vector<Packet> packets = {
-        {PacketType::HTTP, "HTTP Packet 1"},
-        {PacketType::FTP, "FTP Packet 1"},
-        {PacketType::SSH, "SSH Packet 1"},
-        {PacketType::HTTP, "HTTP Packet 2"},
-        {PacketType::FTP, "FTP Packet 2"}
+        {PacketType::HTTP, "HTTP Packet 1", {0x0a000001, 0x0a000064, 50000, 80}},
+        {PacketType::FTP, "FTP Packet 1", {0x0a000002, 0x0a000065, 50001, 21}},
+        {PacketType::SSH, "SSH Packet 1", {0x0a000003, 0x0a000066, 50002, 22}},
+        {PacketType::HTTP, "HTTP Packet 2", {0x0a000004, 0x0a000064, 50003, 80}},
+        {PacketType::FTP, "FTP Packet 2", {0x0a000002, 0x0a000065, 50001, 21}}
     };
 
+    // Dave gets SSH and FTP traffic pushed to him in batches of up to 16, at most 2 ms late
+    SubscriberId dave = 4;
+    PrintingSubscriber daveSubscriber;
+    analyzer.subscribe(dave, PacketType::SSH);
+    analyzer.subscribe(dave, PacketType::FTP);
+    analyzer.attach(dave, daveSubscriber, {16, std::chrono::milliseconds(2)});
+
     // Process the packets
     analyzer.processPackets(packets);
 
+    // The others drain their own delivery queues
+    for (SubscriberId subscriber : {alice, bob, carol}) {
+        analyzer.drain(subscriber, [subscriber](const Notification& notification) {
+            std::cout << "Subscriber " << subscriber << " notified about packet of type "
+                      << static_cast<int>(notification.type) << std::endl;
+        });
+    }
+
+    analyzer.detach(dave); // Hands over whatever is still buffered
+
+    auto perWorker = analyzer.packetsPerWorker();
+    for (std::size_t worker = 0; worker < perWorker.size(); ++worker) {
+        std::cout << "Worker " << worker << " processed " << perWorker[worker] << " packets" << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,181 @@
+/*
+    FlatSubscriberTable vs the original std::multimap + std::map<SubscriberId, std::set<PacketType>>.
+
+    Build: g++ -std=c++20 -O2 04_flat_subscriber_table_benchmark.cpp
+
+    Three measurements per subscriber count (10k, 100k, 1M):
+    - subscribe:   building the table, ns per subscription
+    - fan-out:     visiting every subscriber of the packet's type for a batch of packets,
+                   ns per visited subscriber. This is the notify hot path without the notification itself.
+    - unsubscribe: removing random subscriptions, ns per call. The multimap scans the equal_range of the type,
+                   the flat table does a hash lookup and a swap-remove.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "flat_subscriber_table.hpp"
+#include "packet.hpp"
+
+// The subscriber bookkeeping of the original PacketAnalyzer, kept verbatim as the baseline
+class MultimapSubscriberTable {
+    std::map<SubscriberId, std::set<PacketType>> subscriberPreferences;
+    std::multimap<PacketType, SubscriberId> packetTypeSubscribers;
+
+public:
+    void subscribe(SubscriberId subscriberId, PacketType packetType) {
+        subscriberPreferences[subscriberId].insert(packetType);
+        packetTypeSubscribers.insert({packetType, subscriberId});
+    }
+
+    void unsubscribe(SubscriberId subscriberId, PacketType packetType) {
+        subscriberPreferences[subscriberId].erase(packetType);
+        auto range = packetTypeSubscribers.equal_range(packetType);
+        for (auto it = range.first; it != range.second;) {
+            if (it->second == subscriberId) {
+                it = packetTypeSubscribers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    template<typename Visitor>
+    void forEachSubscriber(PacketType packetType, Visitor&& visit) const {
+        auto range = packetTypeSubscribers.equal_range(packetType);
+        for (auto it = range.first; it != range.second; ++it) {
+            visit(it->second);
+        }
+    }
+};
+
+class FlatTableAdapter {
+    FlatSubscriberTable table;
+
+public:
+    void subscribe(SubscriberId subscriberId, PacketType packetType) {
+        table.subscribe(subscriberId, packetType);
+    }
+
+    void unsubscribe(SubscriberId subscriberId, PacketType packetType) {
+        table.unsubscribe(subscriberId, packetType);
+    }
+
+    template<typename Visitor>
+    void forEachSubscriber(PacketType packetType, Visitor&& visit) const {
+        for (SubscriberId subscriberId : table.subscribers(packetType)) {
+            visit(subscriberId);
+        }
+    }
+};
+
+struct Subscription {
+    SubscriberId subscriberId;
+    PacketType packetType;
+};
+
+struct Result {
+    double subscribeNs;
+    double fanOutNs;
+    double unsubscribeNs;
+    std::uint64_t checksum; // Keeps the fan-out loop from being optimized away
+};
+
+using Clock = std::chrono::steady_clock;
+
+double nanosecondsPer(Clock::time_point start, Clock::time_point stop, std::size_t operations) {
+    return std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(operations);
+}
+
+template<typename Table>
+Result run(const std::vector<Subscription>& subscriptions,
+           const std::vector<PacketType>& batch,
+           const std::vector<Subscription>& removals) {
+    Result result{};
+    Table table;
+
+    auto start = Clock::now();
+    for (const auto& subscription : subscriptions) {
+        table.subscribe(subscription.subscriberId, subscription.packetType);
+    }
+    auto stop = Clock::now();
+    result.subscribeNs = nanosecondsPer(start, stop, subscriptions.size());
+
+    std::uint64_t visited = 0;
+    start = Clock::now();
+    for (PacketType packetType : batch) {
+        table.forEachSubscriber(packetType, [&](SubscriberId subscriberId) {
+            result.checksum += static_cast<std::uint64_t>(subscriberId);
+            ++visited;
+        });
+    }
+    stop = Clock::now();
+    result.fanOutNs = nanosecondsPer(start, stop, visited);
+
+    start = Clock::now();
+    for (const auto& removal : removals) {
+        table.unsubscribe(removal.subscriberId, removal.packetType);
+    }
+    stop = Clock::now();
+    result.unsubscribeNs = nanosecondsPer(start, stop, removals.size());
+
+    return result;
+}
+
+int main() {
+    constexpr std::size_t batchSize = 32;
+    constexpr std::size_t removalCount = 200; // The multimap scans ~N/3 entries per removal
+
+    std::printf("%-10s %-9s %14s %14s %16s\n", "subs", "table", "subscribe ns", "fan-out ns", "unsubscribe ns");
+    for (std::size_t subscriberCount : {10'000u, 100'000u, 1'000'000u}) {
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<std::size_t> pickType(0, packetTypeCount - 1);
+
+        // Every subscriber takes one random type, a quarter of them a second one
+        std::vector<Subscription> subscriptions;
+        for (std::size_t i = 0; i < subscriberCount; ++i) {
+            const auto subscriberId = static_cast<SubscriberId>(i);
+            const std::size_t type = pickType(rng);
+            subscriptions.push_back({subscriberId, static_cast<PacketType>(type)});
+            if (i % 4 == 0) {
+                subscriptions.push_back({subscriberId, static_cast<PacketType>((type + 1) % packetTypeCount)});
+            }
+        }
+        // Random insertion order, as a control plane would replay it
+        std::shuffle(subscriptions.begin(), subscriptions.end(), rng);
+
+        std::vector<PacketType> batch;
+        for (std::size_t i = 0; i < batchSize; ++i) {
+            batch.push_back(static_cast<PacketType>(pickType(rng)));
+        }
+
+        std::vector<Subscription> removals;
+        std::uniform_int_distribution<std::size_t> pickSubscription(0, subscriptions.size() - 1);
+        for (std::size_t i = 0; i < removalCount; ++i) {
+            removals.push_back(subscriptions[pickSubscription(rng)]);
+        }
+
+        const Result baseline = run<MultimapSubscriberTable>(subscriptions, batch, removals);
+        const Result flat = run<FlatTableAdapter>(subscriptions, batch, removals);
+
+        std::printf("%-10zu %-9s %14.1f %14.2f %16.1f\n", subscriberCount, "multimap",
+                    baseline.subscribeNs, baseline.fanOutNs, baseline.unsubscribeNs);
+        std::printf("%-10zu %-9s %14.1f %14.2f %16.1f\n", subscriberCount, "flat",
+                    flat.subscribeNs, flat.fanOutNs, flat.unsubscribeNs);
+        std::printf("%-10s fan-out speedup x%.1f, unsubscribe speedup x%.1f\n\n", "",
+                    baseline.fanOutNs / flat.fanOutNs, baseline.unsubscribeNs / flat.unsubscribeNs);
+
+        if (baseline.checksum != flat.checksum) {
+            std::printf("checksum mismatch: the tables disagree on the subscribers\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
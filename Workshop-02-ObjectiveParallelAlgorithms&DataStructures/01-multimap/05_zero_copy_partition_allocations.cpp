@@ -0,0 +1,93 @@
+/*
+    Counting heap allocations per batch in PacketAnalyzer::processPackets.
+
+    Build: g++ -std=c++20 -O2 -pthread 05_zero_copy_partition_allocations.cpp
+
+    The global operator new is replaced by a counting one. The old partition step,
+    std::map<PacketType, std::vector<Packet>>, is measured next to the analyzer: it copies every packet,
+    and payloads longer than the small-string buffer allocate on every copy.
+    The analyzer partitions a permutation of indices instead, so once its buffers have grown to the batch
+    size it must not allocate at all. The program fails if it does.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "packet_analyzer.hpp"
+
+std::atomic<std::size_t> allocationCount{0};
+
+void* countedAllocation(std::size_t size, std::size_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* pointer = alignment > alignof(std::max_align_t)
+                        ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                        : std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(std::size_t size) { return countedAllocation(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return countedAllocation(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocation(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+template<typename Work>
+double allocationsPerBatch(std::size_t batches, Work&& work) {
+    const std::size_t before = allocationCount.load();
+    for (std::size_t batch = 0; batch < batches; ++batch) {
+        work();
+    }
+    return static_cast<double>(allocationCount.load() - before) / static_cast<double>(batches);
+}
+
+int main() {
+    constexpr std::size_t batchSize = 1024;
+    constexpr std::size_t batches = 100;
+
+    std::vector<Packet> packets;
+    for (std::size_t index = 0; index < batchSize; ++index) {
+        const auto flow = static_cast<std::uint32_t>(index);
+        packets.push_back({static_cast<PacketType>(index % packetTypeCount),
+                           std::string(256, 'x'), // Longer than any small-string buffer
+                           {0x0a000000 | flow, 0x0a010000, static_cast<std::uint16_t>(1024 + flow), 443}});
+    }
+
+    const double copying = allocationsPerBatch(batches, [&] {
+        std::map<PacketType, std::vector<Packet>> packetsByType;
+        for (const auto& packet : packets) {
+            packetsByType[packet.type].push_back(packet);
+        }
+    });
+
+    PacketAnalyzer analyzer(4);
+    analyzer.subscribe(1, PacketType::HTTP);
+    analyzer.subscribe(2, PacketType::SSH);
+    analyzer.processPackets(packets); // Warm-up: the partition buffers grow to the batch size once
+
+    const double zeroCopy = allocationsPerBatch(batches, [&] { analyzer.processPackets(packets); });
+
+    std::cout << "Allocations per batch of " << batchSize << " packets:\n"
+              << "  copy into std::map<PacketType, std::vector<Packet>>: " << copying << "\n"
+              << "  PacketAnalyzer::processPackets:                     " << zeroCopy << "\n";
+
+    if (zeroCopy != 0.0) {
+        std::cout << "FAILED: processPackets allocates in steady state\n";
+        return 1;
+    }
+    std::cout << "OK: no payload is copied between ingest and notification\n";
+    return 0;
+}
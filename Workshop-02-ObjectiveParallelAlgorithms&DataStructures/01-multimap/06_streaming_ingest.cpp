@@ -0,0 +1,125 @@
+/*
+    Streaming ingest: capture threads push packets while workers deliver and subscribers drain.
+
+    Build: g++ -std=c++20 -O2 -pthread 06_streaming_ingest.cpp
+
+    Two capture threads push packets of many flows as fast as they can, one subscriber per type drains its
+    notifications on its own thread. The run is repeated for each IngestPolicy with deliberately small
+    ingest rings, so the rings overflow and the policies differ:
+    - Block never loses a packet but slows the capture threads down
+    - DropNewest and DropOldest keep capture at full speed and count what they gave up
+    The ingest depth is sampled while the stream runs, the way a monitoring thread would, and the analyzer's
+    metrics give the ingest-to-notification latency of the delivered packets.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "packet_analyzer.hpp"
+
+struct RunResult {
+    double seconds = 0;
+    IngestStats ingest;
+    std::size_t maxDepth = 0;
+    std::uint64_t notified = 0;
+    MetricsSnapshot metrics;
+};
+
+RunResult run(IngestPolicy policy, std::size_t packetsPerThread) {
+    constexpr std::size_t captureThreads = 2;
+    PacketAnalyzer analyzer(2, 256, policy);
+    analyzer.enableMetrics();
+    for (std::size_t type = 0; type < packetTypeCount; ++type) {
+        const auto subscriberId = static_cast<SubscriberId>(type + 1);
+        analyzer.configureDelivery(subscriberId, 1 << 16);
+        analyzer.subscribe(subscriberId, static_cast<PacketType>(type));
+    }
+
+    std::atomic<bool> capturing{true};
+    std::atomic<std::uint64_t> notified{0};
+    std::vector<std::jthread> consumers;
+    for (std::size_t type = 0; type < packetTypeCount; ++type) {
+        consumers.emplace_back([&, subscriberId = static_cast<SubscriberId>(type + 1)](std::stop_token stop) {
+            while (!stop.stop_requested()) {
+                const std::size_t drained = analyzer.drain(subscriberId, [](const Notification&) {});
+                notified.fetch_add(drained, std::memory_order_relaxed);
+                if (drained == 0) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    RunResult result;
+    std::jthread monitor([&] {
+        while (capturing.load()) {
+            result.maxDepth = std::max(result.maxDepth, analyzer.ingestStats().depth);
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    const auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> capture;
+        for (std::size_t thread = 0; thread < captureThreads; ++thread) {
+            capture.emplace_back([&, thread] {
+                for (std::size_t index = 0; index < packetsPerThread; ++index) {
+                    const auto flow = static_cast<std::uint32_t>(index * captureThreads + thread);
+                    analyzer.push({static_cast<PacketType>(flow % packetTypeCount), std::string(64, 'x'),
+                                   {0x0a000000 | (flow & 0xffff), 0x0a010001, static_cast<std::uint16_t>(flow), 443}});
+                }
+            });
+        }
+    }
+    analyzer.flush();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    capturing = false;
+    monitor.join();
+
+    // Let the subscribers catch up with what was delivered before counting
+    std::uint64_t pending = 1;
+    while (pending != 0) {
+        pending = 0;
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            pending += analyzer.deliveryStats(static_cast<SubscriberId>(type + 1)).depth;
+        }
+        std::this_thread::yield();
+    }
+    consumers.clear();
+
+    result.ingest = analyzer.ingestStats();
+    result.notified = notified.load();
+    result.metrics = analyzer.metricsSnapshot();
+    return result;
+}
+
+int main() {
+    constexpr std::size_t packetsPerThread = 500'000;
+    const std::pair<IngestPolicy, const char*> policies[] = {
+        {IngestPolicy::Block, "Block"},
+        {IngestPolicy::DropNewest, "DropNewest"},
+        {IngestPolicy::DropOldest, "DropOldest"},
+    };
+
+    std::printf("%-11s %12s %10s %10s %10s %10s %10s %12s %10s %10s\n", "policy", "pushed/s", "accepted", "dropNew",
+                "dropOld", "blocked", "maxDepth", "notified", "p50 us", "p99 us");
+    for (const auto& [policy, name] : policies) {
+        const RunResult result = run(policy, packetsPerThread);
+        std::printf("%-11s %12.0f %10llu %10llu %10llu %10llu %10zu %12llu %10.1f %10.1f\n", name,
+                    2.0 * packetsPerThread / result.seconds,
+                    static_cast<unsigned long long>(result.ingest.accepted),
+                    static_cast<unsigned long long>(result.ingest.droppedNewest),
+                    static_cast<unsigned long long>(result.ingest.droppedOldest),
+                    static_cast<unsigned long long>(result.ingest.blocked), result.maxDepth,
+                    static_cast<unsigned long long>(result.notified),
+                    static_cast<double>(result.metrics.latency.percentile(0.5)) / 1000,
+                    static_cast<double>(result.metrics.latency.percentile(0.99)) / 1000);
+    }
+    return 0;
+}
@@ -0,0 +1,333 @@
+/*
+    Synthetic traffic benchmark for the subscribe/notify engines of this folder.
+
+    Build: g++ -std=c++20 -O2 -pthread 07_traffic_benchmark.cpp
+    Run:   ./a.out [maxSubscribers]      (default 1000000)
+
+    Three implementations see exactly the same traffic (traffic_generator.hpp):
+    - sequential:      01_multimap_subscribe_notify.cpp, one thread, std::map copy of the batch
+    - thread-per-type: 02_multimap_subscribe_notify_async_simplified.cpp, a std::thread per type per batch
+                       and a notifyMutex around every notification
+    - analyzer:        the PacketAnalyzer of packet_analyzer.hpp with its delivery queues drained between
+                       batches, outside the measured time
+    The baselines' notifySubscriber only counts, as their originals are empty; the analyzer really pushes
+    every notification into a ring. Where it still wins, that is the fan-out structure paying off.
+
+    Scenarios cross a uniform and a Zipf type mix with fixed 64-byte and IMIX payloads, for 1 to 1M
+    subscribers. Every subscriber takes one uniformly chosen type, a quarter of them a second one.
+    The batch size shrinks as the subscriber count grows so that each run performs a similar number of
+    notifications.
+
+    Reported per run:
+    - pkts/s and notifications/s over the time spent inside processPackets
+    - p50/p99/p999 notify latency: from processPackets being called until all of a packet's subscribers
+      were notified (the analyzer measures it with its own metrics, per shard)
+    - allocations per packet, from a counting global operator new, inside processPackets only
+
+    Judge every change to the fan-out against these numbers.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <new>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analyzer_metrics.hpp"
+#include "packet_analyzer.hpp"
+#include "traffic_generator.hpp"
+
+std::atomic<std::size_t> allocationCount{0};
+
+void* countedAllocation(std::size_t size, std::size_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void* pointer = alignment > alignof(std::max_align_t)
+                        ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                        : std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(std::size_t size) { return countedAllocation(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return countedAllocation(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocation(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+
+using Clock = std::chrono::steady_clock;
+
+std::uint64_t nanosecondsSince(Clock::time_point start) {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+// 01_multimap_subscribe_notify.cpp, with a notification that counts and a latency probe per packet
+class SequentialAnalyzer {
+    std::map<SubscriberId, std::set<PacketType>> subscriberPreferences;
+    std::multimap<PacketType, SubscriberId> packetTypeSubscribers;
+
+public:
+    std::uint64_t notifications = 0;
+    LatencyHistogram latency;
+
+    void subscribe(SubscriberId subscriberId, PacketType packetType) {
+        subscriberPreferences[subscriberId].insert(packetType);
+        packetTypeSubscribers.insert({packetType, subscriberId});
+    }
+
+    void processPackets(const std::vector<Packet>& packets) {
+        const auto start = Clock::now();
+        std::map<PacketType, std::vector<Packet>> packetsByType;
+        for (const auto& packet : packets) {
+            packetsByType[packet.type].push_back(packet);
+        }
+        for (const auto& [packetType, packetsOfType] : packetsByType) {
+            auto subscribers = packetTypeSubscribers.equal_range(packetType);
+            for (const auto& packet : packetsOfType) {
+                for (auto it = subscribers.first; it != subscribers.second; ++it) {
+                    notifySubscriber(it->second, packet);
+                }
+                latency.record(nanosecondsSince(start));
+            }
+        }
+    }
+
+    void notifySubscriber(SubscriberId, const Packet&) {
+        ++notifications;
+    }
+};
+
+// 02_multimap_subscribe_notify_async_simplified.cpp, same probes
+class ThreadPerTypeAnalyzer {
+    std::map<SubscriberId, std::set<PacketType>> subscriberPreferences;
+    std::multimap<PacketType, SubscriberId> packetTypeSubscribers;
+    std::mutex notifyMutex;
+
+public:
+    std::uint64_t notifications = 0;
+    LatencyHistogram latency;
+
+    void subscribe(SubscriberId subscriberId, PacketType packetType) {
+        subscriberPreferences[subscriberId].insert(packetType);
+        packetTypeSubscribers.insert({packetType, subscriberId});
+    }
+
+    void processPackets(const std::vector<Packet>& packets) {
+        const auto start = Clock::now();
+        std::map<PacketType, std::vector<Packet>> packetsByType;
+        for (const auto& packet : packets) {
+            packetsByType[packet.type].push_back(packet);
+        }
+        std::vector<std::thread> threads;
+        for (const auto& [packetType, packetsOfType] : packetsByType) {
+            threads.emplace_back([this, packetType, packetsOfType, start]() {
+                auto subscribers = packetTypeSubscribers.equal_range(packetType);
+                for (const auto& packet : packetsOfType) {
+                    for (auto it = subscribers.first; it != subscribers.second; ++it) {
+                        notifySubscriber(it->second, packet);
+                    }
+                    std::lock_guard<std::mutex> guard(notifyMutex);
+                    latency.record(nanosecondsSince(start));
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    void notifySubscriber(SubscriberId, const Packet&) {
+        std::lock_guard<std::mutex> guard(notifyMutex);
+        ++notifications;
+    }
+};
+
+struct Scenario {
+    TrafficProfile profile;
+    std::size_t subscriberCount;
+    std::size_t batchSize;
+};
+
+struct Result {
+    std::uint64_t packets = 0;
+    std::uint64_t notifications = 0;
+    std::uint64_t nanoseconds = 0; // Inside processPackets
+    std::size_t allocations = 0;
+    LatencyHistogram latency;
+};
+
+std::vector<std::pair<SubscriberId, PacketType>> subscriptionsFor(std::size_t subscriberCount) {
+    std::mt19937_64 random(7);
+    std::uniform_int_distribution<std::size_t> pickType(0, packetTypeCount - 1);
+    std::vector<std::pair<SubscriberId, PacketType>> subscriptions;
+    for (std::size_t index = 0; index < subscriberCount; ++index) {
+        const auto subscriberId = static_cast<SubscriberId>(index + 1);
+        const std::size_t type = pickType(random);
+        subscriptions.emplace_back(subscriberId, static_cast<PacketType>(type));
+        if (index % 4 == 0) {
+            subscriptions.emplace_back(subscriberId, static_cast<PacketType>((type + 1) % packetTypeCount));
+        }
+    }
+    return subscriptions;
+}
+
+// Runs the warm-up batch, then times processPackets alone over the measured batches
+template<typename Process, typename BetweenBatches>
+Result measure(const std::vector<std::vector<Packet>>& batches, Process&& process, BetweenBatches&& betweenBatches) {
+    Result result;
+    process(batches.front());
+    betweenBatches();
+    for (std::size_t batch = 1; batch < batches.size(); ++batch) {
+        const std::size_t allocationsBefore = allocationCount.load();
+        const auto start = Clock::now();
+        process(batches[batch]);
+        result.nanoseconds += nanosecondsSince(start);
+        result.allocations += allocationCount.load() - allocationsBefore;
+        result.packets += batches[batch].size();
+        betweenBatches();
+    }
+    return result;
+}
+
+template<typename Baseline>
+Result runBaseline(const std::vector<std::pair<SubscriberId, PacketType>>& subscriptions,
+                   const std::vector<std::vector<Packet>>& batches) {
+    Baseline analyzer;
+    for (const auto& [subscriberId, packetType] : subscriptions) {
+        analyzer.subscribe(subscriberId, packetType);
+    }
+    std::uint64_t warmUpNotifications = 0;
+    LatencyHistogram warmUpLatency;
+    bool warmedUp = false;
+    Result result = measure(batches, [&](const std::vector<Packet>& packets) { analyzer.processPackets(packets); },
+                            [&] {
+                                if (!warmedUp) {
+                                    warmUpNotifications = analyzer.notifications;
+                                    warmUpLatency = analyzer.latency;
+                                    warmedUp = true;
+                                }
+                            });
+    result.notifications = analyzer.notifications - warmUpNotifications;
+    result.latency = analyzer.latency.since(warmUpLatency);
+    return result;
+}
+
+Result runAnalyzer(const Scenario& scenario, const std::vector<std::pair<SubscriberId, PacketType>>& subscriptions,
+                   const std::vector<std::vector<Packet>>& batches) {
+    PacketAnalyzer analyzer;
+    analyzer.enableMetrics();
+
+    // Rings large enough for a whole batch of one type, so nothing is dropped and memory stays bounded
+    const std::size_t capacity = std::bit_ceil(scenario.batchSize);
+    std::vector<SubscriptionChange> changes;
+    for (const auto& [subscriberId, packetType] : subscriptions) {
+        analyzer.configureDelivery(subscriberId, capacity);
+        changes.push_back({subscriberId, packetType, true});
+    }
+    analyzer.applySubscriptionChanges(changes);
+
+    std::vector<SubscriberId> subscribers;
+    for (const auto& [subscriberId, packetType] : subscriptions) {
+        if (subscribers.empty() || subscribers.back() != subscriberId) {
+            subscribers.push_back(subscriberId);
+        }
+    }
+
+    std::uint64_t notifications = 0;
+    LatencyHistogram warmUpLatency;
+    bool warmedUp = false;
+    Result result = measure(batches, [&](const std::vector<Packet>& packets) { analyzer.processPackets(packets); },
+                            [&] {
+                                std::uint64_t drained = 0;
+                                for (SubscriberId subscriberId : subscribers) {
+                                    drained += analyzer.drain(subscriberId, [](const Notification&) {});
+                                }
+                                if (!warmedUp) {
+                                    warmUpLatency = analyzer.metricsSnapshot().latency;
+                                    warmedUp = true;
+                                } else {
+                                    notifications += drained;
+                                }
+                            });
+    result.notifications = notifications;
+    result.latency = analyzer.metricsSnapshot().latency.since(warmUpLatency);
+
+    std::uint64_t dropped = 0;
+    for (SubscriberId subscriberId : subscribers) {
+        dropped += analyzer.deliveryStats(subscriberId).dropped;
+    }
+    if (dropped != 0) {
+        std::printf("warning: %llu notifications dropped\n", static_cast<unsigned long long>(dropped));
+    }
+    return result;
+}
+
+void report(const char* implementation, const Scenario& scenario, const Result& result) {
+    const double seconds = static_cast<double>(result.nanoseconds) / 1e9;
+    std::printf("%-16s %-13s %9zu %6zu %12.0f %12.0f %9.1f %9.1f %9.1f %10.3f\n", implementation,
+                scenario.profile.name.data(), scenario.subscriberCount, scenario.batchSize,
+                static_cast<double>(result.packets) / seconds, static_cast<double>(result.notifications) / seconds,
+                static_cast<double>(result.latency.percentile(0.5)) / 1000,
+                static_cast<double>(result.latency.percentile(0.99)) / 1000,
+                static_cast<double>(result.latency.percentile(0.999)) / 1000,
+                static_cast<double>(result.allocations) / static_cast<double>(result.packets));
+}
+
+int main(int argc, char** argv) {
+    const std::size_t maxSubscribers = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    constexpr std::size_t notificationsPerBatch = 2'000'000; // Roughly, sizes the batches
+    constexpr std::size_t measuredBatches = 8;
+
+    const TrafficProfile profiles[] = {
+        {"uniform/64B", uniformTypeMix(), fixedPayload(64)},
+        {"uniform/imix", uniformTypeMix(), imixPayload()},
+        {"zipf/64B", zipfTypeMix(1.2), fixedPayload(64), 4096, 1.1},
+        {"zipf/imix", zipfTypeMix(1.2), imixPayload(), 4096, 1.1},
+    };
+
+    std::printf("%-16s %-13s %9s %6s %12s %12s %9s %9s %9s %10s\n", "implementation", "traffic", "subs", "batch",
+                "pkts/s", "notif/s", "p50 us", "p99 us", "p999 us", "allocs/pkt");
+    for (std::size_t subscriberCount : {1u, 1'000u, 100'000u, 1'000'000u}) {
+        if (subscriberCount > maxSubscribers) {
+            break;
+        }
+        const auto subscriptions = subscriptionsFor(subscriberCount);
+        // About 5/12 of the subscribers want any given type
+        const std::size_t perPacket = std::max<std::size_t>(subscriberCount * 5 / 12, 1);
+        const std::size_t batchSize = std::clamp<std::size_t>(notificationsPerBatch / perPacket, 32, 4096);
+
+        for (const TrafficProfile& profile : profiles) {
+            const Scenario scenario{profile, subscriberCount, batchSize};
+            TrafficGenerator generator(profile, 2024);
+            std::vector<std::vector<Packet>> batches;
+            for (std::size_t batch = 0; batch <= measuredBatches; ++batch) { // The first one warms up
+                batches.push_back(generator.batch(batchSize));
+            }
+
+            report("sequential", scenario, runBaseline<SequentialAnalyzer>(subscriptions, batches));
+            report("thread-per-type", scenario, runBaseline<ThreadPerTypeAnalyzer>(subscriptions, batches));
+            report("analyzer", scenario, runAnalyzer(scenario, subscriptions, batches));
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+/*
+    Overload control: a traffic burst with and without adaptive sampling.
+
+    Build: g++ -std=c++20 -O2 -pthread 08_overload_shedding.cpp
+
+    A capture thread pushes at a steady rate the workers can keep up with, then bursts as fast as it can,
+    then goes back to the steady rate. Every packet fans out to many subscribers, so the burst is well
+    beyond the analyzer's capacity. Without overload control the ingest rings fill up, Block slows capture
+    down and every delivered packet waits behind a full ring. With it, the controller raises the overload
+    level within a few check intervals; HTTP is given a higher priority and is thinned last. The timeline
+    shows the level and the sampling rate per type, and how full delivery comes back after the burst.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "packet_analyzer.hpp"
+
+constexpr std::size_t subscribersPerType = 200;
+
+struct Phase {
+    std::chrono::milliseconds length;
+    std::chrono::microseconds gap; // Between two packets; 0 pushes as fast as possible
+};
+
+void pushPhase(PacketAnalyzer& analyzer, const Phase& phase, std::uint32_t& flow) {
+    const auto end = std::chrono::steady_clock::now() + phase.length;
+    auto next = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() < end) {
+        analyzer.push({static_cast<PacketType>(flow % packetTypeCount), std::string(64, 'x'),
+                       {0x0a000000 | (flow & 0xffff), 0x0a010001, static_cast<std::uint16_t>(flow), 443}});
+        ++flow;
+        if (phase.gap.count() != 0) {
+            next += phase.gap;
+            while (std::chrono::steady_clock::now() < next) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
+
+void run(bool controlled) {
+    PacketAnalyzer analyzer(2, 4096, IngestPolicy::Block);
+    analyzer.enableMetrics();
+    if (controlled) {
+        analyzer.enableOverloadControl();
+        analyzer.setSheddingPriority(PacketType::HTTP, 2);
+    }
+    std::vector<SubscriberId> subscriberIds;
+    for (std::size_t type = 0; type < packetTypeCount; ++type) {
+        for (std::size_t index = 0; index < subscribersPerType; ++index) {
+            const auto subscriberId = static_cast<SubscriberId>(type * subscribersPerType + index + 1);
+            analyzer.configureDelivery(subscriberId, 1 << 14);
+            analyzer.subscribe(subscriberId, static_cast<PacketType>(type));
+            subscriberIds.push_back(subscriberId);
+        }
+    }
+
+    std::jthread consumer([&](std::stop_token stop) {
+        while (!stop.stop_requested()) {
+            std::size_t drained = 0;
+            for (SubscriberId subscriberId : subscriberIds) {
+                drained += analyzer.drain(subscriberId, [](const Notification&) {});
+            }
+            if (drained == 0) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::printf("\n%s overload control\n%8s %10s %6s %8s %8s %8s\n", controlled ? "With" : "Without", "ms",
+                "depth", "level", "HTTP", "FTP", "SSH");
+    std::atomic<bool> pushing{true};
+    std::jthread monitor([&] {
+        const auto start = std::chrono::steady_clock::now();
+        while (pushing.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            const auto elapsed =
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            std::printf("%8lld %10zu %6u %8llu %8llu %8llu\n", static_cast<long long>(elapsed.count()),
+                        analyzer.ingestStats().depth, analyzer.overloadLevel(),
+                        static_cast<unsigned long long>(analyzer.samplingRate(PacketType::HTTP)),
+                        static_cast<unsigned long long>(analyzer.samplingRate(PacketType::FTP)),
+                        static_cast<unsigned long long>(analyzer.samplingRate(PacketType::SSH)));
+        }
+    });
+
+    const Phase phases[] = {
+        {std::chrono::milliseconds(200), std::chrono::microseconds(100)}, // Steady
+        {std::chrono::milliseconds(300), std::chrono::microseconds(0)},   // Burst
+        {std::chrono::milliseconds(500), std::chrono::microseconds(100)}, // Steady again
+    };
+    std::uint32_t flow = 0;
+    for (const Phase& phase : phases) {
+        pushPhase(analyzer, phase, flow);
+    }
+    analyzer.flush();
+    pushing = false;
+    monitor.join();
+
+    const MetricsSnapshot metrics = analyzer.metricsSnapshot();
+    std::uint64_t shed = 0;
+    for (std::uint64_t count : metrics.shed) {
+        shed += count;
+    }
+    std::printf("pushed %u, shed %llu, p50 %.1f us, p99 %.1f us, max %.1f us\n", flow,
+                static_cast<unsigned long long>(shed), static_cast<double>(metrics.latency.percentile(0.5)) / 1000,
+                static_cast<double>(metrics.latency.percentile(0.99)) / 1000,
+                static_cast<double>(metrics.latencyMaxNanos) / 1000);
+}
+
+int main() {
+    run(false);
+    run(true);
+    return 0;
+}
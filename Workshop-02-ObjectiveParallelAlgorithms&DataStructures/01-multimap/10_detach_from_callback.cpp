@@ -0,0 +1,104 @@
+/*
+    Subscribers that detach or remove themselves from inside their own callback.
+
+    Build: g++ -std=c++20 -O2 -pthread 10_detach_from_callback.cpp
+    Checked build: add -fsanitize=address,undefined (or -fsanitize=thread)
+
+    Callbacks run on the dispatcher thread without its lock, so a subscriber may call detach() or
+    removeSubscriber() on itself. Neither can wait there for the final batch, which only the dispatcher
+    thread delivers, so both return at once. removeSubscriber() must also not free the delivery queue yet:
+    the dispatcher still drains it for the final batch, and the registry would otherwise reclaim it as soon
+    as no worker pins the old snapshot. The removal therefore completes on the dispatcher thread after the
+    final batch.
+
+    Every round attaches a subscriber that removes itself from its first callback, keeps pushing packets,
+    and churns the registry so that retired queues get reclaimed. Under AddressSanitizer, a queue freed too
+    early shows up as a use-after-free. The program returns 1 if a subscriber is still subscribed after
+    removing itself, or is called again once its final batch has been delivered.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <thread>
+
+#include "packet_analyzer.hpp"
+
+constexpr int roundCount = 20;
+constexpr int packetsPerRound = 20'000;
+
+class SelfRemovingSubscriber : public Subscriber {
+public:
+    SelfRemovingSubscriber(PacketAnalyzer& analyzer, bool removeQueue)
+        : analyzer(analyzer), removeQueue(removeQueue) {}
+
+    void onNotifications(SubscriberId id, std::span<const Notification>) override {
+        if (calls++ != 0) {
+            return; // The final batch, possibly in several calls of maxBatch
+        }
+        if (removeQueue) {
+            analyzer.removeSubscriber(id);
+        } else {
+            analyzer.detach(id);
+        }
+    }
+
+    std::atomic<int> calls{0};
+
+private:
+    PacketAnalyzer& analyzer;
+    const bool removeQueue;
+};
+
+void pushPackets(PacketAnalyzer& analyzer) {
+    for (int index = 0; index < packetsPerRound; ++index) {
+        const auto flow = static_cast<std::uint32_t>(index);
+        analyzer.push({static_cast<PacketType>(index % packetTypeCount), "x", {flow, 1, 2, 3}});
+    }
+    analyzer.flush();
+}
+
+// Returns false if the subscriber outlived its own removal
+bool runRound(bool removeQueue) {
+    PacketAnalyzer analyzer(2, 1024, IngestPolicy::Block);
+    SelfRemovingSubscriber subscriber(analyzer, removeQueue);
+    const SubscriberId self = 1;
+    analyzer.configureDelivery(self, 4096, OverflowPolicy::Drop, 64);
+    for (std::size_t type = 0; type < packetTypeCount; ++type) {
+        analyzer.subscribe(self, static_cast<PacketType>(type));
+    }
+    analyzer.attach(self, subscriber, {4, std::chrono::microseconds(50)});
+
+    pushPackets(analyzer);
+    for (SubscriberId other = 100; other < 300; ++other) {
+        analyzer.subscribe(other, PacketType::HTTP);
+        analyzer.removeSubscriber(other);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    // Gone by now: more packets must not reach it
+    const int calls = subscriber.calls.load();
+    pushPackets(analyzer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+    const bool subscribed = analyzer.isSubscribed(self, PacketType::HTTP);
+    const bool ok = subscriber.calls.load() == calls && subscribed != removeQueue;
+    if (!ok) {
+        std::printf("%s: called %d times, %s subscribed\n", removeQueue ? "removeSubscriber" : "detach",
+                    subscriber.calls.load(), subscribed ? "still" : "not");
+    }
+    return ok;
+}
+
+int main() {
+    bool ok = true;
+    for (int index = 0; index < roundCount; ++index) {
+        ok &= runRound(false);
+        ok &= runRound(true);
+    }
+    std::printf("%d rounds of detach() and removeSubscriber() from a callback: %s\n", roundCount,
+                ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,395 @@
+#pragma once
+
+/*
+    Instrumentation for PacketAnalyzer: what it processed, how long packets took from ingest to notification,
+    how busy the workers were and how long threads waited for the analyzer's locks.
+
+    Recording must cost a few nanoseconds and must not add contention of its own, so every thread records
+    into its own MetricsShard: cache-line aligned, written by that thread only, with plain relaxed loads and
+    stores instead of locked read-modify-writes. Reading merges all shards; the reader may see a shard
+    mid-update, which is fine for monitoring.
+
+    Latencies go into a log-linear histogram in the style of HdrHistogram: every power of two is split into
+    32 buckets, so any recorded value is known within about 3% with a fixed, small number of buckets.
+
+    Collection is off until enabled; while off, the hot paths test one flag and skip the clock reads.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ingest_queue.hpp"
+#include "packet.hpp"
+
+// Nanoseconds on the steady clock; 0 means "not stamped"
+inline std::uint64_t metricsClock() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+}
+
+// A counter with a single writer: relaxed load and store, no locked instruction; any thread may read it
+class MetricCounter {
+public:
+    void add(std::uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void raiseTo(std::uint64_t candidate) {
+        if (candidate > value.load(std::memory_order_relaxed)) {
+            value.store(candidate, std::memory_order_relaxed);
+        }
+    }
+
+    std::uint64_t load() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<std::uint64_t> value{0};
+};
+
+class LatencyHistogram {
+public:
+    static constexpr unsigned subBucketBits = 5;
+    static constexpr std::uint64_t subBucketCount = std::uint64_t{1} << subBucketBits;
+    static constexpr unsigned maxExponent = 40; // About 18 minutes in ns; longer values share the last bucket
+    static constexpr std::size_t bucketCount = subBucketCount * (maxExponent - subBucketBits + 2);
+
+    // Values below 32 have a bucket each; above, bucket width doubles with every power of two
+    static constexpr std::size_t bucketOf(std::uint64_t value) {
+        if (value < subBucketCount) {
+            return static_cast<std::size_t>(value);
+        }
+        const unsigned exponent = std::min<unsigned>(static_cast<unsigned>(std::bit_width(value)) - 1, maxExponent);
+        const unsigned shift = exponent - subBucketBits;
+        const std::uint64_t subBucket = std::min(value >> shift, 2 * subBucketCount - 1) - subBucketCount;
+        return static_cast<std::size_t>(subBucketCount * (shift + 1) + subBucket);
+    }
+
+    // Highest value that maps to the bucket
+    static constexpr std::uint64_t bucketUpperBound(std::size_t bucket) {
+        if (bucket < subBucketCount) {
+            return bucket;
+        }
+        const std::uint64_t shift = bucket / subBucketCount - 1;
+        const std::uint64_t subBucket = bucket % subBucketCount;
+        return ((subBucketCount + subBucket + 1) << shift) - 1;
+    }
+
+    void add(std::size_t bucket, std::uint64_t count) {
+        counts[bucket] += count;
+        total += count;
+    }
+
+    // One exact value: its bucket, and the maximum that caps every percentile
+    void record(std::uint64_t value) {
+        add(bucketOf(value), 1);
+        raiseMax(value);
+    }
+
+    // For values added by bucket whose maximum is tracked elsewhere, e.g. merged shards
+    void raiseMax(std::uint64_t value) {
+        highest = std::max(highest, value);
+    }
+
+    std::uint64_t count() const {
+        return total;
+    }
+
+    // What was recorded between an earlier snapshot of the same histogram and this one, e.g. between two
+    // scrapes or around one benchmark phase
+    LatencyHistogram since(const LatencyHistogram& earlier) const {
+        LatencyHistogram difference;
+        for (std::size_t bucket = 0; bucket < bucketCount; ++bucket) {
+            difference.add(bucket, counts[bucket] - earlier.counts[bucket]);
+        }
+        difference.highest = highest; // Still bounds every value recorded in between
+        return difference;
+    }
+
+    // Upper bound of the bucket holding the given fraction of the values, e.g. 0.99, capped at the maximum
+    // when one is known: never below the true percentile, at most about 3% above it. 0 when empty.
+    std::uint64_t percentile(double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        const auto rank = static_cast<std::uint64_t>(fraction * static_cast<double>(total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < bucketCount; ++bucket) {
+            seen += counts[bucket];
+            if (seen >= rank) {
+                return capped(bucketUpperBound(bucket));
+            }
+        }
+        return capped(bucketUpperBound(bucketCount - 1));
+    }
+
+private:
+    std::uint64_t capped(std::uint64_t bound) const {
+        return highest != 0 ? std::min(bound, highest) : bound; // A maximum of 0 leaves only bucket 0
+    }
+
+    std::array<std::uint64_t, bucketCount> counts{};
+    std::uint64_t total = 0;
+    std::uint64_t highest = 0; // Largest value recorded, 0 if unknown
+};
+
+static_assert(LatencyHistogram::bucketOf(31) == 31 && LatencyHistogram::bucketOf(32) == 32);
+static_assert(LatencyHistogram::bucketUpperBound(LatencyHistogram::bucketOf(1000)) >= 1000);
+static_assert(LatencyHistogram::bucketOf(~std::uint64_t{0}) == LatencyHistogram::bucketCount - 1);
+
+// Where a packet's path can wait, with how long it waited: every lock on it, and the backpressure of full
+// rings under the Block policies, which is no lock but stalls the producer the same way. The Block sites
+// count only the pushes that had to wait. The queue lookups of notifySubscriber and drain take no lock; a
+// sleeping worker or dispatcher is woken under its own mutex, which the producer takes only while the
+// thread sleeps.
+enum class LockSite {
+    Batch,         // processPackets callers, one batch at a time
+    Completion,    // Workers reporting the end of their shard of a batch
+    IngestBlock,   // push() callers waiting for space in a full ingest ring (IngestPolicy::Block)
+    DeliveryBlock, // Workers and notifySubscriber waiting for a full delivery ring (OverflowPolicy::Block)
+    Count
+};
+
+constexpr std::size_t lockSiteCount = static_cast<std::size_t>(LockSite::Count);
+
+constexpr std::string_view lockSiteName(LockSite site) {
+    switch (site) {
+    case LockSite::Batch: return "batch";
+    case LockSite::Completion: return "completion";
+    case LockSite::IngestBlock: return "ingest_block";
+    case LockSite::DeliveryBlock: return "delivery_block";
+    default: return "unknown";
+    }
+}
+
+// One thread's recordings
+struct alignas(64) MetricsShard {
+    struct Lock {
+        MetricCounter acquisitions;
+        MetricCounter contended; // Acquisitions that found the lock taken
+        MetricCounter waitNanos;
+        MetricCounter maxWaitNanos;
+    };
+
+    std::array<MetricCounter, packetTypeCount> packets;       // Packets delivered, per type
+    std::array<MetricCounter, packetTypeCount> notifications; // Notifications from type subscriptions
+    std::array<MetricCounter, packetTypeCount> filterMatches; // Notifications from filter subscriptions
+    std::array<Lock, lockSiteCount> locks;
+    MetricCounter latencySumNanos;
+    MetricCounter latencyMaxNanos;
+    std::array<MetricCounter, LatencyHistogram::bucketCount> latency; // Ingest to notification
+
+    void recordLatency(std::uint64_t nanos, std::uint64_t count = 1) {
+        latency[LatencyHistogram::bucketOf(nanos)].add(count);
+        latencySumNanos.add(nanos * count);
+        latencyMaxNanos.raiseTo(nanos);
+    }
+
+    // A wait that is not a lock acquisition: a push held back by a full ring
+    void recordWait(LockSite site, std::uint64_t nanos) {
+        Lock& stats = locks[static_cast<std::size_t>(site)];
+        stats.acquisitions.add(1);
+        stats.contended.add(1);
+        stats.waitNanos.add(nanos);
+        stats.maxWaitNanos.raiseTo(nanos);
+    }
+};
+
+struct LockMetrics {
+    std::uint64_t acquisitions = 0;
+    std::uint64_t contended = 0;
+    std::uint64_t waitNanos = 0;
+    std::uint64_t maxWaitNanos = 0;
+};
+
+struct WorkerMetrics {
+    std::uint64_t packets = 0;
+    std::uint64_t busyNanos = 0; // Delivering batches or stream chunks
+    std::uint64_t idleNanos = 0; // Waiting for work
+};
+
+struct MetricsSnapshot {
+    std::array<std::uint64_t, packetTypeCount> packets{};
+    std::array<std::uint64_t, packetTypeCount> notifications{};
+    std::array<std::uint64_t, packetTypeCount> filterMatches{};
+    std::array<std::uint64_t, packetTypeCount> shed{};         // Left out by overload sampling
+    std::array<std::uint64_t, packetTypeCount> samplingRate{}; // Current N of 1-in-N, 1 for full delivery
+    LatencyHistogram latency;
+    std::uint64_t latencySumNanos = 0;
+    std::uint64_t latencyMaxNanos = 0;
+    std::array<LockMetrics, lockSiteCount> locks{};
+    std::vector<WorkerMetrics> workers;
+    IngestStats ingest;
+
+    // Prometheus text exposition format, for a monitoring agent to scrape
+    void dump(std::ostream& out) const {
+        const auto perType = [&](std::string_view name, std::string_view type, const auto& values) {
+            out << "# TYPE packet_analyzer_" << name << ' ' << type << '\n';
+            for (std::size_t type = 0; type < packetTypeCount; ++type) {
+                out << "packet_analyzer_" << name << "{type=\"" << packetTypeName(static_cast<PacketType>(type))
+                    << "\"} " << values[type] << '\n';
+            }
+        };
+        perType("packets_total", "counter", packets);
+        perType("notifications_total", "counter", notifications);
+        perType("filter_matches_total", "counter", filterMatches);
+        perType("shed_total", "counter", shed);
+        perType("sampling_rate", "gauge", samplingRate);
+
+        // Quantiles are histogram bucket upper bounds capped at the maximum, so they err high, by at most 3%
+        out << "# HELP packet_analyzer_ingest_to_notify_ns Ingest-to-notification latency; quantiles are upper "
+               "bounds, at most 3% high\n"
+            << "# TYPE packet_analyzer_ingest_to_notify_ns summary\n";
+        for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            out << "packet_analyzer_ingest_to_notify_ns{quantile=\"" << quantile << "\"} "
+                << latency.percentile(quantile) << '\n';
+        }
+        out << "packet_analyzer_ingest_to_notify_ns_sum " << latencySumNanos << '\n'
+            << "packet_analyzer_ingest_to_notify_ns_count " << latency.count() << '\n'
+            << "# TYPE packet_analyzer_ingest_to_notify_max_ns gauge\n"
+            << "packet_analyzer_ingest_to_notify_max_ns " << latencyMaxNanos << '\n';
+
+        const auto perWorker = [&](std::string_view name, auto field) {
+            out << "# TYPE packet_analyzer_worker_" << name << " counter\n";
+            for (std::size_t worker = 0; worker < workers.size(); ++worker) {
+                out << "packet_analyzer_worker_" << name << "{worker=\"" << worker << "\"} " << workers[worker].*field
+                    << '\n';
+            }
+        };
+        perWorker("packets_total", &WorkerMetrics::packets);
+        perWorker("busy_ns_total", &WorkerMetrics::busyNanos);
+        perWorker("idle_ns_total", &WorkerMetrics::idleNanos);
+
+        const auto perLock = [&](std::string_view name, std::string_view type, auto field) {
+            out << "# TYPE packet_analyzer_lock_" << name << ' ' << type << '\n';
+            for (std::size_t site = 0; site < lockSiteCount; ++site) {
+                out << "packet_analyzer_lock_" << name << "{lock=\"" << lockSiteName(static_cast<LockSite>(site))
+                    << "\"} " << locks[site].*field << '\n';
+            }
+        };
+        perLock("acquisitions_total", "counter", &LockMetrics::acquisitions);
+        perLock("contended_total", "counter", &LockMetrics::contended);
+        perLock("wait_ns_total", "counter", &LockMetrics::waitNanos);
+        perLock("max_wait_ns", "gauge", &LockMetrics::maxWaitNanos);
+
+        out << "# TYPE packet_analyzer_ingest_accepted_total counter\n"
+            << "packet_analyzer_ingest_accepted_total " << ingest.accepted << '\n'
+            << "# TYPE packet_analyzer_ingest_dropped_total counter\n"
+            << "packet_analyzer_ingest_dropped_total{policy=\"newest\"} " << ingest.droppedNewest << '\n'
+            << "packet_analyzer_ingest_dropped_total{policy=\"oldest\"} " << ingest.droppedOldest << '\n'
+            << "# TYPE packet_analyzer_ingest_blocked_total counter\n"
+            << "packet_analyzer_ingest_blocked_total " << ingest.blocked << '\n'
+            << "# TYPE packet_analyzer_ingest_depth gauge\n"
+            << "packet_analyzer_ingest_depth " << ingest.depth << '\n';
+    }
+};
+
+class AnalyzerMetrics {
+public:
+    AnalyzerMetrics() = default;
+    AnalyzerMetrics(const AnalyzerMetrics&) = delete;
+    AnalyzerMetrics& operator=(const AnalyzerMetrics&) = delete;
+
+    bool enabled() const {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    void enable(bool enable) {
+        on.store(enable, std::memory_order_relaxed);
+    }
+
+    // The calling thread's shard, created on its first recording
+    MetricsShard& local() {
+        // One entry per thread, whatever the number of instances it ever recorded into: the last one used.
+        // Instances are told apart by a number, not their address, which a later instance may reuse, so a
+        // stale entry is never dereferenced.
+        thread_local std::pair<std::uint64_t, MetricsShard*> lastUsed{0, nullptr};
+        if (lastUsed.first == instance) {
+            return *lastUsed.second;
+        }
+        std::lock_guard<std::mutex> guard(mutex);
+        auto [it, inserted] = shardOfThread.try_emplace(std::this_thread::get_id(), nullptr);
+        if (inserted) {
+            shards.push_back(std::make_unique<MetricsShard>());
+            it->second = shards.back().get();
+        }
+        lastUsed = {instance, it->second};
+        return *it->second;
+    }
+
+    // Merges every shard; the worker and ingest fields are left to the analyzer
+    MetricsSnapshot snapshot() const {
+        MetricsSnapshot merged;
+        std::lock_guard<std::mutex> guard(mutex);
+        for (const auto& shard : shards) {
+            for (std::size_t type = 0; type < packetTypeCount; ++type) {
+                merged.packets[type] += shard->packets[type].load();
+                merged.notifications[type] += shard->notifications[type].load();
+                merged.filterMatches[type] += shard->filterMatches[type].load();
+            }
+            for (std::size_t site = 0; site < lockSiteCount; ++site) {
+                const auto& lock = shard->locks[site];
+                merged.locks[site].acquisitions += lock.acquisitions.load();
+                merged.locks[site].contended += lock.contended.load();
+                merged.locks[site].waitNanos += lock.waitNanos.load();
+                merged.locks[site].maxWaitNanos = std::max(merged.locks[site].maxWaitNanos, lock.maxWaitNanos.load());
+            }
+            for (std::size_t bucket = 0; bucket < LatencyHistogram::bucketCount; ++bucket) {
+                if (const std::uint64_t count = shard->latency[bucket].load()) {
+                    merged.latency.add(bucket, count);
+                }
+            }
+            merged.latencySumNanos += shard->latencySumNanos.load();
+            merged.latencyMaxNanos = std::max(merged.latencyMaxNanos, shard->latencyMaxNanos.load());
+            merged.latency.raiseMax(merged.latencyMaxNanos);
+        }
+        return merged;
+    }
+
+    // Locks mutex, recording the acquisition and, if the lock was taken, how long the wait was
+    template<typename Mutex>
+    std::unique_lock<Mutex> lock(Mutex& mutex, LockSite site) {
+        std::unique_lock<Mutex> lock(mutex, std::try_to_lock);
+        if (!enabled()) {
+            if (!lock.owns_lock()) {
+                lock.lock();
+            }
+            return lock;
+        }
+        MetricsShard::Lock& stats = local().locks[static_cast<std::size_t>(site)];
+        stats.acquisitions.add(1);
+        if (!lock.owns_lock()) {
+            const std::uint64_t start = metricsClock();
+            lock.lock();
+            const std::uint64_t waited = metricsClock() - start;
+            stats.contended.add(1);
+            stats.waitNanos.add(waited);
+            stats.maxWaitNanos.raiseTo(waited);
+        }
+        return lock;
+    }
+
+private:
+    static inline std::atomic<std::uint64_t> nextInstance{1};
+
+    const std::uint64_t instance = nextInstance.fetch_add(1);
+    std::atomic<bool> on{false};
+    mutable std::mutex mutex; // Guards shards, not the recordings inside them
+    std::vector<std::unique_ptr<MetricsShard>> shards;
+    std::unordered_map<std::thread::id, MetricsShard*> shardOfThread; // Into shards
+};
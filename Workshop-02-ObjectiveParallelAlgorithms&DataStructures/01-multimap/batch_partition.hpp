@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+    Zero-copy batch partitioning.
+
+    Grouping a batch as std::map<Key, std::vector<Packet>> copies every packet, payload included, and
+    allocates a tree node plus a growing vector per key on every batch. A counting sort over packet
+    indices produces the same grouping without touching a single payload:
+
+        1. keys:    compute the bucket of every packet once
+        2. offsets: histogram of the keys, turned into a prefix sum
+        3. order:   scatter the packet indices into their bucket's slice
+
+    The result is a permutation of indices into the caller's batch; buckets are contiguous slices of it,
+    so adjacent buckets (e.g. all packet types of one shard) form one contiguous span as well.
+    The buffers are kept between batches, so in steady state partitioning does not allocate.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "packet.hpp"
+
+class BatchPartition {
+public:
+    // keyOf(packet) must return a bucket index below bucketCount
+    template<typename KeyOf>
+    void partition(std::span<const Packet> packets, std::size_t bucketCount, KeyOf&& keyOf) {
+        keys.resize(packets.size());
+        order.resize(packets.size());
+        offsets.assign(bucketCount + 1, 0);
+
+        for (std::size_t index = 0; index < packets.size(); ++index) {
+            keys[index] = static_cast<std::uint32_t>(keyOf(packets[index]));
+            ++offsets[keys[index] + 1];
+        }
+        for (std::size_t bucket = 0; bucket < bucketCount; ++bucket) {
+            offsets[bucket + 1] += offsets[bucket];
+        }
+
+        // Stable scatter: packets keep their batch order inside a bucket
+        cursor.assign(offsets.begin(), offsets.end() - 1);
+        for (std::size_t index = 0; index < packets.size(); ++index) {
+            order[cursor[keys[index]]++] = static_cast<std::uint32_t>(index);
+        }
+    }
+
+    // Indices of the packets in one bucket
+    std::span<const std::uint32_t> bucket(std::size_t bucketIndex) const {
+        return buckets(bucketIndex, bucketIndex + 1);
+    }
+
+    // Indices of the packets in buckets [firstBucket, lastBucket)
+    std::span<const std::uint32_t> buckets(std::size_t firstBucket, std::size_t lastBucket) const {
+        return std::span<const std::uint32_t>(order).subspan(offsets[firstBucket],
+                                                             offsets[lastBucket] - offsets[firstBucket]);
+    }
+
+private:
+    std::vector<std::uint32_t> keys;
+    std::vector<std::uint32_t> offsets; // bucketCount + 1 prefix sums
+    std::vector<std::uint32_t> cursor;
+    std::vector<std::uint32_t> order;   // The permutation
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+/*
+    Per-subscriber delivery queue.
+
+    Every subscriber gets its own bounded MPSC ring: the workers are the producers, the subscriber is the only
+    consumer and drains the ring at its own pace. Workers fanning out to different subscribers never touch the
+    same memory, and workers fanning out to the same subscriber only share its enqueue counter, so there is
+    no global lock left on the notification path.
+
+    A notification describes the packet, it does not own the payload: the batch given to processPackets
+    belongs to the caller and may be gone by the time the subscriber drains.
+
+    When a slow subscriber lets its ring fill up, the OverflowPolicy decides what happens:
+    - Drop:  the new notification is discarded and counted, the worker moves on
+    - Block: the worker waits for the subscriber to free a slot, which stalls its shard;
+             only for subscribers that must see everything and are known to keep up
+    Both policies count, so a subscriber can always tell how much it missed or how often it held workers up.
+
+    A queue configured with a reorder window hands notifications over in sequence order instead
+    (reorder_buffer.hpp): drain is then given the analyzer's watermark and releases only what is below it.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+
+#include "mpsc_ring.hpp"
+#include "packet.hpp"
+#include "reorder_buffer.hpp"
+
+struct Notification {
+    PacketType type;
+    std::uint32_t length = 0; // Payload size in bytes
+    FlowKey flow{};
+    std::uint64_t sequence = 0; // Unique over all packets of the analyzer, increasing within a flow
+    std::uint64_t ingestNanos = 0; // metricsClock() when the packet entered the analyzer; 0 if not stamped
+};
+
+enum class OverflowPolicy {
+    Drop,
+    Block,
+};
+
+// How a queue was created, so that it can be created again, e.g. from a subscription snapshot
+struct DeliveryConfig {
+    std::size_t capacity = 1024;
+    OverflowPolicy policy = OverflowPolicy::Drop;
+    std::size_t reorderWindow = 0; // 0: arrival order
+};
+
+struct DeliveryStats {
+    std::uint64_t delivered = 0; // Accepted into the ring
+    std::uint64_t dropped = 0;   // Discarded because the ring was full (Drop policy)
+    std::uint64_t blocked = 0;   // Pushes that had to wait for space (Block policy)
+    std::size_t depth = 0;       // Notifications waiting to be drained, in the ring
+    std::size_t held = 0;        // Drained from the ring but held back by the reorder window
+    std::uint64_t outOfOrder = 0; // Handed over after a larger sequence, because the reorder window was full
+};
+
+class DeliveryQueue {
+public:
+    // reorderWindow 0: notifications are handed over in arrival order
+    explicit DeliveryQueue(std::size_t capacity = 1024, OverflowPolicy policy = OverflowPolicy::Drop,
+                           std::size_t reorderWindow = 0)
+        : ring(capacity), policy(policy),
+          reorder(reorderWindow == 0 ? nullptr : std::make_unique<ReorderBuffer<Notification>>(reorderWindow)) {}
+
+    bool ordered() const {
+        return reorder != nullptr;
+    }
+
+    DeliveryConfig config() const {
+        return {ring.capacity(), policy, reorder ? reorder->capacity() : 0};
+    }
+
+    // Producer side, called by the workers. If the push has to wait for space (Block policy), wakeConsumer is
+    // called first: a consumer asleep until the next wake-up would otherwise never free a slot. If waitedNanos
+    // is given, the wait is added to it; the clock is read only then.
+    void push(const Notification& notification, std::uint64_t* waitedNanos = nullptr,
+              const std::function<void()>& wakeConsumer = {}) {
+        if (ring.tryPush(notification)) {
+            return;
+        }
+        if (policy == OverflowPolicy::Drop) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        blocked.fetch_add(1, std::memory_order_relaxed);
+        if (wakeConsumer) {
+            wakeConsumer();
+        }
+        const auto start = waitedNanos != nullptr ? std::chrono::steady_clock::now()
+                                                  : std::chrono::steady_clock::time_point{};
+        while (!ring.tryPush(notification)) {
+            std::this_thread::yield();
+        }
+        if (waitedNanos != nullptr) {
+            *waitedNanos += static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                    .count());
+        }
+    }
+
+    // Consumer side: hands at most maxCount notifications to consume, returns how many.
+    // An ordered queue releases only sequences below watermark, in order; the caller must have read the
+    // watermark before calling, so that everything below it is already in the ring.
+    template<typename Consumer>
+    std::size_t drain(Consumer&& consume, std::size_t maxCount = std::numeric_limits<std::size_t>::max(),
+                      std::uint64_t watermark = std::numeric_limits<std::uint64_t>::max()) {
+        std::size_t drained = 0;
+        Notification notification;
+        if (!reorder) {
+            while (drained < maxCount && ring.tryPop(notification)) {
+                consume(notification);
+                ++drained;
+            }
+            return drained;
+        }
+
+        // Counts every notification handed over after one with a larger sequence
+        const auto handOver = [&](const Notification& released) {
+            if (released.sequence < nextSequence) {
+                outOfOrder.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                nextSequence = released.sequence + 1;
+            }
+            consume(released);
+        };
+        while (drained < maxCount) {
+            while (!reorder->full() && ring.tryPop(notification)) {
+                reorder->insert(notification);
+            }
+            const std::size_t released = reorder->release(watermark, handOver, maxCount - drained);
+            drained += released;
+            if (released > 0) {
+                continue;
+            }
+            if (!reorder->full() || ring.size() == 0) {
+                break; // The rest waits for the watermark
+            }
+            // Full window, nothing releasable, more in the ring: give up order on the oldest to make progress
+            reorder->releaseOldest(handOver);
+            ++drained;
+        }
+        held.store(reorder->size(), std::memory_order_relaxed);
+        return drained;
+    }
+
+    DeliveryStats stats() const {
+        return {ring.pushed(), dropped.load(std::memory_order_relaxed), blocked.load(std::memory_order_relaxed),
+                ring.size(), held.load(std::memory_order_relaxed), outOfOrder.load(std::memory_order_relaxed)};
+    }
+
+private:
+    MpscRing<Notification> ring;
+    const OverflowPolicy policy;
+    // Only touched on overflow; successful pushes are counted by the ring's enqueue position
+    std::atomic<std::uint64_t> dropped{0};
+    std::atomic<std::uint64_t> blocked{0};
+    std::unique_ptr<ReorderBuffer<Notification>> reorder; // Consumer only; nullptr when unordered
+    std::uint64_t nextSequence = 0;                        // Consumer only: one past the largest released
+    std::atomic<std::size_t> held{0};                      // reorder->size() for stats()
+    std::atomic<std::uint64_t> outOfOrder{0};
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+/*
+    Flat, type-indexed subscriber table.
+
+    The original PacketAnalyzer keeps a std::multimap<PacketType, SubscriberId>. Every fan-out walks
+    red-black tree nodes scattered over the heap, and every unsubscribe scans the whole equal_range of
+    a type looking for one subscriber.
+
+    Here each PacketType indexes a contiguous std::vector<SubscriberId>, so fan-out is a linear walk
+    over a dense array that the hardware prefetcher handles well. Order inside a type does not matter
+    for notification, which allows swap-remove: the last subscriber is moved into the freed slot, so
+    unsubscribe is O(1). To find that slot without scanning, the reverse index remembers, for every
+    subscriber, the bit mask of its types and its position inside each per-type vector.
+*/
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "packet.hpp"
+
+static_assert(packetTypeCount <= 64, "The reverse index keeps the types of a subscriber in a 64-bit mask");
+
+class FlatSubscriberTable {
+public:
+    // Returns false if the subscriber was already subscribed to this type
+    bool subscribe(SubscriberId subscriberId, PacketType packetType) {
+        const std::size_t type = packetTypeIndex(packetType);
+        Entry& entry = entries[subscriberId];
+        if (entry.typeMask & typeBit(type)) {
+            return false;
+        }
+
+        entry.typeMask |= typeBit(type);
+        entry.position[type] = static_cast<std::uint32_t>(subscribersByType[type].size());
+        subscribersByType[type].push_back(subscriberId);
+        ownersByType[type].push_back(&entry); // Node-based map: the address stays valid
+        return true;
+    }
+
+    // Returns false if the subscriber was not subscribed to this type
+    bool unsubscribe(SubscriberId subscriberId, PacketType packetType) {
+        auto it = entries.find(subscriberId);
+        if (it == entries.end()) {
+            return false;
+        }
+        if (!removeFromType(it->second, packetTypeIndex(packetType))) {
+            return false;
+        }
+        if (it->second.typeMask == 0) {
+            entries.erase(it);
+        }
+        return true;
+    }
+
+    // Drops every subscription of the subscriber, returns how many were removed
+    std::size_t unsubscribeAll(SubscriberId subscriberId) {
+        auto it = entries.find(subscriberId);
+        if (it == entries.end()) {
+            return 0;
+        }
+        std::size_t removed = 0;
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            removed += removeFromType(it->second, type) ? 1 : 0;
+        }
+        entries.erase(it);
+        return removed;
+    }
+
+    // Contiguous view over the subscribers of one type, invalidated by the next subscribe/unsubscribe
+    std::span<const SubscriberId> subscribers(PacketType packetType) const {
+        return subscribersByType[packetTypeIndex(packetType)];
+    }
+
+    bool isSubscribed(SubscriberId subscriberId, PacketType packetType) const {
+        return subscriptionMask(subscriberId) & typeBit(packetTypeIndex(packetType));
+    }
+
+    // Bit i is set if the subscriber wants packets of PacketType i
+    std::uint64_t subscriptionMask(SubscriberId subscriberId) const {
+        auto it = entries.find(subscriberId);
+        return it == entries.end() ? 0 : it->second.typeMask;
+    }
+
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // Index of the subscriber inside subscribers(packetType), npos if not subscribed
+    std::size_t position(SubscriberId subscriberId, PacketType packetType) const {
+        auto it = entries.find(subscriberId);
+        const std::size_t type = packetTypeIndex(packetType);
+        if (it == entries.end() || !(it->second.typeMask & typeBit(type))) {
+            return npos;
+        }
+        return it->second.position[type];
+    }
+
+    std::size_t subscriberCount() const {
+        return entries.size();
+    }
+
+    void reserve(PacketType packetType, std::size_t subscriberCount) {
+        subscribersByType[packetTypeIndex(packetType)].reserve(subscriberCount);
+        ownersByType[packetTypeIndex(packetType)].reserve(subscriberCount);
+    }
+
+    // Sizes the reverse index for subscriberCount subscribers in total
+    void reserveSubscribers(std::size_t subscriberCount) {
+        entries.reserve(subscriberCount);
+    }
+
+private:
+    struct Entry {
+        std::uint64_t typeMask = 0;
+        std::array<std::uint32_t, packetTypeCount> position{}; // Valid only where typeMask has the bit set
+    };
+
+    static constexpr std::uint64_t typeBit(std::size_t type) {
+        return std::uint64_t{1} << type;
+    }
+
+    bool removeFromType(Entry& entry, std::size_t type) {
+        if (!(entry.typeMask & typeBit(type))) {
+            return false;
+        }
+
+        auto& ids = subscribersByType[type];
+        auto& owners = ownersByType[type];
+        const std::uint32_t hole = entry.position[type];
+
+        // Swap-remove: move the last subscriber into the hole and patch its reverse index entry
+        ids[hole] = ids.back();
+        owners[hole] = owners.back();
+        owners[hole]->position[type] = hole;
+        ids.pop_back();
+        owners.pop_back();
+
+        entry.typeMask &= ~typeBit(type);
+        return true;
+    }
+
+    std::array<std::vector<SubscriberId>, packetTypeCount> subscribersByType;
+    std::array<std::vector<Entry*>, packetTypeCount> ownersByType; // Parallel to subscribersByType
+    std::unordered_map<SubscriberId, Entry> entries;                // Reverse index
+};
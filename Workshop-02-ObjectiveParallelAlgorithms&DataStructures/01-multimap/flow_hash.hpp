@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+    Receive Side Scaling style flow steering.
+
+    NICs spread traffic over cores by hashing the flow 5-tuple with the Toeplitz hash and looking the
+    low bits of the hash up in an indirection table of queue numbers. All packets of one flow land on the
+    same core, so per-flow state never has to be shared, while many flows of the same protocol still spread
+    over every core.
+
+    ToeplitzHash precomputes, for each input byte position and byte value, the XOR of the key windows that
+    the set bits select. Hashing the 12-byte IPv4 tuple is then 12 table lookups instead of 96 bit steps.
+*/
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "packet.hpp"
+
+// The key from the Microsoft RSS specification, used by most NIC drivers by default
+constexpr std::array<std::uint8_t, 40> defaultRssKey = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+// A repeating 16-bit pattern makes the hash symmetric: both directions of a connection hash the same
+constexpr std::array<std::uint8_t, 40> symmetricRssKey = {
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+};
+
+class ToeplitzHash {
+public:
+    static constexpr std::size_t inputBytes = 12; // IPv4 addresses + ports
+
+    explicit ToeplitzHash(const std::array<std::uint8_t, 40>& key = defaultRssKey) {
+        for (std::size_t position = 0; position < inputBytes; ++position) {
+            for (std::size_t value = 0; value < 256; ++value) {
+                std::uint32_t contribution = 0;
+                for (std::size_t bit = 0; bit < 8; ++bit) {
+                    if (value & (0x80u >> bit)) {
+                        contribution ^= keyWindow(key, position * 8 + bit);
+                    }
+                }
+                table[position][value] = contribution;
+            }
+        }
+    }
+
+    std::uint32_t operator()(const FlowKey& flow) const {
+        // RSS input order for IPv4/TCP: source address, destination address, source port, destination port,
+        // each in network byte order
+        const std::uint8_t input[inputBytes] = {
+            byteOf(flow.sourceAddress, 3), byteOf(flow.sourceAddress, 2),
+            byteOf(flow.sourceAddress, 1), byteOf(flow.sourceAddress, 0),
+            byteOf(flow.destinationAddress, 3), byteOf(flow.destinationAddress, 2),
+            byteOf(flow.destinationAddress, 1), byteOf(flow.destinationAddress, 0),
+            byteOf(flow.sourcePort, 1), byteOf(flow.sourcePort, 0),
+            byteOf(flow.destinationPort, 1), byteOf(flow.destinationPort, 0),
+        };
+
+        std::uint32_t hash = 0;
+        for (std::size_t position = 0; position < inputBytes; ++position) {
+            hash ^= table[position][input[position]];
+        }
+        return hash;
+    }
+
+private:
+    // The 32 key bits starting at bitOffset, most significant bit first
+    static std::uint32_t keyWindow(const std::array<std::uint8_t, 40>& key, std::size_t bitOffset) {
+        std::uint32_t window = 0;
+        for (std::size_t bit = 0; bit < 32; ++bit) {
+            const std::size_t keyBit = bitOffset + bit;
+            const bool set = key[keyBit / 8] & (0x80u >> (keyBit % 8));
+            window = (window << 1) | (set ? 1u : 0u);
+        }
+        return window;
+    }
+
+    static constexpr std::uint8_t byteOf(std::uint32_t value, unsigned byte) {
+        return static_cast<std::uint8_t>(value >> (byte * 8));
+    }
+
+    std::array<std::array<std::uint32_t, 256>, inputBytes> table{};
+};
+
+// Maps a flow hash to a shard through an indirection table, like the RSS redirection table of a NIC.
+// Rewriting entries moves hash buckets between shards without touching the hash.
+class FlowSteering {
+public:
+    static constexpr std::size_t tableSize = 128;
+
+    explicit FlowSteering(std::size_t shardCount, const std::array<std::uint8_t, 40>& key = defaultRssKey)
+        : hash(key) {
+        for (std::size_t bucket = 0; bucket < tableSize; ++bucket) {
+            indirection[bucket].store(static_cast<std::uint16_t>(bucket % shardCount), std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t shardOf(const FlowKey& flow) const {
+        return indirection[hash(flow) % tableSize].load(std::memory_order_relaxed);
+    }
+
+    // May run while other threads steer packets; a flow moved mid-stream can be reordered once
+    void assign(std::size_t bucket, std::size_t shard) {
+        indirection[bucket].store(static_cast<std::uint16_t>(shard), std::memory_order_relaxed);
+    }
+
+private:
+    ToeplitzHash hash;
+    std::array<std::atomic<std::uint16_t>, tableSize> indirection;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+/*
+    Bounded ingest queue for streaming packets into a worker.
+
+    processPackets is stop-and-go: the caller hands over a batch and waits for the slowest shard before it
+    can hand over the next one. In streaming mode capture threads push packets one by one into the ring of
+    the worker owning the packet's flow, and the worker drains it in chunks while the next packets arrive.
+
+    The ring is bounded, so a capture thread that outruns its worker has to give something up. The
+    IngestPolicy chooses what:
+    - Block:      the capture thread waits for a free slot; nothing is lost, capture slows down
+    - DropNewest: the packet being pushed is discarded; what is queued is delivered
+    - DropOldest: the oldest queued packet is evicted to make room; delivery stays as fresh as possible
+    DropOldest needs producers to pop, so every pop of this ring goes through tryPopShared.
+
+    The packet, payload included, is moved into the ring: nothing is copied between capture and worker.
+    It travels with what the analyzer stamped on it at ingest.
+
+    Sequence numbers are not taken at push: that would be a read-modify-write of one counter shared by all
+    capture threads, per packet. The ring's own positions already order the packets of one ring, so pop
+    maps the run of positions it takes onto a contiguous range of the analyzer's sequencer, one fetch_add
+    per chunk. Packets of one ring, and so of one flow, keep their push order; runs taken from different
+    rings are ordered by when their worker took them. Before it takes the range, pop publishes the range's
+    lowest possible number as the queue's floor, and settle() lifts it once the run has been delivered, so
+    deliveredBelow is a single acquire load. Push and pop stay lock-free.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mpsc_ring.hpp"
+#include "packet.hpp"
+
+enum class IngestPolicy {
+    Block,
+    DropNewest,
+    DropOldest,
+};
+
+struct IngestStamp {
+    std::uint64_t ingestNanos = 0; // metricsClock() at push, 0 while metrics are off
+    std::uint64_t sequence = 0;    // Set by IngestQueue::pop
+};
+
+struct IngestedPacket {
+    Packet packet;
+    IngestStamp stamp;
+};
+
+struct IngestStats {
+    std::uint64_t accepted = 0;      // Packets that entered the ring
+    std::uint64_t droppedNewest = 0; // Rejected because the ring was full (DropNewest)
+    std::uint64_t droppedOldest = 0; // Evicted from a full ring to make room (DropOldest)
+    std::uint64_t blocked = 0;       // Pushes that had to wait for space (Block)
+    std::size_t depth = 0;           // Packets waiting for the worker
+};
+
+class IngestQueue {
+public:
+    explicit IngestQueue(std::size_t capacity = 4096, IngestPolicy policy = IngestPolicy::Block)
+        : ring(capacity), policy(policy) {}
+
+    // Producer side, any thread. Returns false if the packet was dropped (DropNewest only). If waitedNanos is
+    // given and the push has to wait for space (Block), the wait is added to it.
+    bool push(IngestedPacket&& packet, std::uint64_t* waitedNanos = nullptr) {
+        if (ring.tryPush(std::move(packet))) {
+            return true;
+        }
+        switch (policy) {
+        case IngestPolicy::DropNewest:
+            droppedNewest.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        case IngestPolicy::DropOldest: {
+            IngestedPacket evicted;
+            while (!ring.tryPush(std::move(packet))) {
+                if (ring.tryPopShared(evicted)) {
+                    droppedOldest.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return true;
+        }
+        case IngestPolicy::Block:
+            break;
+        }
+        blocked.fetch_add(1, std::memory_order_relaxed);
+        const auto start = waitedNanos != nullptr ? std::chrono::steady_clock::now()
+                                                  : std::chrono::steady_clock::time_point{};
+        while (!ring.tryPush(std::move(packet))) {
+            std::this_thread::yield();
+        }
+        if (waitedNanos != nullptr) {
+            *waitedNanos += static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                    .count());
+        }
+        return true;
+    }
+
+    // Producer side, never waits nor evicts whatever the policy; the packet is moved from only on success
+    bool tryPush(IngestedPacket&& packet) {
+        return ring.tryPush(std::move(packet));
+    }
+
+    // Consumer side: replaces the contents of packets and stamps with at most maxCount queued packets and
+    // their stamps, numbered from sequencer in ring order, and returns how many. The vectors keep their
+    // capacity, so a steady consumer does not allocate. The numbers count as in flight until settle().
+    std::size_t pop(std::vector<Packet>& packets, std::vector<IngestStamp>& stamps, std::size_t maxCount,
+                    std::atomic<std::uint64_t>& sequencer) {
+        packets.clear();
+        stamps.clear();
+        while (packets.size() < maxCount && ring.tryPopShared(scratch)) {
+            packets.push_back(std::move(scratch.packet));
+            stamps.push_back(scratch.stamp);
+        }
+        if (!packets.empty()) {
+            // The floor goes up before the numbers are taken, so no watermark can pass them
+            floor.store(sequencer.load());
+            std::uint64_t sequence = sequencer.fetch_add(packets.size());
+            for (IngestStamp& stamp : stamps) {
+                stamp.sequence = sequence++;
+            }
+        }
+        return packets.size();
+    }
+
+    // Consumer side: the packets of the last pop have been delivered
+    void settle() {
+        floor.store(idle, std::memory_order_release);
+    }
+
+    // Every packet of this queue numbered below the result has been delivered or dropped. assigned must be
+    // read from the sequencer before the call; packets still in the ring are numbered above it.
+    std::uint64_t deliveredBelow(std::uint64_t assigned) const {
+        return std::min(assigned, floor.load(std::memory_order_acquire));
+    }
+
+    std::size_t size() const {
+        return ring.size();
+    }
+
+    std::size_t capacity() const {
+        return ring.capacity();
+    }
+
+    // Positions of the ring: every packet below popped() has been taken by the consumer or evicted
+    std::uint64_t pushed() const {
+        return ring.pushed();
+    }
+
+    std::uint64_t popped() const {
+        return ring.popped();
+    }
+
+    IngestStats stats() const {
+        return {ring.pushed(), droppedNewest.load(std::memory_order_relaxed),
+                droppedOldest.load(std::memory_order_relaxed), blocked.load(std::memory_order_relaxed), ring.size()};
+    }
+
+private:
+    static constexpr std::uint64_t idle = std::numeric_limits<std::uint64_t>::max();
+
+    MpscRing<IngestedPacket> ring;
+    const IngestPolicy policy;
+    IngestedPacket scratch; // Consumer only
+    // Lowest number of the popped run being delivered, idle between runs
+    alignas(64) std::atomic<std::uint64_t> floor{idle};
+    std::atomic<std::uint64_t> droppedNewest{0};
+    std::atomic<std::uint64_t> droppedOldest{0};
+    std::atomic<std::uint64_t> blocked{0};
+};
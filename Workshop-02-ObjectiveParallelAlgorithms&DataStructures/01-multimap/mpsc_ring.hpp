@@ -0,0 +1,135 @@
+#pragma once
+
+/*
+    Bounded multi-producer single-consumer ring buffer.
+
+    This is Dmitry Vyukov's bounded queue: every cell carries a sequence number that tells producers and the
+    consumer whose turn the cell is. Producers claim a position with one CAS on the enqueue counter and then
+    publish the cell by bumping its sequence; the consumer reads cells in order without any CAS at all.
+    No locks, no allocation after construction, and producers only contend with each other on one counter.
+
+    The capacity is rounded up to a power of two so positions map to cells with a mask.
+
+    tryPopShared claims cells with a CAS on the dequeue counter instead, which is Vyukov's multi-consumer
+    variant. A ring whose consumers all use it can be popped from any thread, e.g. by a producer evicting
+    the oldest entry to make room.
+*/
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+template<typename T>
+class MpscRing {
+public:
+    explicit MpscRing(std::size_t capacity)
+        : mask(std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity) - 1),
+          cells(std::make_unique<Cell[]>(mask + 1)) {
+        for (std::size_t position = 0; position <= mask; ++position) {
+            cells[position].sequence.store(position, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    // Any thread. Returns false if the ring is full.
+    bool tryPush(const T& value) {
+        return pushWith([&](T& cell) { cell = value; });
+    }
+
+    // Moves from value only if the push succeeds, so a failed push can be retried with the same value
+    bool tryPush(T&& value) {
+        return pushWith([&](T& cell) { cell = std::move(value); });
+    }
+
+    // Consumer thread only. Returns false if the ring is empty.
+    bool tryPop(T& value) {
+        const std::size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        Cell& cell = cells[position & mask];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<std::ptrdiff_t>(sequence - (position + 1)) < 0) {
+            return false;
+        }
+        value = std::move(cell.value);
+        cell.sequence.store(position + mask + 1, std::memory_order_release); // Free the cell for the next lap
+        dequeuePosition.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Any thread, as long as no consumer of this ring uses tryPop. Returns false if the ring is empty.
+    bool tryPopShared(T& value) {
+        std::size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto lag = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+            if (lag == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false; // No producer has published this cell yet
+            } else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate while producers or the consumer are active
+    std::size_t size() const {
+        const std::size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        const std::size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    // Number of successful pushes since construction
+    std::size_t pushed() const {
+        return enqueuePosition.load(std::memory_order_relaxed);
+    }
+
+    // Number of successful pops since construction
+    std::size_t popped() const {
+        return dequeuePosition.load(std::memory_order_relaxed);
+    }
+
+    std::size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value{};
+    };
+
+    template<typename Store>
+    bool pushWith(Store&& store) {
+        std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+            if (lag == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    store(cell.value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false; // The consumer has not freed this cell yet
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    const std::size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<std::size_t> enqueuePosition{0}; // Shared by the producers
+    alignas(64) std::atomic<std::size_t> dequeuePosition{0}; // Written by the consumer(s)
+};
@@ -0,0 +1,298 @@
+#pragma once
+
+/*
+    Batched, push-style delivery on top of the per-subscriber rings.
+
+    drain() leaves it to every subscriber to poll its ring. A Subscriber attached to the dispatcher is
+    called instead, with a whole batch of notifications per call: either when maxBatch of them are waiting
+    or when the oldest one has waited maxDelay since its packet was ingested, whichever comes first. One
+    virtual call, one buffer, one pass over the registrations per batch instead of per packet; maxDelay
+    bounds how long a quiet subscriber's last notifications can sit in the buffer.
+
+    A single dispatcher thread serves all attached subscribers, so callbacks should hand heavy work off
+    rather than do it inline. Callbacks run without the dispatcher's lock, so they may attach and detach.
+    An attached subscriber's ring must not be drained by anyone else.
+
+    With nothing buffered the dispatcher sleeps until a producer calls wakeIfSleeping() after pushing, after
+    moving the watermark, or before waiting on a full ring (OverflowPolicy::Block); that call costs one atomic
+    read-modify-write while the dispatcher is busy.
+
+    Queues with a reorder window are drained up to a watermark, asked once per sweep from the callback
+    given at construction (the analyzer's deliveredWatermark).
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "delivery_queue.hpp"
+#include "packet.hpp"
+
+class Subscriber {
+public:
+    virtual ~Subscriber() = default;
+
+    // Called on the dispatcher thread; the span is only valid during the call
+    virtual void onNotifications(SubscriberId subscriberId, std::span<const Notification> batch) = 0;
+};
+
+struct BatchPolicy {
+    std::size_t maxBatch = 64;
+    std::chrono::microseconds maxDelay{1000};
+};
+
+class NotificationDispatcher {
+public:
+    using Watermark = std::function<std::uint64_t()>;
+
+    // Without a watermark, ordered queues release only what their window forces out
+    explicit NotificationDispatcher(Watermark watermark = {}) : watermark(std::move(watermark)) {}
+
+    ~NotificationDispatcher() {
+        if (thread.joinable()) {
+            thread.request_stop();
+            thread.join();
+        }
+    }
+
+    NotificationDispatcher(const NotificationDispatcher&) = delete;
+    NotificationDispatcher& operator=(const NotificationDispatcher&) = delete;
+
+    // Returns false if the subscriber is already attached. The thread starts with the first attachment.
+    bool attach(SubscriberId subscriberId, DeliveryQueue& queue, Subscriber& subscriber, BatchPolicy policy) {
+        std::lock_guard<std::mutex> guard(mutex);
+        policy.maxBatch = std::max<std::size_t>(policy.maxBatch, 1);
+        auto [it, inserted] = registrations.try_emplace(subscriberId, Registration{&queue, &subscriber, policy});
+        if (!inserted) {
+            return false;
+        }
+        it->second.buffer.reserve(policy.maxBatch);
+        attachedCount.fetch_add(1, std::memory_order_relaxed);
+        if (!thread.joinable()) {
+            thread = std::jthread([this](std::stop_token stop) { run(stop); });
+        }
+        signalled = true; // The queue may already hold notifications
+        wake.notify_one();
+        return true;
+    }
+
+    // Has the dispatcher thread deliver everything that can be collected, then stop calling the subscriber.
+    // Waits for that final batch, except when called from a callback: it returns at once then, and the final
+    // batch follows once the callback has returned. afterwards runs once the dispatcher no longer touches the
+    // queue, e.g. to free it: on the caller's thread before returning, or on the dispatcher thread after the
+    // final batch when called from a callback. Returns false, without running afterwards, if the subscriber
+    // was not attached.
+    bool detach(SubscriberId subscriberId, std::function<void()> afterwards = {}) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = registrations.find(subscriberId);
+        if (it == registrations.end()) {
+            return false;
+        }
+        it->second.detaching = true;
+        signalled = true;
+        wake.notify_one();
+        if (std::this_thread::get_id() == thread.get_id()) {
+            if (afterwards) {
+                it->second.afterDetach.push_back(std::move(afterwards));
+            }
+            return true;
+        }
+        // The next sweep to start sees the flag; once it has finished, the subscriber is gone
+        const std::uint64_t sweep = sweepsStarted + 1;
+        swept.wait(lock, [&] { return sweepsFinished >= sweep; });
+        lock.unlock();
+        if (afterwards) {
+            afterwards();
+        }
+        return true;
+    }
+
+    bool isAttached(SubscriberId subscriberId) const {
+        std::lock_guard<std::mutex> guard(mutex);
+        auto it = registrations.find(subscriberId);
+        return it != registrations.end() && !it->second.detaching;
+    }
+
+    // Whether any subscriber is attached: producers stamp the ingest time only then
+    bool active() const {
+        return attachedCount.load(std::memory_order_relaxed) != 0;
+    }
+
+    // Producer side, after pushing notifications or moving the watermark
+    void wakeIfSleeping() {
+        // A read-modify-write rather than a load: it is ordered before or after the dispatcher's exchange,
+        // and if before, the dispatcher's pending() check sees what was just pushed
+        if (sleeping.fetch_or(0, std::memory_order_acq_rel) != 0) {
+            std::lock_guard<std::mutex> guard(mutex);
+            signalled = true;
+            wake.notify_one();
+        }
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Registration {
+        DeliveryQueue* queue;
+        Subscriber* subscriber;
+        BatchPolicy policy;
+        std::vector<Notification> buffer{}; // Collected, not yet delivered
+        Clock::time_point oldest{};         // Ingest time of the oldest buffered notification
+        bool detaching = false;             // Final delivery and removal at the next sweep
+        std::vector<std::function<void()>> afterDetach{}; // Run once the queue is no longer touched
+    };
+
+    // A buffer taken out of its registration, delivered with the lock released
+    struct Batch {
+        SubscriberId subscriberId;
+        Subscriber* subscriber;
+        std::vector<Notification> notifications;
+    };
+
+    void run(std::stop_token stop) {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::vector<Batch> due;
+        std::vector<std::vector<Notification>> spare; // Delivered buffers, reused
+        std::vector<std::function<void()>> afterDetach; // Of registrations erased in this sweep
+        while (!stop.stop_requested()) {
+            ++sweepsStarted;
+            signalled = false;
+            const Clock::time_point now = Clock::now();
+            Clock::time_point nextDeadline = Clock::time_point::max();
+            const std::uint64_t limit = currentWatermark();
+            for (auto it = registrations.begin(); it != registrations.end();) {
+                auto& [subscriberId, registration] = *it;
+                if (registration.detaching) {
+                    // Everything collectable, in batches of maxBatch, then the registration goes
+                    while (collect(registration, now, limit), !registration.buffer.empty()) {
+                        due.push_back({subscriberId, registration.subscriber, takeBuffer(registration, spare)});
+                    }
+                    std::move(registration.afterDetach.begin(), registration.afterDetach.end(),
+                              std::back_inserter(afterDetach));
+                    it = registrations.erase(it);
+                    attachedCount.fetch_sub(1, std::memory_order_relaxed);
+                    continue;
+                }
+                collect(registration, now, limit);
+                if (!registration.buffer.empty()) {
+                    const Clock::time_point deadline = registration.oldest + registration.policy.maxDelay;
+                    if (registration.buffer.size() < registration.policy.maxBatch && now < deadline) {
+                        nextDeadline = std::min(nextDeadline, deadline);
+                    } else {
+                        due.push_back({subscriberId, registration.subscriber, takeBuffer(registration, spare)});
+                    }
+                }
+                ++it;
+            }
+
+            if (!due.empty() || !afterDetach.empty()) {
+                // Unlocked: callbacks may attach or detach, and producers waking us do not wait on them
+                lock.unlock();
+                for (const Batch& batch : due) {
+                    batch.subscriber->onNotifications(batch.subscriberId, batch.notifications);
+                }
+                for (auto& action : afterDetach) {
+                    action();
+                }
+                afterDetach.clear();
+                lock.lock();
+                for (Batch& batch : due) {
+                    batch.notifications.clear();
+                    spare.push_back(std::move(batch.notifications));
+                }
+                due.clear();
+                finishSweep();
+                continue; // A full buffer may have left more in the ring
+            }
+            finishSweep();
+
+            // Pairs with the read-modify-write in wakeIfSleeping: either pending() sees the new notifications
+            // or the producer sees the dispatcher asleep and signals
+            sleeping.exchange(1, std::memory_order_acq_rel);
+            if (!signalled && !pending(limit)) {
+                const auto woken = [this] { return signalled; };
+                if (nextDeadline == Clock::time_point::max()) {
+                    wake.wait(lock, stop, woken);
+                } else {
+                    wake.wait_until(lock, stop, nextDeadline, woken);
+                }
+            }
+            sleeping.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void finishSweep() {
+        sweepsFinished = sweepsStarted;
+        swept.notify_all();
+    }
+
+    // Whether a sweep now would collect more than the last one: new notifications in a ring, or held ones
+    // that a moved watermark releases
+    bool pending(std::uint64_t limit) const {
+        const bool watermarkMoved = currentWatermark() != limit;
+        for (const auto& [subscriberId, registration] : registrations) {
+            const DeliveryStats stats = registration.queue->stats();
+            if (stats.depth != 0 || (watermarkMoved && stats.held != 0)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static std::vector<Notification> takeBuffer(Registration& registration,
+                                                std::vector<std::vector<Notification>>& spare) {
+        std::vector<Notification> taken = std::move(registration.buffer);
+        if (spare.empty()) {
+            registration.buffer = {};
+            registration.buffer.reserve(registration.policy.maxBatch);
+        } else {
+            registration.buffer = std::move(spare.back());
+            spare.pop_back();
+        }
+        return taken;
+    }
+
+    std::uint64_t currentWatermark() const {
+        return watermark ? watermark() : 0;
+    }
+
+    // Notifications without an ingest time count from their collection
+    static void collect(Registration& registration, Clock::time_point now, std::uint64_t limit) {
+        registration.queue->drain(
+            [&](const Notification& notification) {
+                const Clock::time_point produced =
+                    notification.ingestNanos == 0
+                        ? now
+                        : Clock::time_point(std::chrono::duration_cast<Clock::duration>(
+                              std::chrono::nanoseconds(notification.ingestNanos)));
+                registration.oldest =
+                    registration.buffer.empty() ? produced : std::min(registration.oldest, produced);
+                registration.buffer.push_back(notification);
+            },
+            registration.policy.maxBatch - registration.buffer.size(), limit);
+    }
+
+    const Watermark watermark;
+    mutable std::mutex mutex; // Guards everything below but the atomics; released while callbacks run
+    std::condition_variable_any wake;
+    bool signalled = false;                  // Set by attach, detach and wakeIfSleeping, cleared per sweep
+    std::condition_variable swept;           // Signalled after every sweep, for detach
+    std::uint64_t sweepsStarted = 0;
+    std::uint64_t sweepsFinished = 0;
+    std::atomic<std::uint32_t> sleeping{0};  // 1 while the dispatcher waits for a wake-up
+    std::atomic<std::size_t> attachedCount{0};
+    std::unordered_map<SubscriberId, Registration> registrations;
+    std::jthread thread;
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+/*
+    Overload control for the stream: adaptive, deterministic 1-in-N sampling per packet type.
+
+    When packets arrive faster than the workers can notify, the ingest rings fill up and every packet waits
+    longer than the one before: the IngestPolicy only decides what happens once a ring is full, by which time
+    the queueing delay is already as large as the ring allows. The controller acts earlier. Every
+    checkInterval one worker looks at two signals of the interval just ended:
+    - the fullest ingest ring, as a fraction of its capacity
+    - the longest queueing delay, from ingest to the start of delivery, seen by any worker
+    If either is above its high mark, the overload level goes up by one. It only comes down by one after
+    calmChecks intervals in a row with both signals below their low marks: the gap between the marks and the
+    dwell time are the hysteresis that keeps the level from flapping at the edge of capacity.
+
+    The level turns into a sampling rate per type: a type of priority p delivers 1 in 2^(level - p) packets,
+    so low-priority types are thinned first and a type with priority >= level keeps full delivery. Sampling
+    is deterministic, every N-th packet of the type on each worker, and shed packets cost a pop and a
+    compare instead of a fan-out to every subscriber, which is what lets the workers catch up and keeps the
+    queueing delay, and with it the p99, bounded during a burst.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "packet.hpp"
+
+struct OverloadPolicy {
+    double highDepth = 0.5;  // Fullest ingest ring, fraction of its capacity
+    double lowDepth = 0.1;
+    std::chrono::microseconds highDelay{2000}; // Longest ingest-to-delivery delay in the interval
+    std::chrono::microseconds lowDelay{500};
+    std::chrono::microseconds checkInterval{1000};
+    std::uint64_t calmChecks = 20; // Calm intervals in a row before the level comes down by one
+    unsigned maxLevel = 10;      // Sampling never goes below 1 in 2^maxLevel
+};
+
+class OverloadController {
+public:
+    bool enabled() const {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    void enable(const OverloadPolicy& newPolicy) {
+        std::lock_guard<std::mutex> guard(mutex);
+        policy = newPolicy;
+        policy.maxLevel = std::min(policy.maxLevel, 31u); // The worker's sampling mask is 32 bits
+        policy.calmChecks = std::max<std::uint64_t>(policy.calmChecks, 1);
+        calm = 0;
+        windowDelay.store(0, std::memory_order_relaxed);
+        nextCheck.store(0, std::memory_order_relaxed);
+        on.store(true, std::memory_order_relaxed);
+    }
+
+    // Back to full delivery
+    void disable() {
+        std::lock_guard<std::mutex> guard(mutex);
+        on.store(false, std::memory_order_relaxed);
+        applyLevel(0);
+    }
+
+    // Types with a higher priority are sampled later; all types start at 0
+    void setPriority(PacketType packetType, unsigned value) {
+        std::lock_guard<std::mutex> guard(mutex);
+        priority[packetTypeIndex(packetType)] = value;
+        applyLevel(currentLevel.load(std::memory_order_relaxed));
+    }
+
+    unsigned level() const {
+        return currentLevel.load(std::memory_order_relaxed);
+    }
+
+    // log2 of the sampling rate: the worker keeps 1 in 2^shift packets of the type
+    unsigned shift(std::size_t type) const {
+        return shifts[type].load(std::memory_order_relaxed);
+    }
+
+    // N of "1 in N"; 1 is full delivery
+    std::uint64_t samplingRate(PacketType packetType) const {
+        return std::uint64_t{1} << shift(packetTypeIndex(packetType));
+    }
+
+    // Worker side: the oldest packet of a chunk waited delayNanos between ingest and delivery
+    void observeDelay(std::uint64_t delayNanos) {
+        std::uint64_t seen = windowDelay.load(std::memory_order_relaxed);
+        while (delayNanos > seen && !windowDelay.compare_exchange_weak(seen, delayNanos, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Worker side, after every chunk: once per checkInterval, the first worker to get here evaluates the
+    // interval. depthFraction() returns the fullest ingest ring as a fraction of its capacity.
+    template<typename DepthFraction>
+    void maybeCheck(std::uint64_t nowNanos, DepthFraction&& depthFraction) {
+        if (!enabled() || nowNanos < nextCheck.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || nowNanos < nextCheck.load(std::memory_order_relaxed)) {
+            return; // Another worker is checking this interval
+        }
+        const auto interval = static_cast<std::uint64_t>(
+            std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(policy.checkInterval).count(), 1));
+        // Intervals since the last check: a stream that went quiet comes back with the level it has earned
+        const std::uint64_t due = nextCheck.load(std::memory_order_relaxed);
+        const std::uint64_t intervals = due == 0 ? 1 : 1 + (nowNanos - due) / interval;
+        nextCheck.store(nowNanos + interval, std::memory_order_relaxed);
+
+        const auto delay = std::chrono::nanoseconds(windowDelay.exchange(0, std::memory_order_relaxed));
+        const double depth = depthFraction();
+        unsigned next = currentLevel.load(std::memory_order_relaxed);
+        if (depth >= policy.highDepth || delay >= policy.highDelay) {
+            next = std::min(next + 1, policy.maxLevel);
+            calm = 0;
+        } else if (depth <= policy.lowDepth && delay <= policy.lowDelay) {
+            calm += intervals;
+            while (next != 0 && calm >= policy.calmChecks) {
+                --next;
+                calm -= policy.calmChecks;
+            }
+            calm = next == 0 ? 0 : calm;
+        } else {
+            calm = 0; // Between the marks: hold the level
+        }
+        applyLevel(next);
+    }
+
+private:
+    // Called with the mutex held
+    void applyLevel(unsigned next) {
+        currentLevel.store(next, std::memory_order_relaxed);
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            shifts[type].store(next > priority[type] ? next - priority[type] : 0, std::memory_order_relaxed);
+        }
+    }
+
+    mutable std::mutex mutex; // The checker, and the policy and priorities below
+    OverloadPolicy policy;
+    std::array<unsigned, packetTypeCount> priority{};
+    std::uint64_t calm = 0;
+    std::atomic<bool> on{false};
+    std::atomic<std::uint64_t> nextCheck{0};
+    std::atomic<std::uint64_t> windowDelay{0};
+    std::atomic<unsigned> currentLevel{0};
+    std::array<std::atomic<unsigned>, packetTypeCount> shifts{};
+};
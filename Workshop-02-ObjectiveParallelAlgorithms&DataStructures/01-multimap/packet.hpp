@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Define PacketType as an enum for simplicity
+enum class PacketType : std::uint8_t {
+    HTTP,
+    FTP,
+    SSH,
+    // ... other packet types
+    Count // Keep last: sizes the per-type tables
+};
+
+constexpr std::size_t packetTypeCount = static_cast<std::size_t>(PacketType::Count);
+
+constexpr std::size_t packetTypeIndex(PacketType type) {
+    return static_cast<std::size_t>(type);
+}
+
+constexpr std::string_view packetTypeName(PacketType type) {
+    switch (type) {
+    case PacketType::HTTP: return "HTTP";
+    case PacketType::FTP: return "FTP";
+    case PacketType::SSH: return "SSH";
+    default: return "unknown";
+    }
+}
+
+// Addresses and ports of a transport flow, in host byte order
+struct FlowKey {
+    std::uint32_t sourceAddress = 0;
+    std::uint32_t destinationAddress = 0;
+    std::uint16_t sourcePort = 0;
+    std::uint16_t destinationPort = 0;
+};
+
+// Packet structure
+struct Packet {
+    PacketType type;
+    std::string content; // Simplified content representation
+    FlowKey flow{};      // Used to steer the packet to a worker shard
+};
+
+// SubscriberId type
+using SubscriberId = int;
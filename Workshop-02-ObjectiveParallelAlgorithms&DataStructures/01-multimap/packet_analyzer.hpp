@@ -0,0 +1,774 @@
+#pragma once
+
+/*
+    Shared-nothing sharded PacketAnalyzer.
+
+    The first version spawned one std::thread per PacketType for every batch: thread creation on every call,
+    and all HTTP traffic on a single core however much of it arrived. Here a fixed set of long-lived workers,
+    one per core, each own a shard of the traffic. Packets are steered to shards by a Toeplitz hash of their
+    flow (see flow_hash.hpp), like RSS on a NIC, so a dominant protocol spreads over all cores while every
+    packet of one flow stays on the same worker.
+
+    Each worker owns its input and its counters; nothing is shared between workers on the hot path.
+    A batch is never copied: a counting sort (batch_partition.hpp) orders packet indices by (shard, type),
+    and each worker reads its slice of the caller's packets through that permutation.
+    Notifications go to per-subscriber lock-free rings (delivery_queue.hpp) that subscribers drain themselves,
+    so workers fanning out in parallel never serialize on a shared lock.
+    Subscriptions are read through versioned RCU snapshots (subscription_registry.hpp): subscribe/unsubscribe
+    publish a new version and never stall a batch in flight.
+    Subscribers may also register a compiled PacketFilter (packet_filter.hpp); each worker evaluates all
+    filters over its shard column by column before fanning out.
+
+    Besides batches, the analyzer accepts a stream: push/tryPush move single packets into a bounded ingest
+    ring per worker (ingest_queue.hpp), steered by the same flow hash, and each worker drains its ring in
+    chunks whenever it is not busy with a batch. Capture threads then overlap with notification instead of
+    waiting for it, and a full ring is handled by the IngestPolicy chosen at construction.
+
+    Subscribers either drain their ring themselves or attach a Subscriber, which a dispatcher thread calls
+    with batches of notifications (notification_dispatcher.hpp).
+
+    Every packet gets a sequence number: a batch takes a contiguous range when it is handed over, and a
+    worker takes one for each run it pops from its ingest ring, so stream packets keep their order within a
+    flow without a shared counter per push. deliveredWatermark() tells below which number everything has
+    been delivered. A subscriber configured with a reorder window receives its notifications in that order
+    although the workers deliver in parallel (reorder_buffer.hpp).
+
+    Under overload, an optional controller (overload_controller.hpp) watches ingest depth and queueing delay
+    and thins the stream to deterministic 1-in-N sampling per type, lowest priority first, until the load
+    drops again.
+
+    The subscription state can be saved to a binary snapshot file and restored in one bulk pass on a cold
+    start (subscription_snapshot_file.hpp).
+
+    Once enabled, the analyzer records per-type counts, ingest-to-notification latency, worker busy/idle
+    time and lock waits into per-thread shards (analyzer_metrics.hpp), merged by metricsSnapshot().
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "analyzer_metrics.hpp"
+#include "batch_partition.hpp"
+#include "delivery_queue.hpp"
+#include "flow_hash.hpp"
+#include "ingest_queue.hpp"
+#include "notification_dispatcher.hpp"
+#include "overload_controller.hpp"
+#include "packet.hpp"
+#include "packet_filter.hpp"
+#include "subscription_registry.hpp"
+#include "subscription_snapshot_file.hpp"
+
+class PacketAnalyzer {
+    // alignas keeps two workers' state off the same cache line
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::condition_variable_any wake;
+        std::size_t shard = 0;         // Index of this worker's buckets in the partition and its reader slot
+        std::uint64_t batch = 0;       // Generation of the batch being processed
+        std::atomic<std::uint64_t> processed{0}; // Packets handled by this worker since construction
+        // Streaming: producers push into ingest and wake the worker only if it is asleep
+        std::unique_ptr<IngestQueue> ingest;
+        std::atomic<std::uint32_t> sleeping{0}; // 1 while the worker waits for work
+        std::atomic<std::uint64_t> settled{0}; // Every ingest position below it has been delivered or evicted
+        std::vector<Packet> streamPackets;      // The chunk being delivered, reused
+        std::vector<IngestStamp> streamStamps; // Parallel to streamPackets
+        BatchPartition streamPartition;        // By type, over streamPackets
+        // Overload sampling: packets of each type seen while sampled, and how many were left out
+        std::array<std::uint32_t, packetTypeCount> sampleCounters{};
+        std::array<MetricCounter, packetTypeCount> shed;
+        // Filter evaluation buffers, grown once and reused
+        PacketColumns columns;
+        std::vector<std::uint8_t> matches;
+        std::vector<std::vector<std::uint8_t>> filterScratch;
+        MetricCounter busyNanos;
+        MetricCounter idleNanos;
+        std::jthread thread;
+    };
+
+    AnalyzerMetrics instrumentation;    // Declared first: workers record into it until they are joined
+    SubscriptionRegistry subscriptions; // Snapshots for the workers, master table for the control plane
+    FlowSteering steering;
+    OverloadController overload;
+    std::vector<std::unique_ptr<Worker>> workers;
+    // Declared after subscriptions and workers: stops before the queues and the watermark's inputs go away
+    NotificationDispatcher dispatcher;
+    // Called by a push about to wait on a full delivery ring, which the dispatcher may be asleep on
+    const std::function<void()> wakeDispatcher = [this] { dispatcher.wakeIfSleeping(); };
+
+    // Next sequence number, taken per batch, per popped run of the stream and per direct notification
+    std::atomic<std::uint64_t> sequencer{0};
+    // Smallest sequence of the batch in flight, noBatch between batches
+    static constexpr std::uint64_t noBatch = std::numeric_limits<std::uint64_t>::max();
+    std::atomic<std::uint64_t> batchFloor{noBatch};
+
+    // The batch in flight: the caller's packets and the (shard, type) permutation over them
+    std::span<const Packet> batchPackets;
+    std::uint64_t batchIngestNanos = 0; // ingestClock() when the batch was handed over
+    std::uint64_t batchSequence = 0;    // Sequence of batchPackets[0]; packet i gets batchSequence + i
+    BatchPartition partition;
+
+    std::mutex batchMutex; // One batch at a time
+    std::mutex doneMutex;
+    std::condition_variable batchDone;
+    std::size_t pendingWorkers = 0;
+    std::uint64_t batchGeneration = 0;
+    std::condition_variable streamSettled; // Guarded by doneMutex, signalled only while flushWaiters > 0
+    std::atomic<std::size_t> flushWaiters{0};
+
+    // Packets a worker takes from its ingest ring at once: large enough to amortize the snapshot and the
+    // partition, small enough that a pending batch does not wait long
+    static constexpr std::size_t streamChunkSize = 256;
+
+    // A run of packets and its by-type partition: a shard of a batch, or a chunk of a worker's stream
+    struct ShardView {
+        std::span<const Packet> packets;
+        const BatchPartition& partition;
+        std::size_t firstBucket; // Bucket of PacketType 0; the other types follow
+        std::span<const IngestStamp> stamps; // Per packet; empty for a batch, described by the two below
+        std::uint64_t batchIngestNanos = 0;
+        std::uint64_t batchSequence = 0;
+
+        std::uint64_t sequence(std::uint32_t index) const {
+            return stamps.empty() ? batchSequence + index : stamps[index].sequence;
+        }
+
+        std::uint64_t ingestNanos(std::uint32_t index) const {
+            return stamps.empty() ? batchIngestNanos : stamps[index].ingestNanos;
+        }
+
+        std::span<const std::uint32_t> typeRun(std::size_t type) const {
+            return partition.bucket(firstBucket + type);
+        }
+
+        std::span<const std::uint32_t> indices() const {
+            return partition.buckets(firstBucket, firstBucket + packetTypeCount);
+        }
+    };
+
+public:
+    // ingestCapacity and ingestPolicy apply to the per-worker rings used by push/tryPush
+    explicit PacketAnalyzer(std::size_t workerCount = std::thread::hardware_concurrency(),
+                            std::size_t ingestCapacity = 4096, IngestPolicy ingestPolicy = IngestPolicy::Block)
+        : subscriptions(workerCount == 0 ? 1 : workerCount), steering(workerCount == 0 ? 1 : workerCount),
+          dispatcher([this] { return deliveredWatermark(); }) {
+        workerCount = workerCount == 0 ? 1 : workerCount;
+        for (std::size_t index = 0; index < workerCount; ++index) {
+            workers.push_back(std::make_unique<Worker>());
+            workers.back()->shard = index;
+            workers.back()->ingest = std::make_unique<IngestQueue>(ingestCapacity, ingestPolicy);
+            workers.back()->streamPackets.reserve(streamChunkSize);
+            workers.back()->streamStamps.reserve(streamChunkSize);
+        }
+        for (std::size_t index = 0; index < workerCount; ++index) {
+            Worker& worker = *workers[index];
+            worker.thread = std::jthread([this, &worker](std::stop_token stop) { run(worker, stop); });
+            pinToCore(worker.thread, index);
+        }
+    }
+
+    ~PacketAnalyzer() {
+        // Stop and join the workers before the members they use go away
+        for (auto& worker : workers) {
+            worker->thread.request_stop();
+        }
+        for (auto& worker : workers) {
+            worker->thread.join();
+        }
+    }
+
+    PacketAnalyzer(const PacketAnalyzer&) = delete;
+    PacketAnalyzer& operator=(const PacketAnalyzer&) = delete;
+
+    // Creates the subscriber's delivery queue; subscribe() creates one with the defaults otherwise.
+    // A queue that already exists is kept as it is. With a reorderWindow, notifications are handed over in
+    // sequence order, holding up to that many back while earlier packets are still being delivered.
+    DeliveryQueue& configureDelivery(SubscriberId subscriberId, std::size_t capacity = 1024,
+                                     OverflowPolicy policy = OverflowPolicy::Drop, std::size_t reorderWindow = 0) {
+        return subscriptions.configureDelivery(subscriberId, capacity, policy, reorderWindow);
+    }
+
+    // Subscription changes may come from any thread, also while a batch is being processed
+    void subscribe(SubscriberId subscriberId, PacketType packetType) {
+        subscriptions.subscribe(subscriberId, packetType);
+    }
+
+    void unsubscribe(SubscriberId subscriberId, PacketType packetType) {
+        subscriptions.unsubscribe(subscriberId, packetType);
+    }
+
+    // Throws std::invalid_argument if the expression does not compile, see packet_filter.hpp for the grammar
+    void subscribeFilter(SubscriberId subscriberId, std::string_view expression) {
+        subscriptions.subscribeFilter(subscriberId, PacketFilter::compile(expression));
+    }
+
+    bool unsubscribeFilter(SubscriberId subscriberId) {
+        return subscriptions.unsubscribeFilter(subscriberId);
+    }
+
+    // Publishes many changes as a single snapshot version
+    std::size_t applySubscriptionChanges(std::span<const SubscriptionChange> changes) {
+        return subscriptions.apply(changes);
+    }
+
+    // Drops the subscriber and its delivery queue; it must not be drained after this call. Called from a
+    // Subscriber callback, the removal completes on the dispatcher thread after the final batch, since the
+    // dispatcher still drains the queue until then.
+    void removeSubscriber(SubscriberId subscriberId) {
+        const auto remove = [this, subscriberId] { subscriptions.removeSubscriber(subscriberId); };
+        if (!dispatcher.detach(subscriberId, remove)) {
+            remove();
+        }
+    }
+
+    // Writes every subscription, filter and delivery configuration to path, atomically replacing it.
+    // Subscription changes wait only while the state is copied, not during the write.
+    void saveSubscriptions(const std::string& path) const {
+        SubscriptionSnapshotWriter writer;
+        const std::uint64_t version =
+            subscriptions.exportState([&](const SubscriberState& subscriber) { writer.add(subscriber); });
+        writer.commit(path, version);
+    }
+
+    // Cold start: loads a file written by saveSubscriptions into an analyzer without subscribers, as one
+    // snapshot version. Returns the number of subscribers. Throws if the file is unreadable or invalid, or
+    // if the analyzer already has subscribers; nothing is restored then.
+    std::size_t restoreSubscriptions(const std::string& path) {
+        const SubscriptionSnapshotReader reader(path);
+        const std::vector<SubscriberState> subscribers = reader.subscribers();
+        subscriptions.restore(subscribers);
+        return subscribers.size();
+    }
+
+    std::uint64_t subscriptionVersion() const {
+        return subscriptions.version();
+    }
+
+    bool isSubscribed(SubscriberId subscriberId, PacketType packetType) const {
+        return subscriptions.isSubscribed(subscriberId, packetType);
+    }
+
+    // Push-style consumer: the dispatcher thread calls subscriber with up to policy.maxBatch notifications at
+    // once, or fewer once the oldest has waited policy.maxDelay. Creates the delivery queue if needed; the
+    // subscriber must outlive the attachment. Returns false if the subscriber is already attached.
+    bool attach(SubscriberId subscriberId, Subscriber& subscriber, BatchPolicy policy = {}) {
+        return dispatcher.attach(subscriberId, subscriptions.configureDelivery(subscriberId), subscriber, policy);
+    }
+
+    // Has the dispatcher thread deliver what it can still collect, after which the subscriber is no longer
+    // called. From inside a callback it returns at once, and that final batch follows the callback.
+    bool detach(SubscriberId subscriberId) {
+        return dispatcher.detach(subscriberId);
+    }
+
+    // Consumer side: one thread per subscriber drains its notifications, returns how many were handed over.
+    // The queue is looked up in a pinned snapshot but drained after unpinning, so a slow consumer holds no
+    // reader slot; the subscriber must not be removed during the call.
+    template<typename Consumer>
+    std::size_t drain(SubscriberId subscriberId, Consumer&& consume,
+                      std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
+        DeliveryQueue* queue = subscriptions.readShared().snapshot().deliveryQueue(subscriberId);
+        if (queue == nullptr) {
+            return 0;
+        }
+        const std::uint64_t watermark = queue->ordered() ? deliveredWatermark() : 0;
+        return queue->drain(std::forward<Consumer>(consume), maxCount, watermark);
+    }
+
+    // Every packet numbered below the result has been delivered to all its subscribers, or dropped
+    std::uint64_t deliveredWatermark() const {
+        // Read first: whatever was numbered before has raised batchFloor or its ingest queue's floor by now
+        const std::uint64_t assigned = sequencer.load();
+        std::uint64_t watermark = std::min(assigned, batchFloor.load());
+        for (const auto& worker : workers) {
+            watermark = std::min(watermark, worker->ingest->deliveredBelow(assigned));
+        }
+        return watermark;
+    }
+
+    DeliveryStats deliveryStats(SubscriberId subscriberId) const {
+        const auto reading = subscriptions.readShared();
+        DeliveryQueue* queue = reading.snapshot().deliveryQueue(subscriberId);
+        return queue == nullptr ? DeliveryStats{} : queue->stats();
+    }
+
+    std::size_t workerCount() const {
+        return workers.size();
+    }
+
+    // Packets processed by each worker so far, batches and stream; shows how evenly the flows spread
+    std::vector<std::uint64_t> packetsPerWorker() const {
+        std::vector<std::uint64_t> counts;
+        for (const auto& worker : workers) {
+            counts.push_back(worker->processed.load(std::memory_order_relaxed));
+        }
+        return counts;
+    }
+
+    // Moves bucket of the flow-hash indirection table to another worker, e.g. to rebalance heavy flows
+    void steerBucket(std::size_t bucket, std::size_t workerIndex) {
+        std::lock_guard<std::mutex> batchGuard(batchMutex);
+        steering.assign(bucket % FlowSteering::tableSize, workerIndex % workers.size());
+    }
+
+    void processPackets(const std::vector<Packet>& packets) {
+        const auto batchGuard = instrumentation.lock(batchMutex, LockSite::Batch);
+        batchIngestNanos = ingestClock();
+        // The floor goes up before the numbers are taken, so no watermark can pass them
+        batchFloor.store(sequencer.load());
+        batchSequence = sequencer.fetch_add(packets.size());
+
+        // Divide packet indices by flow hash, then by type inside each shard; the packets stay where they are
+        batchPackets = packets;
+        partition.partition(batchPackets, workers.size() * packetTypeCount, [this](const Packet& packet) {
+            return steering.shardOf(packet.flow) * packetTypeCount + packetTypeIndex(packet.type);
+        });
+
+        // Wake only the workers that received packets
+        std::size_t busy = 0;
+        for (auto& worker : workers) {
+            busy += shardOf(*worker).empty() ? 0 : 1;
+        }
+        if (busy == 0) {
+            batchPackets = {};
+            batchFloor.store(noBatch);
+            dispatcher.wakeIfSleeping();
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(doneMutex);
+            pendingWorkers = busy;
+        }
+        ++batchGeneration;
+        for (auto& worker : workers) {
+            if (shardOf(*worker).empty()) {
+                continue;
+            }
+            {
+                std::lock_guard<std::mutex> guard(worker->mutex);
+                worker->batch = batchGeneration;
+            }
+            worker->wake.notify_one();
+        }
+
+        // Wait until every shard of the batch has been processed
+        std::unique_lock<std::mutex> lock(doneMutex);
+        batchDone.wait(lock, [this] { return pendingWorkers == 0; });
+        batchPackets = {};
+        batchFloor.store(noBatch);
+        dispatcher.wakeIfSleeping(); // The watermark has moved past the batch
+    }
+
+    // Streaming ingest, any thread. Applies the IngestPolicy when the worker's ring is full; returns false
+    // if the packet was dropped (DropNewest only).
+    bool push(Packet packet) {
+        Worker& worker = *workers[steering.shardOf(packet.flow)];
+        std::uint64_t waited = 0;
+        const bool timed = instrumentation.enabled();
+        if (!worker.ingest->push({std::move(packet), {ingestClock()}}, timed ? &waited : nullptr)) {
+            return false;
+        }
+        if (waited != 0) {
+            instrumentation.local().recordWait(LockSite::IngestBlock, waited);
+        }
+        wakeIfSleeping(worker);
+        return true;
+    }
+
+    // Never waits nor evicts: returns false if the worker's ring is full. The packet is moved from only on
+    // success, so the caller may retry it or count it as lost.
+    bool tryPush(Packet&& packet) {
+        Worker& worker = *workers[steering.shardOf(packet.flow)];
+        IngestedPacket ingested{std::move(packet), {ingestClock()}};
+        if (!worker.ingest->tryPush(std::move(ingested))) {
+            packet = std::move(ingested.packet); // Hand it back untouched
+            return false;
+        }
+        wakeIfSleeping(worker);
+        return true;
+    }
+
+    // Waits until every packet pushed before the call has been delivered or dropped
+    void flush() {
+        std::vector<std::uint64_t> targets;
+        for (const auto& worker : workers) {
+            targets.push_back(worker->ingest->pushed());
+        }
+        flushWaiters.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            streamSettled.wait(lock, [&] {
+                for (std::size_t index = 0; index < workers.size(); ++index) {
+                    if (workers[index]->settled.load() < targets[index]) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+        }
+        flushWaiters.fetch_sub(1);
+    }
+
+    // Totals over all ingest rings; depth is the number of packets currently queued
+    IngestStats ingestStats() const {
+        IngestStats total;
+        for (const auto& worker : workers) {
+            const IngestStats stats = worker->ingest->stats();
+            total.accepted += stats.accepted;
+            total.droppedNewest += stats.droppedNewest;
+            total.droppedOldest += stats.droppedOldest;
+            total.blocked += stats.blocked;
+            total.depth += stats.depth;
+        }
+        return total;
+    }
+
+    // Queued packets per worker; a worker that keeps a deep ring is a candidate for steerBucket
+    std::vector<std::size_t> ingestDepthPerWorker() const {
+        std::vector<std::size_t> depths;
+        for (const auto& worker : workers) {
+            depths.push_back(worker->ingest->size());
+        }
+        return depths;
+    }
+
+    // Adaptive sampling of the stream under overload, off by default; batches are always delivered in full,
+    // their caller already waits for them
+    void enableOverloadControl(const OverloadPolicy& policy = {}) {
+        overload.enable(policy);
+    }
+
+    // Back to full delivery
+    void disableOverloadControl() {
+        overload.disable();
+    }
+
+    // Under overload, types with a higher priority keep full delivery longer; all types start at 0
+    void setSheddingPriority(PacketType packetType, unsigned priority) {
+        overload.setPriority(packetType, priority);
+    }
+
+    // 0 while every type is delivered in full
+    unsigned overloadLevel() const {
+        return overload.level();
+    }
+
+    // N of the current 1-in-N sampling of the type, 1 for full delivery
+    std::uint64_t samplingRate(PacketType packetType) const {
+        return overload.samplingRate(packetType);
+    }
+
+    // Recording costs a few ns per packet and run of notifications; off by default
+    void enableMetrics(bool enable = true) {
+        instrumentation.enable(enable);
+    }
+
+    // Merges the per-thread recordings with the worker and ingest counters
+    MetricsSnapshot metricsSnapshot() const {
+        MetricsSnapshot snapshot = instrumentation.snapshot();
+        for (const auto& worker : workers) {
+            snapshot.workers.push_back({worker->processed.load(std::memory_order_relaxed), worker->busyNanos.load(),
+                                        worker->idleNanos.load()});
+        }
+        snapshot.ingest = ingestStats();
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            for (const auto& worker : workers) {
+                snapshot.shed[type] += worker->shed[type].load();
+            }
+            snapshot.samplingRate[type] = overload.samplingRate(static_cast<PacketType>(type));
+        }
+        return snapshot;
+    }
+
+    void dumpMetrics(std::ostream& out) const {
+        metricsSnapshot().dump(out);
+    }
+
+    void notifySubscriber(SubscriberId subscriberId, const Packet& packet) {
+        notifySubscriber(subscriberId, std::span<const Packet>(&packet, 1));
+    }
+
+    // One queue lookup for the whole run of packets, in a snapshot pinned until the last push, so a
+    // concurrent removeSubscriber cannot free the queue meanwhile. The packets are numbered like ingested
+    // ones, but the watermark does not wait for a direct notification still being pushed.
+    void notifySubscriber(SubscriberId subscriberId, std::span<const Packet> packets) {
+        const auto reading = subscriptions.readShared();
+        if (DeliveryQueue* queue = reading.snapshot().deliveryQueue(subscriberId)) {
+            const std::uint64_t ingestNanos = ingestClock();
+            MetricsShard* metrics = instrumentation.enabled() ? &instrumentation.local() : nullptr;
+            std::uint64_t sequence = sequencer.fetch_add(packets.size());
+            for (const Packet& packet : packets) {
+                pushTimed(*queue, describe(packet, sequence++, ingestNanos), metrics);
+            }
+            dispatcher.wakeIfSleeping();
+        }
+    }
+
+private:
+    void run(Worker& worker, std::stop_token stop) {
+        std::uint64_t seen = 0;
+        const auto ready = [&] { return worker.batch != seen || worker.ingest->size() != 0; };
+        while (true) {
+            bool batchReady = false;
+            const bool timed = instrumentation.enabled();
+            const std::uint64_t idleSince = timed ? metricsClock() : 0;
+            {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                if (!ready()) {
+                    // Pairs with the read-modify-write in wakeIfSleeping: either this sees the packet or the
+                    // producer sees the worker asleep
+                    worker.sleeping.exchange(1, std::memory_order_acq_rel);
+                    worker.wake.wait(lock, stop, ready);
+                    worker.sleeping.store(0, std::memory_order_relaxed);
+                }
+                if (stop.stop_requested()) {
+                    return; // Packets still queued are dropped with the analyzer
+                }
+                batchReady = worker.batch != seen;
+                seen = worker.batch;
+            }
+            const std::uint64_t busySince = timed ? metricsClock() : 0;
+
+            if (batchReady) {
+                deliver(worker, {batchPackets, partition, worker.shard * packetTypeCount, {}, batchIngestNanos,
+                                 batchSequence});
+                dispatcher.wakeIfSleeping(); // For unordered queues; ordered ones wait for the batch's end
+                const auto guard = instrumentation.lock(doneMutex, LockSite::Completion);
+                if (--pendingWorkers == 0) {
+                    batchDone.notify_one();
+                }
+            }
+            // One chunk at a time, so a batch arriving meanwhile is picked up at the next round
+            deliverStreamChunk(worker);
+
+            if (timed) {
+                const std::uint64_t now = metricsClock();
+                worker.idleNanos.add(busySince - idleSince);
+                worker.busyNanos.add(now - busySince);
+            }
+        }
+    }
+
+    void deliverStreamChunk(Worker& worker) {
+        if (worker.ingest->pop(worker.streamPackets, worker.streamStamps, streamChunkSize, sequencer) == 0) {
+            return;
+        }
+        const std::uint64_t settled = worker.ingest->popped();
+        if (overload.enabled()) {
+            const std::uint64_t now = metricsClock();
+            if (worker.streamStamps.front().ingestNanos != 0) {
+                overload.observeDelay(now - worker.streamStamps.front().ingestNanos);
+            }
+            overload.maybeCheck(now, [this] { return fullestIngest(); });
+            if (overload.level() != 0) {
+                sample(worker);
+            }
+        }
+        if (!worker.streamPackets.empty()) {
+            worker.streamPartition.partition(worker.streamPackets, packetTypeCount,
+                                             [](const Packet& packet) { return packetTypeIndex(packet.type); });
+            deliver(worker, {worker.streamPackets, worker.streamPartition, 0, worker.streamStamps});
+        }
+        worker.ingest->settle();
+        dispatcher.wakeIfSleeping();
+
+        worker.settled.store(settled);
+        if (flushWaiters.load() != 0) {
+            std::lock_guard<std::mutex> guard(doneMutex);
+            streamSettled.notify_all();
+        }
+    }
+
+    // Keeps every N-th packet of each sampled type, in order, and counts the others as shed
+    void sample(Worker& worker) const {
+        std::size_t kept = 0;
+        for (std::size_t index = 0; index < worker.streamPackets.size(); ++index) {
+            const std::size_t type = packetTypeIndex(worker.streamPackets[index].type);
+            const std::uint32_t mask = (std::uint32_t{1} << overload.shift(type)) - 1;
+            if ((worker.sampleCounters[type]++ & mask) != 0) {
+                worker.shed[type].add(1);
+                continue;
+            }
+            if (kept != index) {
+                worker.streamPackets[kept] = std::move(worker.streamPackets[index]);
+                worker.streamStamps[kept] = worker.streamStamps[index];
+            }
+            ++kept;
+        }
+        worker.streamPackets.erase(worker.streamPackets.begin() + static_cast<std::ptrdiff_t>(kept),
+                                   worker.streamPackets.end());
+        worker.streamStamps.resize(kept);
+    }
+
+    // The fullest ingest ring, as a fraction of its capacity
+    double fullestIngest() const {
+        double fullest = 0;
+        for (const auto& worker : workers) {
+            fullest = std::max(fullest, static_cast<double>(worker->ingest->size()) /
+                                            static_cast<double>(worker->ingest->capacity()));
+        }
+        return fullest;
+    }
+
+    // Stamped when the metrics or the overload controller need the queueing delay, or when an attached
+    // subscriber's maxDelay counts from it
+    std::uint64_t ingestClock() const {
+        return instrumentation.enabled() || overload.enabled() || dispatcher.active() ? metricsClock() : 0;
+    }
+
+    void wakeIfSleeping(Worker& worker) {
+        // A read-modify-write rather than a load: it is ordered before or after the worker's exchange, and if
+        // before, the worker's readiness check sees the packet just pushed
+        if (worker.sleeping.fetch_or(0, std::memory_order_acq_rel) != 0) {
+            std::lock_guard<std::mutex> guard(worker.mutex);
+            worker.wake.notify_one();
+        }
+    }
+
+    void deliver(Worker& worker, const ShardView& view) {
+        // One snapshot for the whole view; changes published meanwhile apply from the next one
+        const auto reading = subscriptions.read(worker.shard);
+        const SubscriptionSnapshot& snapshot = reading.snapshot();
+        MetricsShard* metrics = instrumentation.enabled() ? &instrumentation.local() : nullptr;
+
+        std::uint64_t viewTypes = 0;
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            if (!view.typeRun(type).empty()) {
+                viewTypes |= std::uint64_t{1} << type;
+            }
+        }
+
+        if (std::popcount(viewTypes) > 1) {
+            // Mixed types: the bitmap yields every interested subscriber once, with all its types
+            snapshot.forEachSubscriberOfAny(viewTypes, [&](const SubscriberSlot& subscriber) {
+                for (std::uint64_t types = subscriber.typeMask & viewTypes; types != 0; types &= types - 1) {
+                    const auto type = static_cast<std::size_t>(std::countr_zero(types));
+                    pushRun(*subscriber.queue, view, view.typeRun(type), metrics);
+                }
+            });
+        } else if (viewTypes != 0) {
+            // A single type: its subscriber list is exactly the set to notify
+            const auto type = static_cast<std::size_t>(std::countr_zero(viewTypes));
+            snapshot.forEachSubscription(static_cast<PacketType>(type), [&](const Subscription& subscription) {
+                pushRun(*subscription.queue, view, view.typeRun(type), metrics);
+            });
+        }
+        deliverFiltered(worker, snapshot, view, metrics);
+        worker.processed.fetch_add(view.indices().size(), std::memory_order_relaxed);
+        if (metrics != nullptr) {
+            recordDelivered(*metrics, view);
+        }
+    }
+
+    // A push into a delivery queue. Waiting for space (OverflowPolicy::Block) wakes the dispatcher first, and
+    // is recorded with metrics on.
+    void pushTimed(DeliveryQueue& queue, const Notification& notification, MetricsShard* metrics) {
+        if (metrics == nullptr) {
+            queue.push(notification, nullptr, wakeDispatcher);
+            return;
+        }
+        std::uint64_t waited = 0;
+        queue.push(notification, &waited, wakeDispatcher);
+        if (waited != 0) {
+            metrics->recordWait(LockSite::DeliveryBlock, waited);
+        }
+    }
+
+    // Subscriber-major: the whole run of packets goes into one queue before moving to the next
+    void pushRun(DeliveryQueue& queue, const ShardView& view, std::span<const std::uint32_t> indices,
+                 MetricsShard* metrics) {
+        for (std::uint32_t index : indices) {
+            pushTimed(queue, describe(view.packets[index], view.sequence(index), view.ingestNanos(index)), metrics);
+        }
+        if (metrics != nullptr && !indices.empty()) {
+            metrics->notifications[packetTypeIndex(view.packets[indices.front()].type)].add(indices.size());
+        }
+    }
+
+    // Per-type counts, and the ingest-to-notification latency of every packet of the view
+    static void recordDelivered(MetricsShard& metrics, const ShardView& view) {
+        const std::uint64_t now = metricsClock();
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            metrics.packets[type].add(view.typeRun(type).size());
+        }
+        if (view.stamps.empty()) {
+            if (view.batchIngestNanos != 0) {
+                metrics.recordLatency(now - view.batchIngestNanos, view.indices().size());
+            }
+            return;
+        }
+        for (std::uint32_t index : view.indices()) {
+            if (view.stamps[index].ingestNanos != 0) {
+                metrics.recordLatency(now - view.stamps[index].ingestNanos);
+            }
+        }
+    }
+
+    // Evaluates every filter over the whole view at once, then pushes the matching packets
+    void deliverFiltered(Worker& worker, const SubscriptionSnapshot& snapshot, const ShardView& view,
+                         MetricsShard* metrics) {
+        auto filterSubscriptions = snapshot.filterSubscriptions();
+        if (filterSubscriptions.empty()) {
+            return;
+        }
+        auto indices = view.indices();
+        worker.columns.load(view.packets, indices);
+        worker.matches.resize(indices.size());
+        for (const FilterSubscription& subscription : filterSubscriptions) {
+            subscription.filter->evaluate(worker.columns, worker.matches, worker.filterScratch);
+            for (std::size_t i = 0; i < indices.size(); ++i) {
+                if (worker.matches[i]) {
+                    const std::uint32_t index = indices[i];
+                    pushTimed(*subscription.queue,
+                              describe(view.packets[index], view.sequence(index), view.ingestNanos(index)), metrics);
+                    if (metrics != nullptr) {
+                        metrics->filterMatches[packetTypeIndex(view.packets[index].type)].add(1);
+                    }
+                }
+            }
+        }
+    }
+
+    static Notification describe(const Packet& packet, std::uint64_t sequence, std::uint64_t ingestNanos) {
+        return {packet.type, static_cast<std::uint32_t>(packet.content.size()), packet.flow, sequence, ingestNanos};
+    }
+
+    std::span<const std::uint32_t> shardOf(const Worker& worker) const {
+        return partition.buckets(worker.shard * packetTypeCount, (worker.shard + 1) * packetTypeCount);
+    }
+
+    static void pinToCore([[maybe_unused]] std::jthread& thread, [[maybe_unused]] std::size_t index) {
+#if defined(__linux__)
+        const unsigned cores = std::thread::hardware_concurrency();
+        if (cores == 0) {
+            return;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set); // Best effort: runs unpinned on failure
+#endif
+    }
+};
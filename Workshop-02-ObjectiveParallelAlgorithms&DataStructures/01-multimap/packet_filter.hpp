@@ -0,0 +1,451 @@
+#pragma once
+
+/*
+    Compiled packet filters.
+
+    Matching on PacketType alone is not enough for most subscribers; they want predicates like
+
+        type == HTTP && length > 512 && dport in {80, 443, 8080}
+
+    Interpreting such an expression per packet means walking a syntax tree with a branch per node for every
+    packet, which is exactly the CPU-bound per-packet filtering the README warns about. Instead, like BPF:
+
+    1. The expression is parsed once and compiled into a flat stack-machine program (postfix order).
+    2. A batch is turned into columns, one array per header field (PacketColumns).
+    3. Every instruction runs over the whole batch at once: a comparison is one tight loop over a column that
+       writes a 0/1 byte per packet, && and || are byte-wise AND/OR of two such masks. These loops have no
+       data-dependent branches, so the compiler vectorizes them.
+
+    A peephole pass fuses "compare, then &&" into one instruction that ANDs into the mask on top of the stack,
+    so the common chain of conjunctions needs a single mask buffer.
+
+    Grammar:
+        expression := conjunction ('||' conjunction)*
+        conjunction := unary ('&&' unary)*
+        unary      := '!' unary | '(' expression ')' | 'true' | 'false' | comparison
+        comparison := field ('==' | '!=' | '<' | '<=' | '>' | '>=') value
+                    | field 'in' '{' value (',' value)* '}'
+        field      := 'type' | 'length' | 'src' | 'dst' | 'sport' | 'dport'
+        value      := decimal integer | dotted IPv4 address | packet type name (HTTP, FTP, SSH)
+*/
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "packet.hpp"
+
+enum class FilterField : std::uint8_t {
+    Type,
+    Length,
+    SourceAddress,
+    DestinationAddress,
+    SourcePort,
+    DestinationPort,
+    Count
+};
+
+// A batch in structure-of-arrays form; buffers are reused between batches
+class PacketColumns {
+public:
+    template<typename Indices>
+    void load(std::span<const Packet> packets, const Indices& indices) {
+        count = 0;
+        for (auto& column : columns) {
+            column.resize(indices.size());
+        }
+        for (auto index : indices) {
+            const Packet& packet = packets[index];
+            column(FilterField::Type)[count] = static_cast<std::uint32_t>(packet.type);
+            column(FilterField::Length)[count] = static_cast<std::uint32_t>(packet.content.size());
+            column(FilterField::SourceAddress)[count] = packet.flow.sourceAddress;
+            column(FilterField::DestinationAddress)[count] = packet.flow.destinationAddress;
+            column(FilterField::SourcePort)[count] = packet.flow.sourcePort;
+            column(FilterField::DestinationPort)[count] = packet.flow.destinationPort;
+            ++count;
+        }
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    const std::uint32_t* column(FilterField field) const {
+        return columns[static_cast<std::size_t>(field)].data();
+    }
+
+private:
+    std::uint32_t* column(FilterField field) {
+        return columns[static_cast<std::size_t>(field)].data();
+    }
+
+    std::array<std::vector<std::uint32_t>, static_cast<std::size_t>(FilterField::Count)> columns;
+    std::size_t count = 0;
+};
+
+class PacketFilter {
+public:
+    // Throws std::invalid_argument with the offending position if the expression does not parse
+    static PacketFilter compile(std::string_view expression) {
+        PacketFilter filter;
+        filter.text = std::string(expression);
+        Parser parser{expression, 0, filter};
+        parser.parseExpression();
+        parser.skipSpaces();
+        if (parser.position != expression.size()) {
+            parser.fail("unexpected input");
+        }
+        filter.optimize();
+        return filter;
+    }
+
+    // Writes 1 into matches[i] if packet i of the columns passes the filter, 0 otherwise.
+    // scratch is caller-owned so evaluation does not allocate once it has grown.
+    void evaluate(const PacketColumns& batch, std::span<std::uint8_t> matches,
+                  std::vector<std::vector<std::uint8_t>>& scratch) const {
+        const std::size_t count = batch.size();
+        if (scratch.size() < maxDepth) {
+            scratch.resize(maxDepth);
+        }
+        for (auto& mask : scratch) {
+            mask.resize(std::max(mask.size(), count));
+        }
+
+        std::size_t depth = 0;
+        for (const Instruction& instruction : code) {
+            switch (instruction.op) {
+            case Op::Constant:
+                std::fill_n(scratch[depth++].data(), count, static_cast<std::uint8_t>(instruction.operand));
+                break;
+            case Op::Compare:
+                compare(batch.column(instruction.field), instruction, scratch[depth++].data(), count, false);
+                break;
+            case Op::CompareAnd:
+                compare(batch.column(instruction.field), instruction, scratch[depth - 1].data(), count, true);
+                break;
+            case Op::InSet:
+                inSet(batch.column(instruction.field), sets[instruction.operand], scratch[depth++].data(), count);
+                break;
+            case Op::And:
+                combine(scratch[depth - 2].data(), scratch[depth - 1].data(), count, true);
+                --depth;
+                break;
+            case Op::Or:
+                combine(scratch[depth - 2].data(), scratch[depth - 1].data(), count, false);
+                --depth;
+                break;
+            case Op::Not: {
+                std::uint8_t* mask = scratch[depth - 1].data();
+                for (std::size_t i = 0; i < count; ++i) {
+                    mask[i] ^= 1;
+                }
+                break;
+            }
+            }
+        }
+        std::copy_n(scratch[0].data(), count, matches.data());
+    }
+
+    const std::string& expression() const {
+        return text;
+    }
+
+    std::size_t instructionCount() const {
+        return code.size();
+    }
+
+private:
+    enum class Op : std::uint8_t { Constant, Compare, CompareAnd, InSet, And, Or, Not };
+    enum class Comparison : std::uint8_t { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+    struct Instruction {
+        Op op;
+        FilterField field = FilterField::Type;
+        Comparison comparison = Comparison::Equal;
+        std::uint32_t operand = 0; // Constant value, or index into sets for InSet
+    };
+
+    // One branch per instruction, none per packet: the comparison is hoisted out of the loop
+    template<typename Predicate>
+    static void compareWith(const std::uint32_t* column, std::uint8_t* mask, std::size_t count, bool andInto,
+                            Predicate predicate) {
+        if (andInto) {
+            for (std::size_t i = 0; i < count; ++i) {
+                mask[i] &= static_cast<std::uint8_t>(predicate(column[i]));
+            }
+        } else {
+            for (std::size_t i = 0; i < count; ++i) {
+                mask[i] = static_cast<std::uint8_t>(predicate(column[i]));
+            }
+        }
+    }
+
+    static void compare(const std::uint32_t* column, const Instruction& instruction, std::uint8_t* mask,
+                        std::size_t count, bool andInto) {
+        const std::uint32_t value = instruction.operand;
+        switch (instruction.comparison) {
+        case Comparison::Equal:
+            return compareWith(column, mask, count, andInto, [value](std::uint32_t x) { return x == value; });
+        case Comparison::NotEqual:
+            return compareWith(column, mask, count, andInto, [value](std::uint32_t x) { return x != value; });
+        case Comparison::Less:
+            return compareWith(column, mask, count, andInto, [value](std::uint32_t x) { return x < value; });
+        case Comparison::LessEqual:
+            return compareWith(column, mask, count, andInto, [value](std::uint32_t x) { return x <= value; });
+        case Comparison::Greater:
+            return compareWith(column, mask, count, andInto, [value](std::uint32_t x) { return x > value; });
+        case Comparison::GreaterEqual:
+            return compareWith(column, mask, count, andInto, [value](std::uint32_t x) { return x >= value; });
+        }
+    }
+
+    static void inSet(const std::uint32_t* column, const std::vector<std::uint32_t>& set, std::uint8_t* mask,
+                      std::size_t count) {
+        std::fill_n(mask, count, std::uint8_t{0});
+        // One pass per member keeps the inner loop branch-free; sets in filters are small
+        for (std::uint32_t member : set) {
+            for (std::size_t i = 0; i < count; ++i) {
+                mask[i] |= static_cast<std::uint8_t>(column[i] == member);
+            }
+        }
+    }
+
+    static void combine(std::uint8_t* target, const std::uint8_t* operand, std::size_t count, bool conjunction) {
+        if (conjunction) {
+            for (std::size_t i = 0; i < count; ++i) {
+                target[i] &= operand[i];
+            }
+        } else {
+            for (std::size_t i = 0; i < count; ++i) {
+                target[i] |= operand[i];
+            }
+        }
+    }
+
+    // Fuses "Compare, And" into "CompareAnd" and computes the stack depth the program needs
+    void optimize() {
+        std::vector<Instruction> fused;
+        for (const Instruction& instruction : code) {
+            if (instruction.op == Op::And && !fused.empty() && fused.back().op == Op::Compare && fused.size() >= 2) {
+                fused.back().op = Op::CompareAnd;
+                continue;
+            }
+            fused.push_back(instruction);
+        }
+        code = std::move(fused);
+
+        std::size_t depth = 0;
+        maxDepth = 1;
+        for (const Instruction& instruction : code) {
+            switch (instruction.op) {
+            case Op::Constant:
+            case Op::Compare:
+            case Op::InSet:
+                maxDepth = std::max(maxDepth, ++depth);
+                break;
+            case Op::And:
+            case Op::Or:
+                --depth;
+                break;
+            case Op::CompareAnd:
+            case Op::Not:
+                break;
+            }
+        }
+    }
+
+    struct Parser {
+        std::string_view input;
+        std::size_t position;
+        PacketFilter& filter;
+
+        [[noreturn]] void fail(const std::string& message) const {
+            throw std::invalid_argument("filter: " + message + " at position " + std::to_string(position) +
+                                        " in \"" + std::string(input) + "\"");
+        }
+
+        void skipSpaces() {
+            while (position < input.size() && std::isspace(static_cast<unsigned char>(input[position]))) {
+                ++position;
+            }
+        }
+
+        bool accept(std::string_view token) {
+            skipSpaces();
+            if (input.substr(position, token.size()) == token) {
+                position += token.size();
+                return true;
+            }
+            return false;
+        }
+
+        void expect(std::string_view token) {
+            if (!accept(token)) {
+                fail("expected '" + std::string(token) + "'");
+            }
+        }
+
+        std::string_view word() {
+            skipSpaces();
+            const std::size_t start = position;
+            while (position < input.size() &&
+                   (std::isalnum(static_cast<unsigned char>(input[position])) || input[position] == '.')) {
+                ++position;
+            }
+            return input.substr(start, position - start);
+        }
+
+        void emit(Op op) {
+            filter.code.push_back({op});
+        }
+
+        void parseExpression() {
+            parseConjunction();
+            while (accept("||")) {
+                parseConjunction();
+                emit(Op::Or);
+            }
+        }
+
+        void parseConjunction() {
+            parseUnary();
+            while (accept("&&")) {
+                parseUnary();
+                emit(Op::And);
+            }
+        }
+
+        void parseUnary() {
+            if (accept("!")) {
+                parseUnary();
+                emit(Op::Not);
+                return;
+            }
+            if (accept("(")) {
+                parseExpression();
+                expect(")");
+                return;
+            }
+            const std::size_t start = position;
+            const std::string_view name = word();
+            if (name == "true" || name == "false") {
+                filter.code.push_back({Op::Constant, FilterField::Type, Comparison::Equal, name == "true" ? 1u : 0u});
+                return;
+            }
+            position = start;
+            parseComparison();
+        }
+
+        void parseComparison() {
+            const FilterField field = parseField();
+            skipSpaces();
+            const std::size_t start = position;
+            if (word() == "in") {
+                expect("{");
+                std::vector<std::uint32_t> set{parseValue(field)};
+                while (accept(",")) {
+                    set.push_back(parseValue(field));
+                }
+                expect("}");
+                std::sort(set.begin(), set.end());
+                set.erase(std::unique(set.begin(), set.end()), set.end());
+                filter.sets.push_back(std::move(set));
+                filter.code.push_back({Op::InSet, field, Comparison::Equal,
+                                       static_cast<std::uint32_t>(filter.sets.size() - 1)});
+                return;
+            }
+            position = start;
+
+            Comparison comparison;
+            if (accept("==")) {
+                comparison = Comparison::Equal;
+            } else if (accept("!=")) {
+                comparison = Comparison::NotEqual;
+            } else if (accept("<=")) {
+                comparison = Comparison::LessEqual;
+            } else if (accept(">=")) {
+                comparison = Comparison::GreaterEqual;
+            } else if (accept("<")) {
+                comparison = Comparison::Less;
+            } else if (accept(">")) {
+                comparison = Comparison::Greater;
+            } else {
+                fail("expected a comparison operator or 'in'");
+            }
+            filter.code.push_back({Op::Compare, field, comparison, parseValue(field)});
+        }
+
+        FilterField parseField() {
+            const std::string_view name = word();
+            if (name.empty()) {
+                fail("expected a field");
+            }
+            if (name == "type") return FilterField::Type;
+            if (name == "length") return FilterField::Length;
+            if (name == "src") return FilterField::SourceAddress;
+            if (name == "dst") return FilterField::DestinationAddress;
+            if (name == "sport") return FilterField::SourcePort;
+            if (name == "dport") return FilterField::DestinationPort;
+            fail("unknown field '" + std::string(name) + "'");
+        }
+
+        std::uint32_t parseValue(FilterField field) {
+            const std::string_view text = word();
+            if (text.empty()) {
+                fail("expected a value");
+            }
+            if (field == FilterField::Type) {
+                if (text == "HTTP") return packetTypeIndex(PacketType::HTTP);
+                if (text == "FTP") return packetTypeIndex(PacketType::FTP);
+                if (text == "SSH") return packetTypeIndex(PacketType::SSH);
+                fail("unknown packet type '" + std::string(text) + "'");
+            }
+
+            // Decimal number, or a dotted IPv4 address folded into host byte order: four octets of at least
+            // one digit each, so "1.2.3." and "1..2.3" are rejected rather than read as zeros
+            const auto invalidAddress = [&] { fail("invalid IPv4 address '" + std::string(text) + "'"); };
+            std::uint64_t value = 0;
+            std::uint64_t part = 0;
+            std::size_t digits = 0; // In the current part
+            std::size_t dots = 0;
+            for (char character : text) {
+                if (character == '.') {
+                    if (digits == 0 || dots == 3) {
+                        invalidAddress();
+                    }
+                    if (part > 255) {
+                        fail("address octet out of range");
+                    }
+                    value = (value << 8) | part;
+                    part = 0;
+                    digits = 0;
+                    ++dots;
+                } else if (std::isdigit(static_cast<unsigned char>(character))) {
+                    part = part * 10 + static_cast<std::uint64_t>(character - '0');
+                    ++digits;
+                    if (part > 0xffffffffu) {
+                        fail("value out of range");
+                    }
+                } else {
+                    fail("invalid value '" + std::string(text) + "'");
+                }
+            }
+            if (dots != 0 && (dots != 3 || digits == 0 || part > 255)) {
+                invalidAddress();
+            }
+            return static_cast<std::uint32_t>(dots == 0 ? part : (value << 8) | part);
+        }
+    };
+
+    std::string text;
+    std::vector<Instruction> code;
+    std::vector<std::vector<std::uint32_t>> sets;
+    std::size_t maxDepth = 1;
+};
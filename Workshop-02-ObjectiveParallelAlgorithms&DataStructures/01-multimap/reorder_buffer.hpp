@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+    Bounded reorder window for one subscriber.
+
+    Workers deliver in parallel, so the notifications in a subscriber's ring are ordered by which worker
+    got there first, not by when the packets were taken in. Every notification carries the packet's sequence
+    number, and the analyzer can tell a watermark: every packet with a smaller sequence has
+    already been delivered (or dropped). The reorder buffer holds notifications in a min-heap by sequence
+    and releases, in order, exactly those below the watermark: nothing that could still be overtaken.
+
+    The window is bounded. When it is full and nothing in it is below the watermark, the consumer has the
+    choice between waiting and giving up order; DeliveryQueue gives up order on the oldest notification
+    only while its ring holds more, and counts every notification that ends up handed over out of order.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+template<typename Item>
+class ReorderBuffer {
+public:
+    explicit ReorderBuffer(std::size_t window) : window(window < 1 ? 1 : window) {
+        heap.reserve(this->window);
+    }
+
+    bool full() const {
+        return heap.size() >= window;
+    }
+
+    std::size_t size() const {
+        return heap.size();
+    }
+
+    std::size_t capacity() const {
+        return window;
+    }
+
+    void insert(const Item& item) {
+        heap.push_back(item);
+        std::push_heap(heap.begin(), heap.end(), later);
+    }
+
+    // Hands over, in sequence order, at most maxCount items whose sequence is below watermark
+    template<typename Consumer>
+    std::size_t release(std::uint64_t watermark, Consumer&& consume, std::size_t maxCount) {
+        std::size_t released = 0;
+        while (released < maxCount && !heap.empty() && heap.front().sequence < watermark) {
+            releaseFront(consume);
+            ++released;
+        }
+        return released;
+    }
+
+    // Hands over the smallest sequence whether or not the watermark has passed it
+    template<typename Consumer>
+    void releaseOldest(Consumer&& consume) {
+        releaseFront(consume);
+    }
+
+private:
+    static bool later(const Item& left, const Item& right) {
+        return left.sequence > right.sequence;
+    }
+
+    template<typename Consumer>
+    void releaseFront(Consumer& consume) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        consume(heap.back());
+        heap.pop_back();
+    }
+
+    const std::size_t window;
+    std::vector<Item> heap;
+};
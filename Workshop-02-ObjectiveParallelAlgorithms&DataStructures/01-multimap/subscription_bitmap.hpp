@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+    Bitmap subscription matrix.
+
+    A batch usually mixes several packet types. Walking one subscriber list per type visits a subscriber of
+    three types three times, and answering "who wants any of these types" from std::set<PacketType> per
+    subscriber means walking many small trees.
+
+    Every subscriber gets a dense slot number, and for each type a bit row says which slots want it. The
+    subscribers wanting any type of a mask are then the OR of a few rows, 64 subscribers per machine word
+    (256 per AVX2 instruction), and iterating the set bits with countr_zero visits only the subscribers that
+    matched, each exactly once.
+
+    Rows are cut into chunks of 1024 slots so the RCU snapshot can share unchanged chunks between versions,
+    like the per-type lists. Each chunk also keeps, per slot, the subscriber's queue and full type mask.
+
+    The AVX2 path is compiled with a target attribute and chosen at run time, like the gathers of
+    EytzingerIntervalMap, so the plain builds documented in the examples use it on any CPU that has AVX2.
+    Elsewhere the scalar loop runs, which the compiler may still vectorize with SSE2.
+*/
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SUBSCRIPTION_BITMAP_AVX2 1
+#endif
+
+#include "delivery_queue.hpp"
+#include "packet.hpp"
+
+struct SubscriberSlot {
+    SubscriberId subscriberId = 0;
+    std::uint64_t typeMask = 0;     // Bit i: subscribed to PacketType i
+    DeliveryQueue* queue = nullptr; // nullptr: free slot
+};
+
+struct SubscriptionBitmapChunk {
+    static constexpr std::size_t slotCount = 1024;
+    static constexpr std::size_t wordCount = slotCount / 64;
+
+    alignas(32) std::array<std::array<std::uint64_t, wordCount>, packetTypeCount> rows{};
+    std::array<SubscriberSlot, slotCount> slots{};
+};
+
+using SubscriptionBitmap = std::vector<std::shared_ptr<const SubscriptionBitmapChunk>>;
+
+inline void matchAnyTypeScalar(const SubscriptionBitmapChunk& chunk, std::uint64_t typeMask,
+                               std::array<std::uint64_t, SubscriptionBitmapChunk::wordCount>& matched) {
+    matched.fill(0);
+    for (std::uint64_t types = typeMask; types != 0; types &= types - 1) {
+        const auto& row = chunk.rows[static_cast<std::size_t>(std::countr_zero(types))];
+        for (std::size_t word = 0; word < SubscriptionBitmapChunk::wordCount; ++word) {
+            matched[word] |= row[word];
+        }
+    }
+}
+
+#ifdef SUBSCRIPTION_BITMAP_AVX2
+__attribute__((target("avx2"))) inline void matchAnyTypeAvx2(
+    const SubscriptionBitmapChunk& chunk, std::uint64_t typeMask,
+    std::array<std::uint64_t, SubscriptionBitmapChunk::wordCount>& matched) {
+    for (std::size_t word = 0; word < SubscriptionBitmapChunk::wordCount; word += 4) {
+        __m256i any = _mm256_setzero_si256();
+        for (std::uint64_t types = typeMask; types != 0; types &= types - 1) {
+            const auto* row = chunk.rows[static_cast<std::size_t>(std::countr_zero(types))].data() + word;
+            any = _mm256_or_si256(any, _mm256_load_si256(reinterpret_cast<const __m256i*>(row)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(matched.data() + word), any);
+    }
+}
+#endif
+
+// ORs the rows of every type in typeMask into matched
+inline void matchAnyType(const SubscriptionBitmapChunk& chunk, std::uint64_t typeMask,
+                         std::array<std::uint64_t, SubscriptionBitmapChunk::wordCount>& matched) {
+#ifdef SUBSCRIPTION_BITMAP_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) {
+        matchAnyTypeAvx2(chunk, typeMask, matched);
+        return;
+    }
+#endif
+    matchAnyTypeScalar(chunk, typeMask, matched);
+}
+
+// Calls visit(const SubscriberSlot&) once for every subscriber of at least one type in typeMask
+template<typename Visitor>
+void forEachSubscriberOfAny(const SubscriptionBitmap& bitmap, std::uint64_t typeMask, Visitor&& visit) {
+    std::array<std::uint64_t, SubscriptionBitmapChunk::wordCount> matched;
+    for (const auto& chunk : bitmap) {
+        if (!chunk) {
+            continue; // No slot of this range is in use
+        }
+        matchAnyType(*chunk, typeMask, matched);
+        for (std::size_t word = 0; word < SubscriptionBitmapChunk::wordCount; ++word) {
+            for (std::uint64_t bits = matched[word]; bits != 0; bits &= bits - 1) {
+                visit(chunk->slots[word * 64 + static_cast<std::size_t>(std::countr_zero(bits))]);
+            }
+        }
+    }
+}
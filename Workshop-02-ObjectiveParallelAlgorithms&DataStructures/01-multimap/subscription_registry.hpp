@@ -0,0 +1,741 @@
+#pragma once
+
+/*
+    Read-copy-update subscription snapshots.
+
+    The workers read the subscriber lists on every batch while the control plane subscribes and unsubscribes
+    thousands of times per second. A lock would make every batch wait for the control plane, so instead:
+
+    - Readers (the workers) pick up the current immutable SubscriptionSnapshot with one atomic load and
+      use it for the whole batch. They never block and never write shared memory except their own slot.
+    - Writers apply a change to the mutable master FlatSubscriberTable under a control-plane mutex, build
+      the next snapshot version and publish it with an atomic store.
+    - The previous snapshot is retired, not deleted. Each reader announces in its own slot the version it
+      may be using; a retired snapshot is freed once every slot is past its version (epoch-based reclamation).
+
+    Copying the whole subscriber list per change would cost O(subscribers). The per-type lists are split
+    into fixed-size chunks shared between versions through shared_ptr, so a change copies the chunk pointers
+    of one type and rebuilds at most the two chunks the swap-remove touched. Only the writer ever touches the
+    reference counts; readers use plain pointers inside their pinned snapshot.
+
+    Each entry already carries the subscriber's DeliveryQueue, so fan-out does no lookup at all. Queues of
+    removed subscribers are retired together with the snapshot that still referenced them.
+
+    Subscribers with a compiled PacketFilter are kept in a separate, small list that is copied as a whole
+    when it changes.
+
+    Every subscriber also owns a dense slot in the SubscriptionBitmap (subscription_bitmap.hpp), published
+    with the same chunk sharing, for batches that mix several packet types. A chunked, hashed index from
+    subscriber id to slot lets any thread find a subscriber's queue in the snapshot it pinned: threads other
+    than the workers (direct notifications, stats) claim one of a few shared reader slots with a CAS.
+
+    exportState and restore move the whole subscription state at once, for snapshot files
+    (subscription_snapshot_file.hpp): restore fills the master table in one pass and builds the first
+    snapshot from scratch, instead of publishing one version per subscribe.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "delivery_queue.hpp"
+#include "flat_subscriber_table.hpp"
+#include "packet.hpp"
+#include "packet_filter.hpp"
+#include "subscription_bitmap.hpp"
+
+struct Subscription {
+    SubscriberId subscriberId;
+    DeliveryQueue* queue;
+};
+
+struct FilterSubscription {
+    SubscriberId subscriberId;
+    DeliveryQueue* queue;
+    std::shared_ptr<const PacketFilter> filter;
+};
+
+// Everything the registry knows about one subscriber, as exported and restored
+struct SubscriberState {
+    SubscriberId subscriberId = 0;
+    std::uint64_t typeMask = 0; // Bit i: subscribed to PacketType i
+    DeliveryConfig delivery;
+    std::string_view filter; // Source of the PacketFilter, empty without one
+};
+
+struct SubscriptionChange {
+    SubscriberId subscriberId;
+    PacketType packetType;
+    bool subscribe; // false: unsubscribe
+};
+
+class SubscriptionSnapshot {
+public:
+    static constexpr std::size_t chunkSize = 1024;
+
+    using Chunk = std::vector<Subscription>;
+
+    struct TypeList {
+        std::vector<std::shared_ptr<const Chunk>> chunks;
+        std::size_t size = 0;
+    };
+
+    std::uint64_t version() const {
+        return snapshotVersion;
+    }
+
+    std::size_t subscriberCount(PacketType packetType) const {
+        return types[packetTypeIndex(packetType)]->size;
+    }
+
+    // Calls visit(const Subscription&) for every subscriber of the type; chunks are contiguous
+    template<typename Visitor>
+    void forEachSubscription(PacketType packetType, Visitor&& visit) const {
+        for (const auto& chunk : types[packetTypeIndex(packetType)]->chunks) {
+            for (const Subscription& subscription : *chunk) {
+                visit(subscription);
+            }
+        }
+    }
+
+    std::span<const FilterSubscription> filterSubscriptions() const {
+        return *filters;
+    }
+
+    // Calls visit(const SubscriberSlot&) once per subscriber of any type in typeMask
+    template<typename Visitor>
+    void forEachSubscriberOfAny(std::uint64_t typeMask, Visitor&& visit) const {
+        ::forEachSubscriberOfAny(*bitmap, typeMask, std::forward<Visitor>(visit));
+    }
+
+    // The subscriber's queue, nullptr if it has none; valid while the snapshot is pinned
+    DeliveryQueue* deliveryQueue(SubscriberId subscriberId) const {
+        const IndexChunk& chunk = *index->chunks[indexChunkOf(subscriberId, index->chunks.size())];
+        auto it = std::lower_bound(chunk.begin(), chunk.end(), subscriberId,
+                                   [](const auto& entry, SubscriberId id) { return entry.first < id; });
+        if (it == chunk.end() || it->first != subscriberId) {
+            return nullptr;
+        }
+        return (*bitmap)[it->second / SubscriptionBitmapChunk::slotCount]
+            ->slots[it->second % SubscriptionBitmapChunk::slotCount]
+            .queue;
+    }
+
+private:
+    friend class SubscriptionRegistry;
+
+    // Subscriber id to bitmap slot, sorted by id; the chunk is chosen by a hash of the id
+    using IndexChunk = std::vector<std::pair<SubscriberId, std::uint32_t>>;
+
+    struct SubscriberIndex {
+        std::vector<std::shared_ptr<const IndexChunk>> chunks; // A power of two of them
+    };
+
+    static std::size_t indexChunkOf(SubscriberId subscriberId, std::size_t chunkCount) {
+        const std::uint64_t hash = static_cast<std::uint32_t>(subscriberId) * 0x9e37'79b9'7f4a'7c15ull;
+        return static_cast<std::size_t>(hash >> 32) & (chunkCount - 1);
+    }
+
+    std::uint64_t snapshotVersion = 0;
+    std::array<std::shared_ptr<const TypeList>, packetTypeCount> types;
+    std::shared_ptr<const std::vector<FilterSubscription>> filters;
+    std::shared_ptr<const SubscriptionBitmap> bitmap;
+    std::shared_ptr<const SubscriberIndex> index;
+};
+
+class SubscriptionRegistry {
+public:
+    static constexpr std::uint64_t quiescent = std::numeric_limits<std::uint64_t>::max();
+    // Reader slots for threads other than the workers, claimed per read
+    static constexpr std::size_t sharedReaderCount = 16;
+    // Average ids per index chunk before the index doubles its chunk count; like the subscriber list chunks,
+    // a change copies one chunk of about this size
+    static constexpr std::size_t indexChunkTarget = SubscriptionSnapshot::chunkSize;
+
+    explicit SubscriptionRegistry(std::size_t readerCount)
+        : readers(readerCount + sharedReaderCount), workerReaders(readerCount) {
+        auto initial = std::make_unique<SubscriptionSnapshot>();
+        for (auto& type : initial->types) {
+            type = std::make_shared<const SubscriptionSnapshot::TypeList>();
+        }
+        initial->filters = std::make_shared<const std::vector<FilterSubscription>>();
+        initial->bitmap = std::make_shared<const SubscriptionBitmap>();
+        initial->index = indexOf(1);
+        current.store(initial.release());
+    }
+
+    ~SubscriptionRegistry() {
+        delete current.load();
+    }
+
+    SubscriptionRegistry(const SubscriptionRegistry&) = delete;
+    SubscriptionRegistry& operator=(const SubscriptionRegistry&) = delete;
+
+    // Pins the current snapshot for one reader until the guard is destroyed
+    class ReadGuard {
+    public:
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        ~ReadGuard() {
+            slotVersion.store(quiescent, std::memory_order_release);
+        }
+
+        const SubscriptionSnapshot& snapshot() const {
+            return *pinned;
+        }
+
+    private:
+        friend class SubscriptionRegistry;
+
+        ReadGuard(const std::atomic<std::uint64_t>& version, const std::atomic<const SubscriptionSnapshot*>& current,
+                  std::atomic<std::uint64_t>& slot)
+            : slotVersion(slot) {
+            // Announce first, then load: a writer that misses the announcement has already published
+            // a newer snapshot, so the load below cannot return anything it is about to free
+            slotVersion.store(version.load());
+            pinned = current.load();
+        }
+
+        // The slot has already been claimed with the announced version
+        ReadGuard(const std::atomic<const SubscriptionSnapshot*>& current, std::atomic<std::uint64_t>& slot)
+            : slotVersion(slot), pinned(current.load()) {}
+
+        std::atomic<std::uint64_t>& slotVersion;
+        const SubscriptionSnapshot* pinned = nullptr;
+    };
+
+    // Data plane: reader is the worker index, each reader uses its own slot
+    ReadGuard read(std::size_t reader) const {
+        return ReadGuard(publishedVersion, current, readers[reader].version);
+    }
+
+    // Any thread: claims a free shared slot by announcing in it with a CAS, and yields only while every
+    // shared slot is pinned. Keep the guard short, it holds one of sharedReaderCount slots.
+    ReadGuard readShared() const {
+        thread_local const std::size_t first = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        for (std::size_t attempt = 0;; ++attempt) {
+            auto& slot = readers[workerReaders + (first + attempt) % sharedReaderCount].version;
+            std::uint64_t expected = quiescent;
+            if (slot.compare_exchange_strong(expected, publishedVersion.load())) {
+                return ReadGuard(current, slot);
+            }
+            if (attempt % sharedReaderCount == sharedReaderCount - 1) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Control plane, serialized by controlMutex; never waits for the readers
+
+    DeliveryQueue& configureDelivery(SubscriberId subscriberId, std::size_t capacity = 1024,
+                                     OverflowPolicy policy = OverflowPolicy::Drop, std::size_t reorderWindow = 0) {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        const bool created = !queues.contains(subscriberId);
+        DeliveryQueue& queue = queueOf(subscriberId, capacity, policy, reorderWindow);
+        if (created) {
+            publishLocked(); // So that readers can look the queue up
+        }
+        return queue;
+    }
+
+    bool subscribe(SubscriberId subscriberId, PacketType packetType) {
+        return apply({{subscriberId, packetType, true}}) == 1;
+    }
+
+    bool unsubscribe(SubscriberId subscriberId, PacketType packetType) {
+        return apply({{subscriberId, packetType, false}}) == 1;
+    }
+
+    // Applies a batch of changes and publishes them as one new version, returns how many changed anything
+    std::size_t apply(std::span<const SubscriptionChange> changes) {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        std::size_t applied = 0;
+        for (const auto& change : changes) {
+            applied += applyLocked(change) ? 1 : 0;
+        }
+        if (applied > 0) {
+            publishLocked();
+        }
+        return applied;
+    }
+
+    std::size_t apply(std::initializer_list<SubscriptionChange> changes) {
+        return apply(std::span<const SubscriptionChange>(changes.begin(), changes.size()));
+    }
+
+    // Delivers every packet that passes the filter, independently of the type subscriptions.
+    // A subscriber has at most one filter; subscribing again replaces it.
+    void subscribeFilter(SubscriberId subscriberId, PacketFilter filter) {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        queueOf(subscriberId);
+        filters[subscriberId] = std::make_shared<const PacketFilter>(std::move(filter));
+        filtersDirty = true;
+        publishLocked();
+    }
+
+    bool unsubscribeFilter(SubscriberId subscriberId) {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        if (filters.erase(subscriberId) == 0) {
+            return false;
+        }
+        filtersDirty = true;
+        publishLocked();
+        return true;
+    }
+
+    // Drops every subscription and the delivery queue; the queue is freed once no reader can reach it
+    void removeSubscriber(SubscriberId subscriberId) {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        auto it = queues.find(subscriberId);
+        if (it == queues.end()) {
+            return;
+        }
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            applyLocked({subscriberId, static_cast<PacketType>(type), false});
+        }
+        filtersDirty |= filters.erase(subscriberId) != 0;
+        retiredQueues.push_back(std::move(it->second));
+        queues.erase(it);
+
+        auto slot = slotOf.find(subscriberId);
+        slotOwners[slot->second].reset();
+        freeSlots.push_back(slot->second);
+        dirtySlots.insert(slot->second);
+        slotOf.erase(slot);
+        dirtyIds.push_back(subscriberId);
+        publishLocked();
+    }
+
+    bool isSubscribed(SubscriberId subscriberId, PacketType packetType) const {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        return master.isSubscribed(subscriberId, packetType);
+    }
+
+    std::uint64_t version() const {
+        return publishedVersion.load(std::memory_order_relaxed);
+    }
+
+    // Calls visit(const SubscriberState&) for every subscriber with a delivery queue, by increasing id, and
+    // returns the version the state belongs to. Runs under the control mutex, so the state is consistent;
+    // the filter views are only valid during the call.
+    template<typename Visitor>
+    std::uint64_t exportState(Visitor&& visit) const {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        std::vector<SubscriberId> subscriberIds;
+        subscriberIds.reserve(queues.size());
+        for (const auto& [subscriberId, queue] : queues) {
+            subscriberIds.push_back(subscriberId);
+        }
+        std::sort(subscriberIds.begin(), subscriberIds.end());
+        for (SubscriberId subscriberId : subscriberIds) {
+            auto filter = filters.find(subscriberId);
+            visit(SubscriberState{subscriberId, master.subscriptionMask(subscriberId),
+                                  queues.at(subscriberId)->config(),
+                                  filter == filters.end() ? std::string_view() : filter->second->expression()});
+        }
+        return publishedVersion.load(std::memory_order_relaxed);
+    }
+
+    // Bulk load into a registry without subscribers, published as a single new version. subscribers must
+    // be ordered by strictly increasing id, as exportState produces them. Throws std::logic_error if the
+    // registry already has subscribers, std::invalid_argument for bad input; either way nothing changes.
+    void restore(std::span<const SubscriberState> subscribers) {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        if (!queues.empty()) {
+            throw std::logic_error("restore needs a registry without subscribers");
+        }
+
+        // Validate and compile everything before the first change
+        constexpr std::uint64_t knownTypes = (std::uint64_t{1} << packetTypeCount) - 1;
+        std::array<std::size_t, packetTypeCount> typeCounts{};
+        std::vector<std::pair<SubscriberId, std::shared_ptr<const PacketFilter>>> compiled;
+        for (std::size_t index = 0; index < subscribers.size(); ++index) {
+            const SubscriberState& subscriber = subscribers[index];
+            if (index > 0 && subscriber.subscriberId <= subscribers[index - 1].subscriberId) {
+                throw std::invalid_argument("restore needs subscribers ordered by strictly increasing id");
+            }
+            if ((subscriber.typeMask & ~knownTypes) != 0) {
+                throw std::invalid_argument("restore got a subscription to an unknown packet type");
+            }
+            for (std::uint64_t types = subscriber.typeMask; types != 0; types &= types - 1) {
+                ++typeCounts[static_cast<std::size_t>(std::countr_zero(types))];
+            }
+            if (!subscriber.filter.empty()) {
+                compiled.emplace_back(subscriber.subscriberId,
+                                      std::make_shared<const PacketFilter>(PacketFilter::compile(subscriber.filter)));
+            }
+        }
+
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            master.reserve(static_cast<PacketType>(type), typeCounts[type]);
+        }
+        master.reserveSubscribers(subscribers.size());
+        queues.reserve(subscribers.size());
+        slotOf.reserve(subscribers.size());
+        slotOwners.reserve(subscribers.size());
+        for (const SubscriberState& subscriber : subscribers) {
+            queues[subscriber.subscriberId] = std::make_unique<DeliveryQueue>(
+                subscriber.delivery.capacity, subscriber.delivery.policy, subscriber.delivery.reorderWindow);
+            slotOf[subscriber.subscriberId] = static_cast<std::uint32_t>(slotOwners.size());
+            slotOwners.emplace_back(subscriber.subscriberId);
+            for (std::uint64_t types = subscriber.typeMask; types != 0; types &= types - 1) {
+                master.subscribe(subscriber.subscriberId, static_cast<PacketType>(std::countr_zero(types)));
+            }
+        }
+        for (auto& [subscriberId, filter] : compiled) {
+            filters.emplace(subscriberId, std::move(filter));
+        }
+        rebuildLocked();
+    }
+
+    // Snapshots published but not yet reclaimed
+    std::size_t retiredCount() const {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        return retired.size();
+    }
+
+    // Frees whatever no reader can still see; also done on every publish
+    void reclaim() {
+        std::lock_guard<std::mutex> guard(controlMutex);
+        reclaimLocked();
+    }
+
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<std::uint64_t> version{quiescent};
+    };
+
+    struct Retired {
+        std::uint64_t version;
+        std::unique_ptr<const SubscriptionSnapshot> snapshot;
+        std::vector<std::unique_ptr<DeliveryQueue>> queues;
+    };
+
+    DeliveryQueue& queueOf(SubscriberId subscriberId, std::size_t capacity = 1024,
+                           OverflowPolicy policy = OverflowPolicy::Drop, std::size_t reorderWindow = 0) {
+        auto& queue = queues[subscriberId];
+        if (!queue) {
+            queue = std::make_unique<DeliveryQueue>(capacity, policy, reorderWindow);
+            allocateSlot(subscriberId);
+        }
+        return *queue;
+    }
+
+    // Freed slots are reused before the bitmap grows, so it stays as long as the subscriber count
+    void allocateSlot(SubscriberId subscriberId) {
+        std::uint32_t slot;
+        if (freeSlots.empty()) {
+            slot = static_cast<std::uint32_t>(slotOwners.size());
+            slotOwners.emplace_back();
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slotOwners[slot] = subscriberId;
+        slotOf[subscriberId] = slot;
+        dirtySlots.insert(slot);
+        dirtyIds.push_back(subscriberId);
+    }
+
+    bool applyLocked(const SubscriptionChange& change) {
+        const std::size_t type = packetTypeIndex(change.packetType);
+        if (change.subscribe) {
+            queueOf(change.subscriberId);
+            if (!master.subscribe(change.subscriberId, change.packetType)) {
+                return false;
+            }
+            dirty[type].insert(master.subscribers(change.packetType).size() - 1);
+            dirtySlots.insert(slotOf.at(change.subscriberId));
+            return true;
+        }
+
+        const std::size_t hole = master.position(change.subscriberId, change.packetType);
+        if (hole == FlatSubscriberTable::npos) {
+            return false;
+        }
+        master.unsubscribe(change.subscriberId, change.packetType);
+        // Swap-remove rewrote the hole and shortened the list: both chunks change
+        dirty[type].insert(hole);
+        const std::size_t size = master.subscribers(change.packetType).size();
+        if (size > 0) {
+            dirty[type].insert(size - 1);
+        }
+        dirtySlots.insert(slotOf.at(change.subscriberId));
+        return true;
+    }
+
+    void publishLocked() {
+        const SubscriptionSnapshot* previous = current.load(std::memory_order_relaxed);
+        auto next = std::make_unique<SubscriptionSnapshot>();
+        next->snapshotVersion = previous->snapshotVersion + 1;
+
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            if (dirty[type].empty()) {
+                next->types[type] = previous->types[type]; // Untouched types are shared as a whole
+                continue;
+            }
+            auto subscribers = master.subscribers(static_cast<PacketType>(type));
+            auto list = std::make_shared<SubscriptionSnapshot::TypeList>(*previous->types[type]);
+            list->size = subscribers.size();
+            list->chunks.resize((subscribers.size() + SubscriptionSnapshot::chunkSize - 1) /
+                                SubscriptionSnapshot::chunkSize);
+
+            for (auto it = dirty[type].begin(); it != dirty[type].end();) {
+                const std::size_t chunk = *it / SubscriptionSnapshot::chunkSize;
+                auto last = dirty[type].lower_bound((chunk + 1) * SubscriptionSnapshot::chunkSize);
+                if (chunk < list->chunks.size()) {
+                    list->chunks[chunk] = patchChunk(list->chunks[chunk], subscribers, chunk, it, last);
+                }
+                it = last;
+            }
+            next->types[type] = std::move(list);
+            dirty[type].clear();
+        }
+
+        if (filtersDirty) {
+            next->filters = filterList();
+            filtersDirty = false;
+        } else {
+            next->filters = previous->filters;
+        }
+
+        if (!dirtySlots.empty()) {
+            auto bitmap = std::make_shared<SubscriptionBitmap>(*previous->bitmap);
+            bitmap->resize((slotOwners.size() + SubscriptionBitmapChunk::slotCount - 1) /
+                           SubscriptionBitmapChunk::slotCount);
+            for (auto it = dirtySlots.begin(); it != dirtySlots.end();) {
+                const std::size_t chunk = *it / SubscriptionBitmapChunk::slotCount;
+                auto last = dirtySlots.lower_bound((chunk + 1) * SubscriptionBitmapChunk::slotCount);
+                (*bitmap)[chunk] = patchBitmapChunk((*bitmap)[chunk], chunk, it, last);
+                it = last;
+            }
+            next->bitmap = std::move(bitmap);
+            dirtySlots.clear();
+        } else {
+            next->bitmap = previous->bitmap;
+        }
+
+        next->index = patchIndex(previous->index);
+        install(std::move(next));
+    }
+
+    // Builds the next snapshot from the master table alone, every chunk new; for bulk loads, where patching
+    // position by position would cost more than building
+    void rebuildLocked() {
+        const SubscriptionSnapshot* previous = current.load(std::memory_order_relaxed);
+        auto next = std::make_unique<SubscriptionSnapshot>();
+        next->snapshotVersion = previous->snapshotVersion + 1;
+
+        for (std::size_t type = 0; type < packetTypeCount; ++type) {
+            auto subscribers = master.subscribers(static_cast<PacketType>(type));
+            auto list = std::make_shared<SubscriptionSnapshot::TypeList>();
+            list->size = subscribers.size();
+            list->chunks.resize((subscribers.size() + SubscriptionSnapshot::chunkSize - 1) /
+                                SubscriptionSnapshot::chunkSize);
+            for (std::size_t chunk = 0; chunk < list->chunks.size(); ++chunk) {
+                const auto positions = std::views::iota(chunk * SubscriptionSnapshot::chunkSize,
+                                                        (chunk + 1) * SubscriptionSnapshot::chunkSize);
+                list->chunks[chunk] = patchChunk(nullptr, subscribers, chunk, positions.begin(), positions.end());
+            }
+            next->types[type] = std::move(list);
+            dirty[type].clear();
+        }
+
+        next->filters = filterList();
+        filtersDirty = false;
+
+        auto bitmap = std::make_shared<SubscriptionBitmap>((slotOwners.size() + SubscriptionBitmapChunk::slotCount - 1) /
+                                                           SubscriptionBitmapChunk::slotCount);
+        for (std::size_t chunk = 0; chunk < bitmap->size(); ++chunk) {
+            const auto slots = std::views::iota(chunk * SubscriptionBitmapChunk::slotCount,
+                                                std::min(slotOwners.size(), (chunk + 1) * SubscriptionBitmapChunk::slotCount));
+            (*bitmap)[chunk] = patchBitmapChunk(nullptr, chunk, slots.begin(), slots.end());
+        }
+        next->bitmap = std::move(bitmap);
+        dirtySlots.clear();
+
+        next->index = indexOf(std::bit_ceil(slotOf.size() / indexChunkTarget + 1));
+        dirtyIds.clear();
+
+        install(std::move(next));
+    }
+
+    std::shared_ptr<const std::vector<FilterSubscription>> filterList() const {
+        auto list = std::make_shared<std::vector<FilterSubscription>>();
+        for (const auto& [subscriberId, filter] : filters) {
+            list->push_back({subscriberId, queues.at(subscriberId).get(), filter});
+        }
+        return list;
+    }
+
+    // Every subscriber with a slot, hashed into chunkCount chunks
+    std::shared_ptr<const SubscriptionSnapshot::SubscriberIndex> indexOf(std::size_t chunkCount) const {
+        std::vector<SubscriptionSnapshot::IndexChunk> chunks(chunkCount);
+        for (const auto& [subscriberId, slot] : slotOf) {
+            chunks[SubscriptionSnapshot::indexChunkOf(subscriberId, chunkCount)].emplace_back(subscriberId, slot);
+        }
+        auto index = std::make_shared<SubscriptionSnapshot::SubscriberIndex>();
+        for (auto& chunk : chunks) {
+            std::sort(chunk.begin(), chunk.end());
+            index->chunks.push_back(std::make_shared<const SubscriptionSnapshot::IndexChunk>(std::move(chunk)));
+        }
+        return index;
+    }
+
+    // Copies only the chunks of ids added or removed since the last publish; doubles the chunk count, in a
+    // full rebuild, once the chunks average more than indexChunkTarget ids
+    std::shared_ptr<const SubscriptionSnapshot::SubscriberIndex> patchIndex(
+        const std::shared_ptr<const SubscriptionSnapshot::SubscriberIndex>& previous) {
+        if (dirtyIds.empty()) {
+            return previous;
+        }
+        if (slotOf.size() > previous->chunks.size() * indexChunkTarget) {
+            dirtyIds.clear();
+            return indexOf(previous->chunks.size() * 2);
+        }
+        auto index = std::make_shared<SubscriptionSnapshot::SubscriberIndex>(*previous);
+        std::sort(dirtyIds.begin(), dirtyIds.end(), [&](SubscriberId left, SubscriberId right) {
+            return SubscriptionSnapshot::indexChunkOf(left, index->chunks.size()) <
+                   SubscriptionSnapshot::indexChunkOf(right, index->chunks.size());
+        });
+        // One copy per touched chunk, then each dirty id is inserted, updated or erased in place
+        std::size_t chunk = index->chunks.size();
+        std::shared_ptr<SubscriptionSnapshot::IndexChunk> patched;
+        for (SubscriberId subscriberId : dirtyIds) {
+            if (SubscriptionSnapshot::indexChunkOf(subscriberId, index->chunks.size()) != chunk) {
+                chunk = SubscriptionSnapshot::indexChunkOf(subscriberId, index->chunks.size());
+                patched = std::make_shared<SubscriptionSnapshot::IndexChunk>(*index->chunks[chunk]);
+                index->chunks[chunk] = patched;
+            }
+            auto entry = std::lower_bound(patched->begin(), patched->end(), subscriberId,
+                                          [](const auto& stored, SubscriberId id) { return stored.first < id; });
+            const bool stored = entry != patched->end() && entry->first == subscriberId;
+            auto slot = slotOf.find(subscriberId);
+            if (slot == slotOf.end()) {
+                if (stored) {
+                    patched->erase(entry);
+                }
+            } else if (stored) {
+                entry->second = slot->second;
+            } else {
+                patched->emplace(entry, subscriberId, slot->second);
+            }
+        }
+        dirtyIds.clear();
+        return index;
+    }
+
+    void install(std::unique_ptr<SubscriptionSnapshot> next) {
+        const SubscriptionSnapshot* previous = current.load(std::memory_order_relaxed);
+        // Publish the pointer before the version: a reader that sees the new version sees the new snapshot
+        current.store(next.release());
+        publishedVersion.store(previous->snapshotVersion + 1);
+
+        retired.push_back({previous->snapshotVersion, std::unique_ptr<const SubscriptionSnapshot>(previous),
+                           std::move(retiredQueues)});
+        retiredQueues.clear();
+        reclaimLocked();
+    }
+
+    // Copies the published chunk and rewrites only the dirty positions: a single change costs one chunk
+    // copy, not a queue lookup per subscriber of the chunk. Positions iterate over std::size_t, ascending.
+    template<typename PositionIterator>
+    std::shared_ptr<const SubscriptionSnapshot::Chunk> patchChunk(
+        const std::shared_ptr<const SubscriptionSnapshot::Chunk>& previous, std::span<const SubscriberId> subscribers,
+        std::size_t chunk, PositionIterator first, PositionIterator last) {
+        const std::size_t begin = chunk * SubscriptionSnapshot::chunkSize;
+        const std::size_t end = std::min(subscribers.size(), begin + SubscriptionSnapshot::chunkSize);
+        auto patched = previous ? std::make_shared<SubscriptionSnapshot::Chunk>(*previous)
+                                : std::make_shared<SubscriptionSnapshot::Chunk>();
+        patched->resize(end - begin);
+        for (; first != last; ++first) {
+            const std::size_t position = *first;
+            if (position < end) {
+                patched->at(position - begin) = {subscribers[position], queues.at(subscribers[position]).get()};
+            }
+        }
+        return patched;
+    }
+
+    // Same for the bitmap: clear the old bits of each dirty slot, then set the current ones.
+    // Returns nullptr once no slot of the chunk is in use, so readers skip it
+    template<typename PositionIterator>
+    std::shared_ptr<const SubscriptionBitmapChunk> patchBitmapChunk(
+        const std::shared_ptr<const SubscriptionBitmapChunk>& previous, std::size_t chunk, PositionIterator first,
+        PositionIterator last) {
+        auto patched = previous ? std::make_shared<SubscriptionBitmapChunk>(*previous)
+                                : std::make_shared<SubscriptionBitmapChunk>();
+        const std::size_t begin = chunk * SubscriptionBitmapChunk::slotCount;
+        for (; first != last; ++first) {
+            const std::size_t offset = *first - begin;
+            const std::uint64_t bit = std::uint64_t{1} << (offset % 64);
+            SubscriberSlot& slot = patched->slots[offset];
+            for (std::uint64_t types = slot.typeMask; types != 0; types &= types - 1) {
+                patched->rows[static_cast<std::size_t>(std::countr_zero(types))][offset / 64] &= ~bit;
+            }
+            slot = {};
+
+            const auto& owner = slotOwners[*first];
+            if (!owner) {
+                continue;
+            }
+            slot = {*owner, master.subscriptionMask(*owner), queues.at(*owner).get()};
+            for (std::uint64_t types = slot.typeMask; types != 0; types &= types - 1) {
+                patched->rows[static_cast<std::size_t>(std::countr_zero(types))][offset / 64] |= bit;
+            }
+        }
+
+        for (const SubscriberSlot& slot : patched->slots) {
+            if (slot.queue != nullptr) {
+                return patched;
+            }
+        }
+        return nullptr;
+    }
+
+    void reclaimLocked() {
+        std::uint64_t oldestInUse = quiescent;
+        for (const auto& reader : readers) {
+            oldestInUse = std::min(oldestInUse, reader.version.load());
+        }
+        // A reader announcing version v may hold snapshot v or newer, never older
+        std::erase_if(retired, [oldestInUse](const Retired& entry) { return entry.version < oldestInUse; });
+    }
+
+    mutable std::vector<ReaderSlot> readers; // One per worker, then sharedReaderCount shared ones
+    const std::size_t workerReaders;
+    std::atomic<std::uint64_t> publishedVersion{0};
+    std::atomic<const SubscriptionSnapshot*> current{nullptr};
+
+    mutable std::mutex controlMutex;
+    FlatSubscriberTable master;
+    std::unordered_map<SubscriberId, std::unique_ptr<DeliveryQueue>> queues;
+    std::array<std::set<std::size_t>, packetTypeCount> dirty; // Positions changed since the last publish
+    std::unordered_map<SubscriberId, std::shared_ptr<const PacketFilter>> filters;
+    std::unordered_map<SubscriberId, std::uint32_t> slotOf;
+    std::vector<std::optional<SubscriberId>> slotOwners;
+    std::vector<std::uint32_t> freeSlots;
+    std::set<std::size_t> dirtySlots; // Bitmap slots changed since the last publish
+    std::vector<SubscriberId> dirtyIds; // Subscribers given or stripped of a slot since the last publish
+    bool filtersDirty = false;
+    std::vector<Retired> retired;
+    std::vector<std::unique_ptr<DeliveryQueue>> retiredQueues; // Removed since the last publish
+};
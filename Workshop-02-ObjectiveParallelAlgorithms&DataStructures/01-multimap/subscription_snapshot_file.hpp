@@ -0,0 +1,273 @@
+#pragma once
+
+/*
+    Binary snapshot file of the subscription state, for a fast cold start.
+
+    Replaying every subscribe() after a restart publishes one RCU version per call. Instead, the state is
+    exported once (SubscriptionRegistry::exportState) into a compact file and restored in one bulk pass.
+
+    Layout, in host byte order (the header records which one):
+    - SnapshotHeader: magic, format version, byte-order tag, counts, registry version, checksum of the rest
+    - subscriberCount fixed-size SnapshotRecords, ordered by increasing subscriber id
+    - the filter expressions, back to back, in record order
+
+    The writer encodes into memory first, so the registry is locked only while it is read, not during the
+    disk write. The file is written next to its final name, flushed to disk, renamed over it, and the
+    directory is flushed too (common/replace_file.hpp): a reader sees the old snapshot or the new one,
+    never half of one, even across a crash.
+
+    The reader maps the file and validates the header, the sizes and the checksum before anything is
+    restored. The records are read in place; the filter expressions are views into the mapping, so they are
+    valid as long as the reader lives. Without POSIX, the file is read into memory instead.
+*/
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../common/replace_file.hpp"
+#include "delivery_queue.hpp"
+#include "packet.hpp"
+#include "subscription_registry.hpp"
+
+struct SnapshotHeader {
+    static constexpr char expectedMagic[8] = {'P', 'K', 'T', 'S', 'U', 'B', 'S', '\0'};
+    static constexpr std::uint32_t currentFormat = 1;
+    static constexpr std::uint32_t byteOrderTag = 0x01020304;
+
+    char magic[8];
+    std::uint32_t format;
+    std::uint32_t byteOrder;
+    std::uint64_t subscriberCount;
+    std::uint64_t filterBytes;
+    std::uint64_t registryVersion;
+    std::uint64_t checksum; // snapshotChecksum of everything after the header
+};
+
+struct SnapshotRecord {
+    // Largest queue sizes a file may ask for: the checksum does not stop a crafted file, and the queues are
+    // allocated during restore
+    static constexpr std::uint64_t maxCapacity = std::uint64_t{1} << 24;
+    static constexpr std::uint64_t maxReorderWindow = std::uint64_t{1} << 24;
+
+    std::int64_t subscriberId;
+    std::uint64_t typeMask;
+    std::uint64_t capacity;
+    std::uint64_t reorderWindow;
+    std::uint32_t filterLength;
+    std::uint8_t policy; // OverflowPolicy
+    std::uint8_t reserved[3];
+};
+
+static_assert(sizeof(SnapshotHeader) == 48 && sizeof(SnapshotRecord) == 40, "The file layout has no padding to hide");
+
+// Word-at-a-time multiplicative hash: catches truncation and bit rot at memory speed, not an adversary
+inline std::uint64_t snapshotChecksum(std::span<const std::byte> bytes) {
+    std::uint64_t hash = 0x9e3779b97f4a7c15ull ^ bytes.size();
+    std::size_t offset = 0;
+    for (; offset + 8 <= bytes.size(); offset += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes.data() + offset, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    for (; offset < bytes.size(); ++offset) {
+        hash = (hash ^ static_cast<std::uint64_t>(bytes[offset])) * 0xc4ceb9fe1a85ec53ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+class SubscriptionSnapshotWriter {
+public:
+    // Feed it from SubscriptionRegistry::exportState. Throws std::length_error for a queue larger than the
+    // reader accepts, rather than write a snapshot that cannot be restored.
+    void add(const SubscriberState& subscriber) {
+        if (subscriber.delivery.capacity > SnapshotRecord::maxCapacity ||
+            subscriber.delivery.reorderWindow > SnapshotRecord::maxReorderWindow) {
+            throw std::length_error("subscription snapshot: delivery queue of subscriber " +
+                                    std::to_string(subscriber.subscriberId) + " is too large");
+        }
+        SnapshotRecord record{};
+        record.subscriberId = subscriber.subscriberId;
+        record.typeMask = subscriber.typeMask;
+        record.capacity = subscriber.delivery.capacity;
+        record.reorderWindow = subscriber.delivery.reorderWindow;
+        record.filterLength = static_cast<std::uint32_t>(subscriber.filter.size());
+        record.policy = static_cast<std::uint8_t>(subscriber.delivery.policy);
+        records.push_back(record);
+        filterText.append(subscriber.filter);
+    }
+
+    // Atomically and durably replaces path with the snapshot; throws std::system_error if the file cannot be
+    // written
+    void commit(const std::string& path, std::uint64_t registryVersion) const {
+        const std::size_t recordBytes = records.size() * sizeof(SnapshotRecord);
+        std::vector<std::byte> file(sizeof(SnapshotHeader) + recordBytes + filterText.size());
+        std::memcpy(file.data() + sizeof(SnapshotHeader), records.data(), recordBytes);
+        std::memcpy(file.data() + sizeof(SnapshotHeader) + recordBytes, filterText.data(), filterText.size());
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SnapshotHeader::expectedMagic, sizeof(header.magic));
+        header.format = SnapshotHeader::currentFormat;
+        header.byteOrder = SnapshotHeader::byteOrderTag;
+        header.subscriberCount = records.size();
+        header.filterBytes = filterText.size();
+        header.registryVersion = registryVersion;
+        header.checksum = snapshotChecksum(std::span<const std::byte>(file).subspan(sizeof(SnapshotHeader)));
+        std::memcpy(file.data(), &header, sizeof(header));
+
+        replaceFile(path, file);
+    }
+
+private:
+    std::vector<SnapshotRecord> records;
+    std::string filterText;
+};
+
+class SubscriptionSnapshotReader {
+public:
+    // Maps and validates the file; throws std::system_error if it cannot be read, std::runtime_error if it
+    // is not a valid snapshot of this format
+    explicit SubscriptionSnapshotReader(const std::string& path) {
+        load(path);
+        if (bytes.size() < sizeof(SnapshotHeader)) {
+            throw std::runtime_error(path + ": too short for a subscription snapshot");
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, SnapshotHeader::expectedMagic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error(path + ": not a subscription snapshot");
+        }
+        if (header.byteOrder != SnapshotHeader::byteOrderTag) {
+            throw std::runtime_error(path + ": written on a machine of the other byte order");
+        }
+        if (header.format != SnapshotHeader::currentFormat) {
+            throw std::runtime_error(path + ": snapshot format " + std::to_string(header.format) +
+                                     ", this build reads format " + std::to_string(SnapshotHeader::currentFormat));
+        }
+        const std::uint64_t body = bytes.size() - sizeof(SnapshotHeader);
+        if (header.subscriberCount > body / sizeof(SnapshotRecord) ||
+            header.subscriberCount * sizeof(SnapshotRecord) + header.filterBytes != body) {
+            throw std::runtime_error(path + ": truncated or oversized snapshot");
+        }
+        if (snapshotChecksum(bytes.subspan(sizeof(SnapshotHeader))) != header.checksum) {
+            throw std::runtime_error(path + ": checksum mismatch");
+        }
+    }
+
+    SubscriptionSnapshotReader(const SubscriptionSnapshotReader&) = delete;
+    SubscriptionSnapshotReader& operator=(const SubscriptionSnapshotReader&) = delete;
+
+    std::uint64_t registryVersion() const {
+        return header.registryVersion;
+    }
+
+    std::size_t subscriberCount() const {
+        return static_cast<std::size_t>(header.subscriberCount);
+    }
+
+    // Decodes the records for SubscriptionRegistry::restore; the filter views point into the file.
+    // Throws std::runtime_error if a record is out of range.
+    std::vector<SubscriberState> subscribers() const {
+        std::vector<SubscriberState> states(subscriberCount());
+        const std::byte* record = bytes.data() + sizeof(SnapshotHeader);
+        const char* filters = reinterpret_cast<const char*>(record + states.size() * sizeof(SnapshotRecord));
+        std::uint64_t filterOffset = 0;
+        for (SubscriberState& state : states) {
+            SnapshotRecord stored;
+            std::memcpy(&stored, record, sizeof(stored)); // The mapping only guarantees byte alignment in general
+            record += sizeof(stored);
+            if (stored.policy > static_cast<std::uint8_t>(OverflowPolicy::Block) ||
+                stored.capacity > SnapshotRecord::maxCapacity ||
+                stored.reorderWindow > SnapshotRecord::maxReorderWindow ||
+                stored.filterLength > header.filterBytes - filterOffset) {
+                throw std::runtime_error("subscription snapshot: record out of range");
+            }
+            state.subscriberId = static_cast<SubscriberId>(stored.subscriberId);
+            state.typeMask = stored.typeMask;
+            state.delivery = {static_cast<std::size_t>(stored.capacity), static_cast<OverflowPolicy>(stored.policy),
+                              static_cast<std::size_t>(stored.reorderWindow)};
+            state.filter = std::string_view(filters + filterOffset, stored.filterLength);
+            filterOffset += stored.filterLength;
+        }
+        return states;
+    }
+
+private:
+#if defined(__unix__) || defined(__APPLE__)
+    void load(const std::string& path) {
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+        }
+        struct stat status;
+        if (::fstat(descriptor, &status) != 0) {
+            const int error = errno;
+            ::close(descriptor);
+            throw std::system_error(error, std::generic_category(), "cannot stat " + path);
+        }
+        const auto size = static_cast<std::size_t>(status.st_size);
+        if (size == 0) {
+            ::close(descriptor);
+            return; // mmap rejects empty mappings; the size check reports the file
+        }
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor); // The mapping keeps the file open
+        if (mapped == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "cannot map " + path);
+        }
+        mapping.address = mapped;
+        mapping.size = size;
+        bytes = std::span<const std::byte>(static_cast<const std::byte*>(mapped), size);
+    }
+
+    // Unmapped also when the constructor throws after mapping
+    struct Mapping {
+        Mapping() = default;
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        ~Mapping() {
+            if (address != nullptr) {
+                ::munmap(address, size);
+            }
+        }
+
+        void* address = nullptr;
+        std::size_t size = 0;
+    };
+
+    Mapping mapping;
+#else
+    void load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), "cannot open " + path);
+        }
+        contents.resize(static_cast<std::size_t>(in.tellg()));
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(contents.data()), static_cast<std::streamsize>(contents.size()));
+        bytes = contents;
+    }
+
+    std::vector<std::byte> contents;
+#endif
+
+    std::span<const std::byte> bytes;
+    SnapshotHeader header{};
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+    Deterministic synthetic traffic for benchmarks.
+
+    A TrafficProfile describes the mix: how often each PacketType occurs, how payload sizes are spread and
+    how many flows there are and how skewed they are. Real traffic is rarely uniform, so both the type mix
+    and the flow popularity can follow a Zipf law, where the k-th most common value has weight 1/k^s:
+    a few protocols and a few heavy flows dominate, which is what stresses one shard or one subscriber list.
+
+    The same profile and seed always produce the same packets (for a given standard library), so two
+    implementations, or two versions of one, are measured on identical traffic.
+*/
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "packet.hpp"
+
+struct PayloadSize {
+    std::size_t bytes;
+    double weight;
+};
+
+struct TrafficProfile {
+    std::string_view name;
+    std::array<double, packetTypeCount> typeWeights;
+    std::vector<PayloadSize> payloadSizes;
+    std::size_t flowCount = 4096;
+    double flowSkew = 0; // Zipf exponent over the flows, 0 for uniform
+};
+
+inline std::array<double, packetTypeCount> uniformTypeMix() {
+    std::array<double, packetTypeCount> weights;
+    weights.fill(1.0);
+    return weights;
+}
+
+// PacketType 0 is the most common, weights 1, 1/2^s, 1/3^s, ...
+inline std::array<double, packetTypeCount> zipfTypeMix(double exponent) {
+    std::array<double, packetTypeCount> weights;
+    for (std::size_t type = 0; type < packetTypeCount; ++type) {
+        weights[type] = 1.0 / std::pow(static_cast<double>(type + 1), exponent);
+    }
+    return weights;
+}
+
+// Small packets only, as in a flood of ACKs or DNS queries
+inline std::vector<PayloadSize> fixedPayload(std::size_t bytes) {
+    return {{bytes, 1.0}};
+}
+
+// The classic "simple IMIX": 7 parts 40 bytes, 4 parts 576 bytes, 1 part 1500 bytes
+inline std::vector<PayloadSize> imixPayload() {
+    return {{40, 7.0}, {576, 4.0}, {1500, 1.0}};
+}
+
+class TrafficGenerator {
+public:
+    TrafficGenerator(const TrafficProfile& profile, std::uint64_t seed)
+        : random(seed), types(profile.typeWeights.begin(), profile.typeWeights.end()),
+          flows(flowWeights(profile.flowCount, profile.flowSkew)) {
+        std::vector<double> weights;
+        for (const PayloadSize& size : profile.payloadSizes) {
+            sizes.push_back(size.bytes);
+            weights.push_back(size.weight);
+        }
+        payloads = std::discrete_distribution<std::size_t>(weights.begin(), weights.end());
+    }
+
+    Packet next() {
+        const auto flow = static_cast<std::uint32_t>(flows(random));
+        return {static_cast<PacketType>(types(random)), std::string(sizes[payloads(random)], 'x'),
+                {0x0a000000 | flow, 0xc0a80001, static_cast<std::uint16_t>(1024 + flow % 60000), 443}};
+    }
+
+    std::vector<Packet> batch(std::size_t count) {
+        std::vector<Packet> packets;
+        packets.reserve(count);
+        for (std::size_t index = 0; index < count; ++index) {
+            packets.push_back(next());
+        }
+        return packets;
+    }
+
+private:
+    static std::discrete_distribution<std::size_t> flowWeights(std::size_t flowCount, double skew) {
+        std::vector<double> weights(flowCount == 0 ? 1 : flowCount);
+        for (std::size_t flow = 0; flow < weights.size(); ++flow) {
+            weights[flow] = skew == 0 ? 1.0 : 1.0 / std::pow(static_cast<double>(flow + 1), skew);
+        }
+        return std::discrete_distribution<std::size_t>(weights.begin(), weights.end());
+    }
+
+    std::mt19937_64 random;
+    std::discrete_distribution<std::size_t> types;
+    std::discrete_distribution<std::size_t> flows;
+    std::discrete_distribution<std::size_t> payloads;
+    std::vector<std::size_t> sizes;
+};
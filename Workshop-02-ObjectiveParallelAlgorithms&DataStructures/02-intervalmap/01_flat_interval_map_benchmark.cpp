@@ -0,0 +1,119 @@
+/*
+    FlatIntervalMap vs the std::map IntervalMap on a read-heavy policy table.
+
+    Build: g++ -std=c++20 -O2 01_flat_interval_map_benchmark.cpp
+
+    The table maps IPv4 address ranges to a policy id, with gaps between some ranges, like an address plan.
+    For 10k, 100k and 1M ranges:
+    - build:  IntervalMap by one set() per range, FlatIntervalMap by fromSorted, ns per range
+    - memory: heap bytes per range, from a counting global operator new
+    - lookup: find() for random addresses, ns per lookup. At 1M ranges neither fits in cache and the
+              difference is the number of cache lines touched per lookup.
+    Both maps are checked to hold the same boundaries.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+
+std::atomic<std::size_t> allocatedBytes{0};
+
+void* operator new(std::size_t size) {
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+
+double nanosecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Sorted, non-overlapping ranges; about one in four is followed by a gap
+std::vector<IntervalEntry<Address, Policy>> policyTable(std::size_t rangeCount, std::mt19937& random) {
+    std::vector<IntervalEntry<Address, Policy>> ranges;
+    ranges.reserve(rangeCount);
+    const Address stride = static_cast<Address>(0xffff'ffffu / (rangeCount + 1));
+    Address start = 0;
+    for (std::size_t index = 0; index < rangeCount; ++index) {
+        const Address length = stride / 2 + static_cast<Address>(random() % (stride / 2));
+        const Address end = random() % 4 == 0 ? start + length : start + stride;
+        ranges.push_back({start, end, static_cast<Policy>(random() % 64)});
+        start += stride;
+    }
+    return ranges;
+}
+
+template<typename Map>
+double lookupNanoseconds(const Map& map, const std::vector<Address>& keys, std::uint64_t& checksum) {
+    const auto start = Clock::now();
+    for (Address key : keys) {
+        const std::optional<Policy> policy = map.find(key);
+        checksum += policy ? *policy : 0xffff;
+    }
+    return nanosecondsSince(start) / static_cast<double>(keys.size());
+}
+
+int main() {
+    std::mt19937 random(42);
+    std::vector<Address> keys(2'000'000);
+    for (Address& key : keys) {
+        key = static_cast<Address>(random());
+    }
+
+    std::printf("%10s | %12s %12s | %12s %12s | %12s %12s\n", "ranges", "map build", "flat build", "map B/range",
+                "flat B/range", "map lookup", "flat lookup");
+    for (std::size_t rangeCount : {10'000u, 100'000u, 1'000'000u}) {
+        const auto ranges = policyTable(rangeCount, random);
+
+        IntervalMap<Address, Policy> map;
+        std::size_t bytesBefore = allocatedBytes.load();
+        auto start = Clock::now();
+        for (const auto& range : ranges) {
+            map.set(range.start, range.end, range.value);
+        }
+        const double mapBuild = nanosecondsSince(start) / static_cast<double>(rangeCount);
+        const std::size_t mapBytes = allocatedBytes.load() - bytesBefore;
+
+        start = Clock::now();
+        auto flat = FlatIntervalMap<Address, Policy>::fromSorted(ranges);
+        const double flatBuild = nanosecondsSince(start) / static_cast<double>(rangeCount);
+        flat.shrinkToFit();
+
+        if (map.boundaries() != flat.boundaries()) {
+            std::printf("MISMATCH at %zu ranges\n", rangeCount);
+            return 1;
+        }
+
+        std::uint64_t mapChecksum = 0;
+        std::uint64_t flatChecksum = 0;
+        const double mapLookup = lookupNanoseconds(map, keys, mapChecksum);
+        const double flatLookup = lookupNanoseconds(flat, keys, flatChecksum);
+        if (mapChecksum != flatChecksum) {
+            std::printf("LOOKUP MISMATCH at %zu ranges\n", rangeCount);
+            return 1;
+        }
+
+        std::printf("%10zu | %9.1f ns %9.1f ns | %12.1f %12.1f | %9.1f ns %9.1f ns\n", rangeCount, mapBuild,
+                    flatBuild, static_cast<double>(mapBytes) / static_cast<double>(rangeCount),
+                    static_cast<double>(flat.memoryBytes()) / static_cast<double>(rangeCount), mapLookup, flatLookup);
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+    Reloading a policy table: one set() per range vs setMany.
+
+    Build: g++ -std=c++20 -O2 02_set_many_benchmark.cpp
+
+    A table of 1M address ranges is loaded, then reloaded with a new version of itself: every range again,
+    with about one policy in eight changed, the way a control plane pushes a full table. Each reload is
+    applied to IntervalMap and FlatIntervalMap once by a set() per range and once by setMany. A second batch
+    applies a batch of overlapping overrides in random order, where setMany has to sort and resolve the
+    overlaps first. All variants are checked to end with the same boundaries.
+
+    setMany on IntervalMap rebuilds every node of the map for the full reload, and applies the overrides in
+    place, one set() per resolved segment, since they are few for the table's size; on FlatIntervalMap it
+    replaces per-range shifts of the whole array and always wins.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+using Ranges = std::vector<IntervalEntry<Address, Policy>>;
+
+constexpr std::size_t rangeCount = 1'000'000;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Sorted, non-overlapping ranges; about one in four is followed by a gap
+Ranges policyTable(std::mt19937& random) {
+    Ranges ranges;
+    ranges.reserve(rangeCount);
+    const Address stride = static_cast<Address>(0xffff'ffffu / (rangeCount + 1));
+    Address start = 0;
+    for (std::size_t index = 0; index < rangeCount; ++index) {
+        const Address length = stride / 2 + static_cast<Address>(random() % (stride / 2));
+        const Address end = random() % 4 == 0 ? start + length : start + stride;
+        ranges.push_back({start, end, static_cast<Policy>(random() % 64)});
+        start += stride;
+    }
+    return ranges;
+}
+
+// Per-range set() on one map, setMany on a copy of it; returns false if they end up different
+template<typename Map>
+bool reload(const char* name, const Map& loaded, const Ranges& batch) {
+    Map oneByOne = loaded;
+    auto start = Clock::now();
+    for (const auto& range : batch) {
+        oneByOne.set(range.start, range.end, range.value);
+    }
+    const double setTime = millisecondsSince(start);
+
+    Map batched = loaded;
+    start = Clock::now();
+    batched.setMany(batch);
+    const double setManyTime = millisecondsSince(start);
+
+    const bool same = oneByOne.boundaries() == batched.boundaries();
+    std::printf("  %-16s set() x %zu: %9.1f ms   setMany: %7.1f ms   %s\n", name, batch.size(), setTime,
+                setManyTime, same ? "same" : "DIFFERENT");
+    return same;
+}
+
+int main() {
+    std::mt19937 random(42);
+    const Ranges table = policyTable(random);
+
+    IntervalMap<Address, Policy> map;
+    map.setMany(table);
+    auto flat = FlatIntervalMap<Address, Policy>::fromSorted(table);
+    if (map.boundaries() != flat.boundaries()) {
+        std::printf("initial load differs\n");
+        return 1;
+    }
+
+    Ranges update = table;
+    for (auto& range : update) {
+        if (random() % 8 == 0) {
+            range.value = static_cast<Policy>(random() % 64);
+        }
+    }
+
+    // Overrides of random length at random places, later ones winning where they overlap
+    Ranges overrides;
+    for (std::size_t index = 0; index < rangeCount / 50; ++index) {
+        const Address start = static_cast<Address>(random());
+        const Address length = static_cast<Address>(random() % (1u << 16));
+        overrides.push_back({start, start + length, static_cast<Policy>(random() % 64)});
+    }
+
+    bool same = true;
+    std::printf("full reload, sorted:\n");
+    same &= reload("IntervalMap", map, update);
+    same &= reload("FlatIntervalMap", flat, update);
+    std::printf("overlapping overrides, unsorted:\n");
+    same &= reload("IntervalMap", map, overrides);
+    same &= reload("FlatIntervalMap", flat, overrides);
+    return same ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+    One lookup at a time vs batch lookups on an Eytzinger layout.
+
+    Build: g++ -std=c++20 -O2 03_batch_lookup_benchmark.cpp
+
+    The policy table of 01_flat_interval_map_benchmark.cpp, with 10k, 100k, 1M and 4M ranges, is looked up
+    for random addresses, the way a classifier looks up a batch of packets:
+    - map:        IntervalMap::find per key, a tree walk
+    - flat:       FlatIntervalMap::find per key, a branchless binary search
+    - eytzinger:  EytzingerIntervalMap::find per key
+    - batch:      findBatch with the scalar lock-step descent and prefetches
+    - batch avx2: findBatch with gathers, when the CPU has AVX2
+    in ns per lookup. Every variant is checked to give the same answers.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "eytzinger_interval_map.hpp"
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+
+// Sorted, non-overlapping ranges; about one in four is followed by a gap
+std::vector<IntervalEntry<Address, Policy>> policyTable(std::size_t rangeCount, std::mt19937& random) {
+    std::vector<IntervalEntry<Address, Policy>> ranges;
+    ranges.reserve(rangeCount);
+    const Address stride = static_cast<Address>(0xffff'ffffu / (rangeCount + 1));
+    Address start = 0;
+    for (std::size_t index = 0; index < rangeCount; ++index) {
+        const Address length = stride / 2 + static_cast<Address>(random() % (stride / 2));
+        const Address end = random() % 4 == 0 ? start + length : start + stride;
+        ranges.push_back({start, end, static_cast<Policy>(random() % 64)});
+        start += stride;
+    }
+    return ranges;
+}
+
+// ns per key of lookup(keys, results), results then compared against expected
+template<typename Lookup>
+double nanosecondsPerKey(const std::vector<Address>& keys, std::vector<std::optional<Policy>>& results, Lookup lookup) {
+    const auto start = Clock::now();
+    lookup(keys, results);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(keys.size());
+}
+
+template<typename Map>
+auto oneAtATime(const Map& map) {
+    return [&map](const std::vector<Address>& keys, std::vector<std::optional<Policy>>& results) {
+        for (std::size_t index = 0; index < keys.size(); ++index) {
+            results[index] = map.find(keys[index]);
+        }
+    };
+}
+
+int main() {
+    std::mt19937 random(42);
+    std::vector<Address> keys(4'000'000);
+    for (Address& key : keys) {
+        key = static_cast<Address>(random());
+    }
+    const bool avx2 = EytzingerIntervalMap<Address, Policy>::vectorized();
+
+    std::printf("%9s | %9s %9s %9s %9s %10s\n", "ranges", "map", "flat", "eytzinger", "batch", "batch avx2");
+    for (std::size_t rangeCount : {10'000u, 100'000u, 1'000'000u, 4'000'000u}) {
+        const auto ranges = policyTable(rangeCount, random);
+        IntervalMap<Address, Policy> map;
+        map.setMany(ranges);
+        const auto flat = FlatIntervalMap<Address, Policy>::fromSorted(ranges);
+        const EytzingerIntervalMap<Address, Policy> eytzinger(flat.boundaries());
+
+        std::vector<std::optional<Policy>> expected(keys.size());
+        std::vector<std::optional<Policy>> results(keys.size());
+        bool same = true;
+        const auto measure = [&](auto lookup) {
+            const double nanoseconds = nanosecondsPerKey(keys, results, lookup);
+            same = same && results == expected;
+            return nanoseconds;
+        };
+
+        const double mapTime = nanosecondsPerKey(keys, expected, oneAtATime(map));
+        const double flatTime = measure(oneAtATime(flat));
+        const double eytzingerTime = measure(oneAtATime(eytzinger));
+        const double batchTime = measure([&](const std::vector<Address>& batch, std::vector<std::optional<Policy>>& out) {
+            eytzinger.findBatch(batch, out, BatchLookupPath::Scalar);
+        });
+        double vectorTime = 0;
+        if (avx2) {
+            vectorTime = measure([&](const std::vector<Address>& batch, std::vector<std::optional<Policy>>& out) {
+                eytzinger.findBatch(batch, out);
+            });
+        }
+
+        std::printf("%9zu | %6.1f ns %6.1f ns %6.1f ns %6.1f ns ", rangeCount, mapTime, flatTime, eytzingerTime,
+                    batchTime);
+        if (avx2) {
+            std::printf("%7.1f ns", vectorTime);
+        } else {
+            std::printf("%10s", "n/a");
+        }
+        std::printf("%s\n", same ? "" : "  MISMATCH");
+        if (!same) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*
+    Versioned policy table: stable snapshots for readers while updates keep coming.
+
+    Build: g++ -std=c++20 -O2 -pthread 04_persistent_versions.cpp
+
+    A table of 1M address ranges takes 100k updates, applied to IntervalMap, which has one version only,
+    and to PersistentIntervalMap keeping the last 1000 versions. The demo shows:
+    - set() cost of both, ns per update
+    - heap bytes allocated per update: the copied paths, and the most a retained version can cost, against
+      the size of a full copy of the table
+    - snapshot() cost
+    - a reader thread that pins a snapshot and checks that it keeps answering the same while the writer
+      applies another 100k updates, without locking
+    - at(version) answering for an old version, checked against a copy taken at the time
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "interval_map.hpp"
+#include "persistent_interval_map.hpp"
+
+// Heap bytes allocated in total and still live, from malloc's own size of each block
+std::atomic<std::size_t> allocatedBytes{0};
+std::atomic<std::size_t> liveBytes{0};
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    allocatedBytes.fetch_add(malloc_usable_size(pointer), std::memory_order_relaxed);
+    liveBytes.fetch_add(malloc_usable_size(pointer), std::memory_order_relaxed);
+    return pointer;
+}
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    liveBytes.fetch_sub(malloc_usable_size(pointer), std::memory_order_relaxed);
+    std::free(pointer);
+}
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+
+constexpr std::size_t rangeCount = 1'000'000;
+constexpr std::size_t updateCount = 100'000;
+constexpr std::size_t historyDepth = 1000;
+
+double nanosecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Updates of half a range each, at random places
+std::vector<IntervalEntry<Address, Policy>> randomUpdates(std::mt19937& random, Address stride) {
+    std::vector<IntervalEntry<Address, Policy>> updates;
+    for (std::size_t index = 0; index < updateCount; ++index) {
+        const Address start = static_cast<Address>(random() % rangeCount) * stride;
+        updates.push_back({start, start + stride / 2, static_cast<Policy>(random() % 64)});
+    }
+    return updates;
+}
+
+int main() {
+    std::mt19937 random(42);
+    const Address stride = static_cast<Address>(0xffff'ffffu / (rangeCount + 1));
+
+    IntervalMap<Address, Policy> map;
+    PersistentIntervalMap<Address, Policy> versions(historyDepth);
+    std::vector<IntervalEntry<Address, Policy>> table;
+    for (std::size_t index = 0; index < rangeCount; ++index) {
+        const Address start = static_cast<Address>(index) * stride;
+        table.push_back({start, start + stride, static_cast<Policy>(random() % 64)});
+    }
+    map.setMany(table);
+    std::size_t bytesBefore = liveBytes.load();
+    for (const auto& range : table) {
+        versions.set(range.start, range.end, range.value);
+    }
+    const std::size_t tableBytes = liveBytes.load() - bytesBefore;
+    std::printf("loaded %zu ranges: %zu boundaries, version %llu, %.1f MB\n", rangeCount, versions.size(),
+                static_cast<unsigned long long>(versions.version()), static_cast<double>(tableBytes) / 1e6);
+
+    auto updates = randomUpdates(random, stride);
+    auto start = Clock::now();
+    for (const auto& update : updates) {
+        map.set(update.start, update.end, update.value);
+    }
+    const double mapSet = nanosecondsSince(start) / static_cast<double>(updateCount);
+
+    bytesBefore = allocatedBytes.load();
+    start = Clock::now();
+    for (const auto& update : updates) {
+        versions.set(update.start, update.end, update.value);
+    }
+    const double persistentSet = nanosecondsSince(start) / static_cast<double>(updateCount);
+    const double bytesPerUpdate = static_cast<double>(allocatedBytes.load() - bytesBefore) / updateCount;
+
+    start = Clock::now();
+    std::size_t nonEmpty = 0;
+    for (int repeat = 0; repeat < 1'000'000; ++repeat) {
+        nonEmpty += versions.snapshot().empty() ? 0 : 1;
+    }
+    const double snapshotTime = nanosecondsSince(start) / 1e6;
+
+    std::printf("set():      IntervalMap %.0f ns, PersistentIntervalMap %.0f ns per update\n", mapSet, persistentSet);
+    std::printf("versions:   %.0f bytes allocated per update, a full copy is %.0f\n", bytesPerUpdate,
+                static_cast<double>(tableBytes));
+    std::printf("snapshot(): %.1f ns (%zu taken)\n", snapshotTime, nonEmpty);
+
+    // A reader pins the current version and keeps checking it while the next updates go in
+    const auto pinned = versions.snapshot();
+    const auto pinnedBoundaries = pinned.boundaries();
+    std::atomic<bool> updating{true};
+    std::atomic<std::size_t> readerLookups{0};
+    std::atomic<std::size_t> readerErrors{0};
+    std::thread reader([&] {
+        std::mt19937 readerRandom(7);
+        while (updating.load()) {
+            const std::size_t index = readerRandom() % pinnedBoundaries.size();
+            if (pinned.find(pinnedBoundaries[index].first) != pinnedBoundaries[index].second) {
+                readerErrors.fetch_add(1);
+            }
+            readerLookups.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+
+    updates = randomUpdates(random, stride);
+    const std::uint64_t checkedVersion = versions.version() + updateCount - historyDepth / 2;
+    std::vector<IntervalMap<Address, Policy>::Boundary> checkedBoundaries;
+    for (const auto& update : updates) {
+        map.set(update.start, update.end, update.value);
+        versions.set(update.start, update.end, update.value);
+        if (versions.version() == checkedVersion) {
+            checkedBoundaries = versions.boundaries();
+        }
+    }
+    updating = false;
+    reader.join();
+    std::printf("reader:     %zu lookups on pinned version %llu during the updates, %zu wrong\n",
+                readerLookups.load(), static_cast<unsigned long long>(pinned.version()), readerErrors.load());
+
+    const auto old = versions.at(checkedVersion);
+    const bool oldSame = old && old->boundaries() == checkedBoundaries;
+    const bool currentSame = versions.boundaries() == map.boundaries();
+    std::printf("at(%llu): %s; version %llu: %s\n", static_cast<unsigned long long>(checkedVersion),
+                oldSame ? "same as the copy taken then" : "DIFFERENT",
+                static_cast<unsigned long long>(versions.version()),
+                currentSame ? "same as IntervalMap" : "DIFFERENT");
+    return oldSame && currentSame && readerErrors.load() == 0 ? 0 : 1;
+}
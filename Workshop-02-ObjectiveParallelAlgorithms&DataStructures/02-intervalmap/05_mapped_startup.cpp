@@ -0,0 +1,146 @@
+/*
+    Startup from a memory-mapped table instead of replaying set().
+
+    Build: g++ -std=c++20 -O2 05_mapped_startup.cpp
+
+    A policy table of 2M address ranges is written once to a mapped table file, the offline step. Then:
+    - replay:       IntervalMap loaded by one set() per range, what every start used to do
+    - map, header:  MappedIntervalMap opened with MappedCheck::Header, then 1000 lookups
+    - map, full:    opened with MappedCheck::Full, which checksums the whole file
+    with the time and the page faults each takes, against the pages in the file. The mapped table is
+    checked to answer like the replayed one, and corrupted copies of the file are fed to both checks.
+*/
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+#include "mapped_interval_map.hpp"
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+
+constexpr std::size_t rangeCount = 2'000'000;
+
+double millisecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+long pageFaults() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+// Sorted, non-overlapping ranges; about one in four is followed by a gap
+std::vector<IntervalEntry<Address, Policy>> policyTable(std::mt19937& random) {
+    std::vector<IntervalEntry<Address, Policy>> ranges;
+    ranges.reserve(rangeCount);
+    const Address stride = static_cast<Address>(0xffff'ffffu / (rangeCount + 1));
+    Address start = 0;
+    for (std::size_t index = 0; index < rangeCount; ++index) {
+        const Address length = stride / 2 + static_cast<Address>(random() % (stride / 2));
+        const Address end = random() % 4 == 0 ? start + length : start + stride;
+        ranges.push_back({start, end, static_cast<Policy>(random() % 64)});
+        start += stride;
+    }
+    return ranges;
+}
+
+// Copies path with the byte at offset flipped
+void corruptCopy(const std::string& path, const std::string& copy, std::uintmax_t offset) {
+    std::filesystem::copy_file(path, copy, std::filesystem::copy_options::overwrite_existing);
+    std::fstream file(copy, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(offset));
+    const char byte = static_cast<char>(file.get() ^ 0x40);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.put(byte);
+}
+
+void tryOpen(const char* what, const std::string& path, MappedCheck check) {
+    try {
+        MappedIntervalMap<Address, Policy> table(path, check);
+        std::printf("  %-36s accepted\n", what);
+    } catch (const std::runtime_error& error) {
+        std::printf("  %-36s rejected: %s\n", what, error.what());
+    }
+}
+
+int main() {
+    const std::string path = (std::filesystem::temp_directory_path() / "policy.ivlmap").string();
+    std::mt19937 random(42);
+    const auto ranges = policyTable(random);
+
+    auto start = Clock::now();
+    const auto flat = FlatIntervalMap<Address, Policy>::fromSorted(ranges);
+    MappedIntervalMap<Address, Policy>::write(path, flat.boundaries(), 1);
+    const std::size_t filePages = std::filesystem::file_size(path) / MappedIntervalHeader::pageSize;
+    std::printf("offline build: %8.1f ms, %zu boundaries, %zu pages\n", millisecondsSince(start), flat.size(),
+                filePages);
+
+    std::vector<Address> keys(1000);
+    for (Address& key : keys) {
+        key = static_cast<Address>(random());
+    }
+
+    long faults = pageFaults();
+    start = Clock::now();
+    IntervalMap<Address, Policy> replayed;
+    for (const auto& range : ranges) {
+        replayed.set(range.start, range.end, range.value);
+    }
+    std::printf("replay:        %8.1f ms, %ld page faults\n", millisecondsSince(start), pageFaults() - faults);
+
+    std::uint64_t checksum = 0;
+    faults = pageFaults();
+    start = Clock::now();
+    {
+        MappedIntervalMap<Address, Policy> table(path, MappedCheck::Header);
+        for (Address key : keys) {
+            checksum += table.find(key).value_or(0xffff);
+        }
+        std::printf("map, header:   %8.3f ms, %ld page faults for open and %zu lookups\n", millisecondsSince(start),
+                    pageFaults() - faults, keys.size());
+    }
+
+    faults = pageFaults();
+    start = Clock::now();
+    MappedIntervalMap<Address, Policy> table(path, MappedCheck::Full);
+    std::printf("map, full:     %8.1f ms, %ld page faults\n", millisecondsSince(start), pageFaults() - faults);
+
+    std::uint64_t expected = 0;
+    bool same = table.tableVersion() == 1;
+    for (Address key : keys) {
+        expected += replayed.find(key).value_or(0xffff);
+        same = same && table.find(key) == replayed.find(key);
+    }
+    same = same && checksum == expected && table.boundaries() == replayed.boundaries();
+    std::printf("mapped table answers like the replayed one: %s\n", same ? "yes" : "NO");
+
+    const std::string copy = path + ".corrupt";
+    std::printf("corrupted copies:\n");
+    corruptCopy(path, copy, std::filesystem::file_size(path) / 2);
+    tryOpen("body byte flipped, header check", copy, MappedCheck::Header);
+    tryOpen("body byte flipped, full check", copy, MappedCheck::Full);
+    corruptCopy(path, copy, offsetof(MappedIntervalHeader, boundaryCount));
+    tryOpen("boundary count flipped, header check", copy, MappedCheck::Header);
+    std::filesystem::copy_file(path, copy, std::filesystem::copy_options::overwrite_existing);
+    std::filesystem::resize_file(copy, std::filesystem::file_size(path) - MappedIntervalHeader::pageSize);
+    tryOpen("truncated", copy, MappedCheck::Header);
+
+    std::filesystem::remove(copy);
+    std::filesystem::remove(path);
+    return same ? 0 : 1;
+}
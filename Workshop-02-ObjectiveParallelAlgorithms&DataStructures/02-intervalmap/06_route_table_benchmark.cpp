@@ -0,0 +1,256 @@
+/*
+    Longest-prefix-match lookups: a flattened IntervalMap vs the route tables.
+
+    Build: g++ -std=c++20 -O2 06_route_table_benchmark.cpp
+
+    A BGP-like table of 800k IPv4 prefixes, most of them /24 and /16 to /23, a few up to /32, is flattened
+    into interval maps (shortest prefixes first, so the longest match wins) and loaded into Ipv4RouteTable.
+    4M random addresses are then looked up with:
+    - map:         IntervalMap::find per address
+    - flat:        FlatIntervalMap::find per address
+    - route table: Ipv4RouteTable::find per address
+    - batch:       Ipv4RouteTable::findBatch
+    in ns per lookup. 10% of the prefixes are then erased and as many new ones set, one at a time, and the
+    table is checked against the flattened map of the prefixes that are left.
+    The same is done for 200k IPv6 prefixes, /32 to /64 with a few host routes, and Ipv6RouteTable.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+#include "route_table.hpp"
+
+using Clock = std::chrono::steady_clock;
+using NextHop = std::uint32_t;
+__extension__ using Wide = unsigned __int128; // GCC and clang extension; __extension__ keeps -Wpedantic quiet
+
+constexpr std::size_t lookupCount = 4'000'000;
+
+double nanosecondsSince(Clock::time_point start, std::size_t count) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(count);
+}
+
+template<typename Address>
+struct Prefix {
+    Address address;
+    unsigned length;
+    NextHop nextHop;
+};
+
+unsigned ipv4Length(std::mt19937& random) {
+    const unsigned draw = random() % 100;
+    if (draw < 58) {
+        return 24;
+    }
+    if (draw < 95) {
+        return 16 + random() % 8;
+    }
+    if (draw < 98) {
+        return 8 + random() % 8;
+    }
+    return 25 + random() % 8;
+}
+
+unsigned ipv6Length(std::mt19937& random) {
+    const unsigned draw = random() % 100;
+    if (draw < 45) {
+        return 48;
+    }
+    if (draw < 90) {
+        return 32 + random() % 16;
+    }
+    return random() % 10 == 0 ? 128 : 49 + random() % 16;
+}
+
+Ipv4Address ipv4Address(std::mt19937& random) {
+    return (1 + random() % 223) << 24 | (random() & 0xff'ffff); // Unicast
+}
+
+Ipv6Address ipv6Address(std::mt19937& random) {
+    Ipv6Address address;
+    for (std::uint8_t& byte : address) {
+        byte = static_cast<std::uint8_t>(random());
+    }
+    address[0] = static_cast<std::uint8_t>(0x20 | (address[0] & 0x1f)); // 2000::/3
+    address[1] = static_cast<std::uint8_t>(address[1] & 0x3f);            // Keeps 2000::/3 dense enough to hit
+    return address;
+}
+
+// Address range a prefix covers, as integers wide enough for the end of the space
+std::pair<std::uint64_t, std::uint64_t> rangeOf(const Prefix<Ipv4Address>& prefix) {
+    const std::uint64_t size = std::uint64_t{1} << (32 - prefix.length);
+    const std::uint64_t start = prefix.address & ~(size - 1);
+    return {start, start + size};
+}
+
+Wide wide(const Ipv6Address& address) {
+    Wide value = 0;
+    for (std::uint8_t byte : address) {
+        value = value << 8 | byte;
+    }
+    return value;
+}
+
+std::pair<Wide, Wide> rangeOf(const Prefix<Ipv6Address>& prefix) {
+    const Wide size = Wide{1} << (128 - prefix.length);
+    const Wide start = wide(prefix.address) & ~(size - 1);
+    return {start, start + size};
+}
+
+// The prefixes as ranges, shortest first: set in this order, a longer prefix overrides the ones it is inside
+template<typename Key, typename Address>
+std::vector<IntervalEntry<Key, NextHop>> flatten(
+    const std::map<std::pair<Address, unsigned>, Prefix<Address>>& prefixes) {
+    std::vector<IntervalEntry<Key, NextHop>> ranges;
+    ranges.reserve(prefixes.size());
+    for (const auto& [key, prefix] : prefixes) {
+        const auto [start, end] = rangeOf(prefix);
+        ranges.push_back({start, end, prefix.nextHop});
+    }
+    std::stable_sort(ranges.begin(), ranges.end(), [&](const auto& left, const auto& right) {
+        return left.end - left.start > right.end - right.start;
+    });
+    return ranges;
+}
+
+// Keys of the prefix map are the masked prefix, so re-drawing an existing one replaces it
+template<typename Address>
+Prefix<Address> randomPrefix(std::mt19937& random, Address (*address)(std::mt19937&),
+                             unsigned (*length)(std::mt19937&));
+
+template<>
+Prefix<Ipv4Address> randomPrefix(std::mt19937& random, Ipv4Address (*address)(std::mt19937&),
+                                 unsigned (*length)(std::mt19937&)) {
+    const unsigned bits = length(random);
+    const Ipv4Address masked = address(random) & (bits == 0 ? 0 : ~std::uint32_t{0} << (32 - bits));
+    return {masked, bits, static_cast<NextHop>(random() % 4096)};
+}
+
+template<>
+Prefix<Ipv6Address> randomPrefix(std::mt19937& random, Ipv6Address (*address)(std::mt19937&),
+                                 unsigned (*length)(std::mt19937&)) {
+    const unsigned bits = length(random);
+    Ipv6Address masked = address(random);
+    for (unsigned bit = bits; bit < 128; ++bit) {
+        masked[bit / 8] = static_cast<std::uint8_t>(masked[bit / 8] & ~(0x80u >> (bit % 8)));
+    }
+    return {masked, bits, static_cast<NextHop>(random() % 4096)};
+}
+
+template<typename Key, typename Address, typename Table>
+bool run(const char* family, std::size_t prefixCount, Address (*address)(std::mt19937&),
+         unsigned (*length)(std::mt19937&), Key (*toKey)(const Address&), std::mt19937& random) {
+    std::map<std::pair<Address, unsigned>, Prefix<Address>> prefixes;
+    while (prefixes.size() < prefixCount) {
+        const auto prefix = randomPrefix(random, address, length);
+        prefixes[{prefix.address, prefix.length}] = prefix;
+    }
+
+    auto start = Clock::now();
+    const auto ranges = flatten<Key>(prefixes);
+    IntervalMap<Key, NextHop> map;
+    map.setMany(ranges);
+    FlatIntervalMap<Key, NextHop> flat;
+    flat.setMany(ranges);
+    const double flattenTime = nanosecondsSince(start, 1) / 1e6;
+    start = Clock::now();
+    Table table;
+    for (const auto& [key, prefix] : prefixes) {
+        table.set(prefix.address, prefix.length, prefix.nextHop);
+    }
+    std::printf("%s: %zu prefixes, %zu boundaries; flatten %.0f ms, route table %.0f ms\n", family, prefixes.size(),
+                map.size(), flattenTime, nanosecondsSince(start, 1) / 1e6);
+
+    std::vector<Address> addresses(lookupCount);
+    for (Address& value : addresses) {
+        value = address(random);
+    }
+    std::vector<std::optional<NextHop>> expected(lookupCount);
+    std::vector<std::optional<NextHop>> results(lookupCount);
+    bool same = true;
+    const auto measure = [&](auto lookup, std::vector<std::optional<NextHop>>& out) {
+        const auto begin = Clock::now();
+        lookup(out);
+        const double nanoseconds = nanosecondsSince(begin, lookupCount);
+        same = same && out == expected;
+        return nanoseconds;
+    };
+    const auto oneAtATime = [&](const auto& lookupIn) {
+        return [&](std::vector<std::optional<NextHop>>& out) {
+            for (std::size_t index = 0; index < lookupCount; ++index) {
+                out[index] = lookupIn.find(addresses[index]);
+            }
+        };
+    };
+    const auto byKey = [&](const auto& lookupIn) {
+        return [&](std::vector<std::optional<NextHop>>& out) {
+            for (std::size_t index = 0; index < lookupCount; ++index) {
+                out[index] = lookupIn.find(toKey(addresses[index]));
+            }
+        };
+    };
+
+    const double mapTime = measure(byKey(map), expected);
+    const double flatTime = measure(byKey(flat), results);
+    const double tableTime = measure(oneAtATime(table), results);
+    const double batchTime = measure([&](std::vector<std::optional<NextHop>>& out) {
+        table.findBatch(addresses, out);
+    }, results);
+    std::printf("  lookup: map %.1f ns, flat %.1f ns, route table %.1f ns, batch %.1f ns (%.0fM lookups/s)\n",
+                mapTime, flatTime, tableTime, batchTime, 1e3 / batchTime);
+
+    // Churn: erase a tenth of the prefixes and set as many new ones, one update at a time
+    const std::size_t churn = prefixes.size() / 10;
+    std::vector<std::pair<Address, unsigned>> erased;
+    std::size_t position = 0;
+    for (const auto& [key, prefix] : prefixes) {
+        if (position++ % 10 == 0 && erased.size() < churn) {
+            erased.push_back(key);
+        }
+    }
+    std::vector<Prefix<Address>> added;
+    while (added.size() < erased.size()) {
+        added.push_back(randomPrefix(random, address, length));
+    }
+    start = Clock::now();
+    for (std::size_t index = 0; index < erased.size(); ++index) {
+        same = same && table.erase(erased[index].first, erased[index].second);
+        table.set(added[index].address, added[index].length, added[index].nextHop);
+    }
+    const double updateTime = nanosecondsSince(start, 2 * erased.size()) / 1e3;
+    for (std::size_t index = 0; index < erased.size(); ++index) {
+        prefixes.erase(erased[index]);
+        prefixes[{added[index].address, added[index].length}] = added[index];
+    }
+    IntervalMap<Key, NextHop> updated;
+    updated.setMany(flatten<Key>(prefixes));
+    for (std::size_t index = 0; index < lookupCount; ++index) {
+        same = same && table.find(addresses[index]) == updated.find(toKey(addresses[index]));
+    }
+    same = same && table.size() == prefixes.size();
+    std::printf("  %zu erases and %zu sets: %.2f us per update; matches the flattened map: %s\n", erased.size(),
+                added.size(), updateTime, same ? "yes" : "NO");
+    return same;
+}
+
+std::uint64_t ipv4Key(const Ipv4Address& address) {
+    return address;
+}
+
+int main() {
+    std::mt19937 random(42);
+    const bool ipv4 = run<std::uint64_t, Ipv4Address, Ipv4RouteTable<NextHop>>("IPv4", 800'000, ipv4Address,
+                                                                              ipv4Length, ipv4Key, random);
+    const bool ipv6 = run<Wide, Ipv6Address, Ipv6RouteTable<NextHop>>("IPv6", 200'000, ipv6Address, ipv6Length,
+                                                                        wide, random);
+    return ipv4 && ipv6 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/*
+    Window queries: scanning every interval vs range views.
+
+    Build: g++ -std=c++20 -O2 07_window_queries.cpp
+
+    An audit job asks, for many windows [low, high), which intervals overlap them. Two tables of 1M
+    intervals:
+    - the policy table of 01_flat_interval_map_benchmark.cpp in an IntervalMap, one value per key, queried
+      by scanning its boundaries and with IntervalMap::overlapping
+    - 1M overlapping intervals (bookings, say) in an IntervalTree, queried by scanning them all and with
+      IntervalTree::overlapping
+    in us per window, summing the values found. Both answers are checked against each other.
+*/
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "interval_map.hpp"
+#include "interval_tree.hpp"
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+
+constexpr std::size_t intervalCount = 1'000'000;
+constexpr std::size_t scannedWindows = 200;
+constexpr std::size_t windowCount = 200'000;
+
+double microsecondsPerWindow(Clock::time_point start, std::size_t windows) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / static_cast<double>(windows);
+}
+
+// Sorted, non-overlapping ranges; about one in four is followed by a gap
+std::vector<IntervalEntry<Address, Policy>> policyTable(std::mt19937& random) {
+    std::vector<IntervalEntry<Address, Policy>> ranges;
+    ranges.reserve(intervalCount);
+    const Address stride = static_cast<Address>(0xffff'ffffu / (intervalCount + 1));
+    Address start = 0;
+    for (std::size_t index = 0; index < intervalCount; ++index) {
+        const Address length = stride / 2 + static_cast<Address>(random() % (stride / 2));
+        const Address end = random() % 4 == 0 ? start + length : start + stride;
+        ranges.push_back({start, end, static_cast<Policy>(random() % 64)});
+        start += stride;
+    }
+    return ranges;
+}
+
+struct Window {
+    Address low;
+    Address high;
+};
+
+// Windows about `width` wide, starting anywhere below limit
+std::vector<Window> windows(std::size_t count, Address limit, Address width, std::mt19937& random) {
+    std::vector<Window> result(count);
+    for (Window& window : result) {
+        window.low = static_cast<Address>(random() % (limit - width));
+        window.high = window.low + width / 2 + static_cast<Address>(random() % width);
+    }
+    return result;
+}
+
+bool mapWindows(std::mt19937& random) {
+    IntervalMap<Address, Policy> map;
+    map.setMany(policyTable(random));
+    const auto boundaries = map.boundaries();
+    const auto queries = windows(windowCount, 0xffff'0000u, 40 * (0xffff'ffffu / intervalCount), random);
+
+    // What the audit job did: walk every boundary for each window
+    std::vector<std::uint64_t> scanned(scannedWindows);
+    auto start = Clock::now();
+    for (std::size_t query = 0; query < scannedWindows; ++query) {
+        for (std::size_t index = 0; index + 1 < boundaries.size(); ++index) {
+            if (boundaries[index].second && boundaries[index].first < queries[query].high &&
+                queries[query].low < boundaries[index + 1].first) {
+                scanned[query] += *boundaries[index].second;
+            }
+        }
+    }
+    const double scanTime = microsecondsPerWindow(start, scannedWindows);
+
+    std::vector<std::uint64_t> viewed(windowCount);
+    start = Clock::now();
+    for (std::size_t query = 0; query < windowCount; ++query) {
+        for (const auto& interval : map.overlapping(queries[query].low, queries[query].high)) {
+            viewed[query] += interval.value;
+        }
+    }
+    const double viewTime = microsecondsPerWindow(start, windowCount);
+
+    bool same = true;
+    for (std::size_t query = 0; query < scannedWindows; ++query) {
+        same = same && scanned[query] == viewed[query];
+    }
+    std::printf("IntervalMap, %zu boundaries:  scan %8.1f us, overlapping() %6.3f us per window%s\n", map.size(),
+                scanTime, viewTime, same ? "" : "  MISMATCH");
+    return same;
+}
+
+bool treeWindows(std::mt19937& random) {
+    constexpr Address span = 1'000'000'000;
+    std::vector<IntervalEntry<Address, Policy>> intervals(intervalCount);
+    IntervalTree<Address, Policy> tree;
+    for (auto& interval : intervals) {
+        interval.start = static_cast<Address>(random() % span);
+        interval.end = interval.start + 1 + static_cast<Address>(random() % 20'000);
+        interval.value = static_cast<Policy>(random() % 64);
+        tree.insert(interval.start, interval.end, interval.value);
+    }
+    const auto queries = windows(windowCount, span, 10'000, random);
+
+    std::vector<std::uint64_t> scanned(scannedWindows);
+    auto start = Clock::now();
+    for (std::size_t query = 0; query < scannedWindows; ++query) {
+        for (const auto& interval : intervals) {
+            if (interval.start < queries[query].high && queries[query].low < interval.end) {
+                scanned[query] += interval.value;
+            }
+        }
+    }
+    const double scanTime = microsecondsPerWindow(start, scannedWindows);
+
+    std::vector<std::uint64_t> viewed(windowCount);
+    std::size_t found = 0;
+    start = Clock::now();
+    for (std::size_t query = 0; query < windowCount; ++query) {
+        for (const auto& interval : tree.overlapping(queries[query].low, queries[query].high)) {
+            viewed[query] += interval.value;
+            ++found;
+        }
+    }
+    const double viewTime = microsecondsPerWindow(start, windowCount);
+
+    bool same = true;
+    for (std::size_t query = 0; query < scannedWindows; ++query) {
+        same = same && scanned[query] == viewed[query];
+    }
+    std::printf("IntervalTree, %zu intervals: scan %8.1f us, overlapping() %6.3f us per window, %.1f found%s\n",
+                tree.size(), scanTime, viewTime, static_cast<double>(found) / windowCount, same ? "" : "  MISMATCH");
+    return same;
+}
+
+int main() {
+    std::mt19937 random(42);
+    const bool map = mapWindows(random);
+    const bool tree = treeWindows(random);
+    return map && tree ? 0 : 1;
+}
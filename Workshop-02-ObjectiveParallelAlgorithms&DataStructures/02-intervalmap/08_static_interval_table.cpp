@@ -0,0 +1,102 @@
+/*
+    Range tables built at compile time.
+
+    Build: g++ -std=c++20 -O2 08_static_interval_table.cpp
+
+    Two tables that never change, port ranges to service classes and HTTP status code bands to their
+    descriptions, are built by makeIntervalTable while compiling, checked with static_assert, and looked up
+    at run time. The port table is then compared with the same ranges loaded into an IntervalMap at
+    startup: the time before the first lookup, and ns per lookup for 10M random ports.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "interval_map.hpp"
+#include "static_interval_table.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+enum class ServiceClass { System, Registered, Dynamic };
+
+// Listed out of order, and Registered in two touching pieces: the builder sorts and coalesces them
+constexpr auto portClasses = makeIntervalTable<std::uint32_t, ServiceClass>({
+    {49152, 65536, ServiceClass::Dynamic},
+    {0, 1024, ServiceClass::System},
+    {1024, 8000, ServiceClass::Registered},
+    {8000, 49152, ServiceClass::Registered},
+});
+
+constexpr auto statusBands = makeIntervalTable<int, std::string_view>({
+    {100, 200, "Informational"},
+    {200, 300, "Success"},
+    {300, 400, "Redirection"},
+    {400, 500, "Client Error"},
+    {500, 600, "Server Error"},
+});
+
+// Verified by the compiler: nothing of this is left to run at startup
+static_assert(portClasses.size() == 4); // 0, 1024, 49152 and the closing 65536
+static_assert(portClasses.get(443) == ServiceClass::System);
+static_assert(portClasses.get(8080) == ServiceClass::Registered);
+static_assert(!portClasses.find(65536));
+static_assert(statusBands.get(404) == "Client Error");
+static_assert(!statusBands.find(99) && !statusBands.find(600));
+
+// These do not compile, the builder rejects them:
+//   makeIntervalTable<int, char>({{0, 10, 'a'}, {5, 15, 'b'}}); // Overlapping ranges with different values
+//   makeIntervalTable<int, char>({{10, 10, 'a'}});              // Empty range
+
+const char* name(ServiceClass serviceClass) {
+    switch (serviceClass) {
+        case ServiceClass::System: return "system";
+        case ServiceClass::Registered: return "registered";
+        case ServiceClass::Dynamic: return "dynamic";
+    }
+    return "?";
+}
+
+int main() {
+    for (std::uint32_t port : {22u, 5432u, 50000u}) {
+        std::printf("port %u: %s\n", port, name(portClasses.get(port)));
+    }
+    for (int status : {200, 302, 503}) {
+        std::printf("status %d: %.*s\n", status, static_cast<int>(statusBands.get(status).size()),
+                    statusBands.get(status).data());
+    }
+
+    // The same table the way it used to be built, at startup
+    auto start = Clock::now();
+    IntervalMap<std::uint32_t, ServiceClass> map;
+    map.set(0, 1024, ServiceClass::System);
+    map.set(1024, 49152, ServiceClass::Registered);
+    map.set(49152, 65536, ServiceClass::Dynamic);
+    const double buildTime = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+    std::mt19937 random(42);
+    std::vector<std::uint32_t> ports(10'000'000);
+    for (std::uint32_t& port : ports) {
+        port = static_cast<std::uint32_t>(random() % 70'000); // A few out of range
+    }
+    const auto nanosecondsPerLookup = [&](const auto& table, unsigned& checksum) {
+        const auto begin = Clock::now();
+        for (std::uint32_t port : ports) {
+            checksum += static_cast<unsigned>(table.find(port).value_or(ServiceClass::Dynamic));
+        }
+        const double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+        return nanoseconds / static_cast<double>(ports.size());
+    };
+    unsigned staticSum = 0;
+    unsigned mapSum = 0;
+    const double staticTime = nanosecondsPerLookup(portClasses, staticSum);
+    const double mapTime = nanosecondsPerLookup(map, mapSum);
+    std::printf("IntervalMap: %.0f ns to build, %.2f ns per lookup\n", buildTime, mapTime);
+    std::printf("static table: nothing to build, %zu bytes of read-only data, %.2f ns per lookup\n",
+                sizeof(portClasses), staticTime);
+    std::printf("same answers: %s\n", staticSum == mapSum ? "yes" : "NO");
+    return staticSum == mapSum ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/*
+    Interval map backends side by side: set, get and mixed workloads from 1k to 10M ranges.
+
+    Build: g++ -std=c++20 -O2 09_backend_benchmark.cpp
+    Run:   ./a.out [max ranges]          (default 10000000)
+
+    Each backend is loaded with n ranges by one set() per range, in one of three orders:
+    - sequential:  ranges in ascending order, touching or followed by a small gap, the append pattern
+    - random:      ranges of one to four strides at random places, overlapping each other
+    - adversarial: descending order, two values only so most sets coalesce with a neighbour, and every
+                   16th range wide enough to swallow 32 others
+    then takes up to 1M gets of random keys, and a mix of 100k operations, one set in ten.
+    Reported: ns per set while loading, ns per get, ns per mixed operation, and heap bytes per range once
+    loaded. EytzingerIntervalMap is read-only: its "set" column is the time to build it from IntervalMap's
+    boundaries, per range, and it takes no mixed workload.
+
+    Combinations whose cost grows with n per set, and would run for minutes, are skipped: the flat arrays
+    shift on every set() that is not an append, and the persistent map pays an allocation per copied node.
+    All backends must give the same sums over the gets; a difference means a bug, and
+    10_differential_fuzz.cpp will find a small case of it.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "eytzinger_interval_map.hpp"
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+#include "persistent_interval_map.hpp"
+
+// Heap bytes still live, from malloc's own size of each block
+std::atomic<std::size_t> liveBytes{0};
+
+__attribute__((noinline)) void* operator new(std::size_t size) {
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    liveBytes.fetch_add(malloc_usable_size(pointer), std::memory_order_relaxed);
+    return pointer;
+}
+__attribute__((noinline)) void operator delete(void* pointer) noexcept {
+    liveBytes.fetch_sub(malloc_usable_size(pointer), std::memory_order_relaxed);
+    std::free(pointer);
+}
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+using Clock = std::chrono::steady_clock;
+using Address = std::uint32_t;
+using Policy = std::uint16_t;
+using Range = IntervalEntry<Address, Policy>;
+
+enum class Workload { Sequential, Random, Adversarial };
+
+const char* name(Workload workload) {
+    switch (workload) {
+        case Workload::Sequential: return "sequential";
+        case Workload::Random: return "random";
+        case Workload::Adversarial: return "adversarial";
+    }
+    return "?";
+}
+
+double nanosecondsSince(Clock::time_point start, std::size_t operations) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(operations);
+}
+
+std::vector<Range> load(Workload workload, std::size_t rangeCount, std::mt19937& random) {
+    const Address stride = static_cast<Address>(0xffff'ffffu / (rangeCount + 40));
+    std::vector<Range> ranges(rangeCount);
+    for (std::size_t index = 0; index < rangeCount; ++index) {
+        Range& range = ranges[index];
+        switch (workload) {
+            case Workload::Sequential:
+                range.start = static_cast<Address>(index) * stride;
+                range.end = range.start + (random() % 4 == 0 ? stride * 3 / 4 : stride);
+                range.value = static_cast<Policy>(random() % 64);
+                break;
+            case Workload::Random:
+                range.start = static_cast<Address>(random() % rangeCount) * stride;
+                range.start += static_cast<Address>(random() % stride);
+                range.end = range.start + stride * (1 + static_cast<Address>(random() % 4));
+                range.value = static_cast<Policy>(random() % 64);
+                break;
+            case Workload::Adversarial:
+                range.start = static_cast<Address>(rangeCount - 1 - index) * stride;
+                range.end = range.start + (index % 16 == 15 ? 32 * stride : stride);
+                range.value = static_cast<Policy>(random() % 2);
+                break;
+        }
+    }
+    return ranges;
+}
+
+struct Result {
+    double setTime = 0;
+    double getTime = 0;
+    double mixedTime = 0;
+    double bytesPerRange = 0;
+    std::uint64_t checksum = 0;      // Over the gets
+    std::uint64_t mixedChecksum = 0; // Over the gets of the mixed workload
+};
+
+template<typename Map>
+std::uint64_t sumOfGets(const Map& map, const std::vector<Address>& keys) {
+    std::uint64_t sum = 0;
+    for (Address key : keys) {
+        sum += map.find(key).value_or(0xffff);
+    }
+    return sum;
+}
+
+template<typename Map>
+Result measure(Map& map, const std::vector<Range>& ranges, const std::vector<Address>& keys,
+               const std::vector<Range>& mixed) {
+    Result result;
+    const std::size_t bytesBefore = liveBytes.load();
+    auto start = Clock::now();
+    for (const Range& range : ranges) {
+        map.set(range.start, range.end, range.value);
+    }
+    result.setTime = nanosecondsSince(start, ranges.size());
+    result.bytesPerRange = static_cast<double>(liveBytes.load() - bytesBefore) / static_cast<double>(ranges.size());
+
+    start = Clock::now();
+    result.checksum = sumOfGets(map, keys);
+    result.getTime = nanosecondsSince(start, keys.size());
+
+    // One set in ten; a get's key is the range's start
+    start = Clock::now();
+    for (std::size_t index = 0; index < mixed.size(); ++index) {
+        if (index % 10 == 0) {
+            map.set(mixed[index].start, mixed[index].end, mixed[index].value);
+        } else {
+            result.mixedChecksum += map.find(mixed[index].start).value_or(0xffff);
+        }
+    }
+    result.mixedTime = nanosecondsSince(start, mixed.size());
+    return result;
+}
+
+void report(Workload workload, std::size_t rangeCount, const char* backend, const std::optional<Result>& result,
+            bool mixed = true) {
+    std::printf("%-11s %9zu  %-10s ", name(workload), rangeCount, backend);
+    if (!result) {
+        std::printf("%10s\n", "skipped");
+        return;
+    }
+    std::printf("%8.1f %8.1f ", result->setTime, result->getTime);
+    if (mixed) {
+        std::printf("%8.1f", result->mixedTime);
+    } else {
+        std::printf("%8s", "-");
+    }
+    std::printf(" %11.1f\n", result->bytesPerRange);
+}
+
+int main(int argc, char** argv) {
+    const std::size_t maxRanges = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+    std::mt19937 random(42);
+
+    std::printf("%-11s %9s  %-10s %8s %8s %8s %11s\n", "workload", "ranges", "backend", "set ns", "get ns",
+                "mixed ns", "bytes/range");
+    bool same = true;
+    for (Workload workload : {Workload::Sequential, Workload::Random, Workload::Adversarial}) {
+        for (std::size_t rangeCount = 1'000; rangeCount <= maxRanges; rangeCount *= 10) {
+            const auto ranges = load(workload, rangeCount, random);
+            std::vector<Address> keys(std::min<std::size_t>(rangeCount, 1'000'000));
+            for (Address& key : keys) {
+                key = static_cast<Address>(random());
+            }
+            const auto mixed = load(Workload::Random, std::min<std::size_t>(rangeCount, 100'000), random);
+
+            std::optional<Result> map;
+            {
+                IntervalMap<Address, Policy> backend;
+                map = measure(backend, ranges, keys, mixed);
+                report(workload, rangeCount, "map", map);
+
+                // Read-only: built from the map as it stands after the mixed workload, so it gets the
+                // sum the map gives now
+                const auto start = Clock::now();
+                const EytzingerIntervalMap<Address, Policy> eytzinger(backend.boundaries());
+                Result result;
+                result.setTime = nanosecondsSince(start, rangeCount);
+                result.bytesPerRange = static_cast<double>(eytzinger.memoryBytes()) / static_cast<double>(rangeCount);
+                const auto getStart = Clock::now();
+                result.checksum = sumOfGets(eytzinger, keys);
+                result.getTime = nanosecondsSince(getStart, keys.size());
+                same = same && result.checksum == sumOfGets(backend, keys);
+                report(workload, rangeCount, "eytzinger", result, false);
+            }
+
+            std::optional<Result> flat;
+            if (workload == Workload::Sequential ? rangeCount <= 1'000'000 : rangeCount <= 100'000) {
+                FlatIntervalMap<Address, Policy> backend;
+                flat = measure(backend, ranges, keys, mixed);
+                same = same && flat->checksum == map->checksum && flat->mixedChecksum == map->mixedChecksum;
+            }
+            report(workload, rangeCount, "flat", flat);
+
+            std::optional<Result> persistent;
+            if (rangeCount <= 1'000'000) {
+                PersistentIntervalMap<Address, Policy> backend;
+                persistent = measure(backend, ranges, keys, mixed);
+                same = same && persistent->checksum == map->checksum &&
+                       persistent->mixedChecksum == map->mixedChecksum;
+            }
+            report(workload, rangeCount, "persistent", persistent);
+        }
+    }
+    std::printf("backends agree: %s\n", same ? "yes" : "NO");
+    return same ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+/*
+    Differential fuzzer: every interval map backend against a model too simple to get wrong.
+
+    Build: g++ -std=c++20 -O2 10_differential_fuzz.cpp
+    Run:   ./a.out [rounds] [seed]          (default 500 rounds, seed 1)
+
+    The model is a plain array with one std::optional<int> per key of a small key space, and set() writes
+    every key of its range. Each round draws a key space of 8 to 1000 keys, two to four values so that
+    neighbours often coalesce, and one operation mix:
+    - random:      ranges anywhere, of any width
+    - sequential:  ranges marching up the key space, touching or with small gaps
+    - adversarial: nested and touching ranges, repeats of the neighbour's value, ranges at both ends of the
+                   key space, empty and reversed ranges
+    After every set() the backends are compared with the model on random keys; every few operations, and
+    at the end of the round, on every key and on the exact boundary list, which must be the model's
+    canonical one (a boundary only where the value changes). That is what catches coalescing bugs.
+
+    Backends: IntervalMap and FlatIntervalMap with set(), both again with the operations applied in
+    batches through setMany(), PersistentIntervalMap, plus a snapshot of it taken mid-round checked against
+    the model of that moment, IntervalMap::within views, and the read-only EytzingerIntervalMap (find and
+    both findBatch paths) and MappedIntervalMap built from the model's boundaries.
+
+    On a mismatch it prints the seed, round and operation, the backend and key, and the operations of the
+    round, and exits with 1. Rounds are seeded from the seed and the round number, so a failure is
+    reproduced by running up to its round with the same seed.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "eytzinger_interval_map.hpp"
+#include "flat_interval_map.hpp"
+#include "interval_map.hpp"
+#include "mapped_interval_map.hpp"
+#include "persistent_interval_map.hpp"
+
+using Boundary = std::pair<int, std::optional<int>>;
+
+enum class Mix { Random, Sequential, Adversarial };
+
+const char* name(Mix mix) {
+    switch (mix) {
+        case Mix::Random: return "random";
+        case Mix::Sequential: return "sequential";
+        case Mix::Adversarial: return "adversarial";
+    }
+    return "?";
+}
+
+// Operations reach this far past either end of the key space, so that the edges get exercised
+constexpr int margin = 4;
+
+// One std::optional<int> per key in [first(), last()): the key space and its margins
+class Model {
+public:
+    explicit Model(int keySpace) : keySpace(keySpace), values(static_cast<std::size_t>(keySpace + 2 * margin)) {}
+
+    // Operations are clamped to [first(), last()) before they reach the model and the backends
+    void set(int start, int end, int value) {
+        for (int key = start; key < end; ++key) {
+            values[static_cast<std::size_t>(key - first())] = value;
+        }
+    }
+
+    std::optional<int> find(int key) const {
+        return key < first() || key >= last() ? std::nullopt : values[static_cast<std::size_t>(key - first())];
+    }
+
+    // Canonical form: a boundary wherever the value differs from the key before
+    std::vector<Boundary> boundaries() const {
+        std::vector<Boundary> result;
+        for (int key = first(); key <= last(); ++key) {
+            if (find(key) != find(key - 1)) {
+                result.emplace_back(key, find(key));
+            }
+        }
+        return result;
+    }
+
+    int first() const {
+        return -margin;
+    }
+
+    int last() const {
+        return keySpace + margin;
+    }
+
+    int keySpace;
+
+private:
+    std::vector<std::optional<int>> values;
+};
+
+struct Operation {
+    int start;
+    int end;
+    int value;
+};
+
+class Fuzzer {
+public:
+    Fuzzer(std::uint64_t seed, int round)
+        : seed(seed), round(round), random(static_cast<std::mt19937::result_type>(seed * 1'000'003 + round)) {}
+
+    bool run() {
+        const int keySpaces[] = {8, 16, 64, 1000};
+        const int keySpace = keySpaces[random() % 4];
+        valueCount = 2 + static_cast<int>(random() % 3);
+        mix = static_cast<Mix>(random() % 3);
+        const int operationCount = 50 + static_cast<int>(random() % 400);
+        const std::size_t batchSize = 1 + random() % 16;
+        const int snapshotAt = static_cast<int>(random() % static_cast<unsigned>(operationCount));
+
+        Model model(keySpace);
+        IntervalMap<int, int> map;
+        FlatIntervalMap<int, int> flat;
+        IntervalMap<int, int> batchedMap;
+        FlatIntervalMap<int, int> batchedFlat;
+        PersistentIntervalMap<int, int> persistent;
+        std::vector<IntervalEntry<int, int>> batch;
+        std::optional<PersistentIntervalMap<int, int>::Snapshot> snapshot;
+        std::optional<Model> snapshotModel;
+
+        for (operationIndex = 0; operationIndex < operationCount; ++operationIndex) {
+            Operation operation = next(keySpace);
+            operation.start = std::clamp(operation.start, model.first(), model.last());
+            operation.end = std::clamp(operation.end, model.first(), model.last());
+            operations.push_back(operation);
+            model.set(operation.start, operation.end, operation.value);
+            map.set(operation.start, operation.end, operation.value);
+            flat.set(operation.start, operation.end, operation.value);
+            persistent.set(operation.start, operation.end, operation.value);
+            batch.push_back({operation.start, operation.end, operation.value});
+            if (batch.size() == batchSize) {
+                batchedMap.setMany(batch);
+                batchedFlat.setMany(batch);
+                batch.clear();
+            }
+            if (operationIndex == snapshotAt) {
+                snapshot = persistent.snapshot();
+                snapshotModel = model;
+            }
+
+            const bool full = operationIndex % 16 == 0;
+            if (!check("IntervalMap", map, model, full) || !check("FlatIntervalMap", flat, model, full) ||
+                !check("PersistentIntervalMap", persistent, model, full)) {
+                return false;
+            }
+            if (batch.empty() && (!check("IntervalMap::setMany", batchedMap, model, full) ||
+                                  !check("FlatIntervalMap::setMany", batchedFlat, model, full))) {
+                return false;
+            }
+        }
+
+        batchedMap.setMany(batch);
+        batchedFlat.setMany(batch);
+        return check("IntervalMap::setMany", batchedMap, model, true) &&
+               check("FlatIntervalMap::setMany", batchedFlat, model, true) &&
+               check("PersistentIntervalMap snapshot", *snapshot, *snapshotModel, true) &&
+               checkViews(map, model) && checkReadOnly(model);
+    }
+
+private:
+    Operation next(int keySpace) {
+        const auto value = [&] { return static_cast<int>(random() % static_cast<unsigned>(valueCount)); };
+        const auto key = [&] { return static_cast<int>(random() % static_cast<unsigned>(keySpace + 1)); };
+        switch (mix) {
+            case Mix::Random: {
+                const int start = key();
+                return {start, start + static_cast<int>(random() % static_cast<unsigned>(keySpace / 2 + 1)), value()};
+            }
+            case Mix::Sequential: {
+                const int start = cursor + static_cast<int>(random() % 3) - 1; // Touching, overlapping or a gap
+                const int end = start + 1 + static_cast<int>(random() % 4);
+                cursor = end >= keySpace ? 0 : end;
+                return {start, end, value()};
+            }
+            case Mix::Adversarial:
+                break;
+        }
+        const Operation& last = operations.empty() ? Operation{0, keySpace, 0} : operations.back();
+        switch (random() % 6) {
+            case 0: { // Nested in the last range
+                const int width = std::max(last.end - last.start, 1);
+                const int start = last.start + static_cast<int>(random() % static_cast<unsigned>(width));
+                return {start, start + 1 + static_cast<int>(random() % static_cast<unsigned>(width)), value()};
+            }
+            case 1: // Touching the last range, with its value or not
+                return {last.end, last.end + 1 + static_cast<int>(random() % 4), random() % 2 ? last.value : value()};
+            case 2: // Covering the last range
+                return {last.start - static_cast<int>(random() % 3), last.end + static_cast<int>(random() % 3),
+                        value()};
+            case 3: // At either end of the key space, or past it
+                return random() % 2 ? Operation{-2, 1 + static_cast<int>(random() % 3), value()}
+                                    : Operation{keySpace - static_cast<int>(random() % 3), keySpace + 2, value()};
+            case 4: { // Empty or reversed
+                const int start = key();
+                return {start, start - static_cast<int>(random() % 2), value()};
+            }
+            default: { // The value already in effect there
+                const int start = key();
+                return {start, start + 1 + static_cast<int>(random() % 8), static_cast<int>(random() % 2)};
+            }
+        }
+    }
+
+    // Random keys, or every key and the boundary list
+    template<typename Map>
+    bool check(const char* backend, const Map& map, const Model& model, bool full) {
+        if (full) {
+            for (int key = model.first() - 1; key <= model.last(); ++key) {
+                if (map.find(key) != model.find(key)) {
+                    return fail(backend, key, map.find(key), model.find(key));
+                }
+            }
+            if constexpr (requires { map.boundaries(); }) { // The Eytzinger layout keeps no boundary list
+                if (map.boundaries() != model.boundaries()) {
+                    return fail(backend, "boundary list differs from the canonical one");
+                }
+            }
+            return true;
+        }
+        for (int probe = 0; probe < 8; ++probe) {
+            const unsigned span = static_cast<unsigned>(model.last() - model.first());
+            const int key = model.first() + static_cast<int>(random() % span);
+            if (map.find(key) != model.find(key)) {
+                return fail(backend, key, map.find(key), model.find(key));
+            }
+        }
+        return true;
+    }
+
+    // within() over random windows, pieced back together
+    bool checkViews(const IntervalMap<int, int>& map, const Model& model) {
+        for (int window = 0; window < 32; ++window) {
+            const int low = model.first() + static_cast<int>(random() % static_cast<unsigned>(model.keySpace));
+            const int high = low + static_cast<int>(random() % static_cast<unsigned>(model.keySpace + margin));
+            std::vector<std::optional<int>> seen(static_cast<std::size_t>(model.last() - model.first()));
+            for (const auto& slice : map.within(low, high)) {
+                if (!(slice.start < slice.end) || slice.start < low || high < slice.end) {
+                    return fail("IntervalMap::within", "slice outside the window");
+                }
+                for (int key = slice.start; key < slice.end; ++key) {
+                    seen[static_cast<std::size_t>(key - model.first())] = slice.value;
+                }
+            }
+            for (int key = model.first(); key < model.last(); ++key) {
+                const std::optional<int>& found = seen[static_cast<std::size_t>(key - model.first())];
+                const std::optional<int> expected = key >= low && key < high ? model.find(key) : std::nullopt;
+                if (found != expected) {
+                    return fail("IntervalMap::within", key, found, expected);
+                }
+            }
+        }
+        return true;
+    }
+
+    // The read-only backends, built from the model's boundaries
+    bool checkReadOnly(const Model& model) {
+        const auto boundaries = model.boundaries();
+        const EytzingerIntervalMap<int, int> eytzinger(boundaries);
+        if (!check("EytzingerIntervalMap", eytzinger, model, true)) {
+            return false;
+        }
+        std::vector<int> keys;
+        for (int key = model.first() - 1; key <= model.last(); ++key) {
+            keys.push_back(key);
+        }
+        for (BatchLookupPath path : {BatchLookupPath::Auto, BatchLookupPath::Scalar}) {
+            std::vector<std::optional<int>> found(keys.size());
+            eytzinger.findBatch(keys, found, path);
+            for (std::size_t index = 0; index < keys.size(); ++index) {
+                if (found[index] != model.find(keys[index])) {
+                    return fail("EytzingerIntervalMap::findBatch", keys[index], found[index], model.find(keys[index]));
+                }
+            }
+        }
+
+        if (round % 10 == 0) { // File I/O: not every round
+            const auto path = std::filesystem::temp_directory_path() / "differential_fuzz.ivlmap";
+            MappedIntervalMap<int, int>::write(path.string(), boundaries, static_cast<std::uint64_t>(round));
+            const MappedIntervalMap<int, int> mapped(path.string());
+            const bool same = check("MappedIntervalMap", mapped, model, true);
+            std::filesystem::remove(path);
+            return same;
+        }
+        return true;
+    }
+
+    bool fail(const char* backend, int key, const std::optional<int>& found, const std::optional<int>& expected) {
+        const auto text = [](const std::optional<int>& value) { return value ? std::to_string(*value) : "none"; };
+        const std::string what = "key " + std::to_string(key) + ": " + text(found) + ", expected " + text(expected);
+        return fail(backend, what.c_str());
+    }
+
+    bool fail(const char* backend, const char* what) {
+        std::printf("MISMATCH seed %llu round %d operation %d (%s mix): %s: %s\n",
+                    static_cast<unsigned long long>(seed), round, operationIndex, name(mix), backend, what);
+        std::printf("operations of the round:\n");
+        for (const Operation& operation : operations) {
+            std::printf("  set(%d, %d, %d)\n", operation.start, operation.end, operation.value);
+        }
+        return false;
+    }
+
+    std::uint64_t seed;
+    int round;
+    std::mt19937 random;
+    Mix mix = Mix::Random;
+    int valueCount = 2;
+    int cursor = 0;
+    int operationIndex = 0;
+    std::vector<Operation> operations;
+};
+
+int main(int argc, char** argv) {
+    const int rounds = argc > 1 ? std::atoi(argv[1]) : 500;
+    const std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+    for (int round = 0; round < rounds; ++round) {
+        if (!Fuzzer(seed, round).run()) {
+            return 1;
+        }
+    }
+    std::printf("%d rounds, seed %llu: all backends agree with the model\n", rounds,
+                static_cast<unsigned long long>(seed));
+    return 0;
+}
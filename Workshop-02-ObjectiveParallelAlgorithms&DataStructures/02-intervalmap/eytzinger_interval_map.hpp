@@ -0,0 +1,318 @@
+#pragma once
+
+/*
+    Read-only interval map in Eytzinger order, with batch lookups that keep many searches in flight.
+
+    A lookup in a sorted array is a chain of dependent loads: the next probe is known only once the
+    current one has arrived from memory, so on a table larger than the cache one get() costs about
+    log2(n) DRAM round trips and the core idles in between. A classifier looking up a whole batch of
+    packets has independent searches that can overlap instead, provided the layout lets them:
+
+    - The boundary keys are stored as an implicit binary tree in breadth-first (Eytzinger) order: the
+      children of node k are 2k and 2k + 1. The four levels below node k then sit in one cache line
+      starting at 16k (for 4-byte keys, with the array cache-line aligned), so a search can prefetch
+      four levels ahead, and the top levels, shared by every search, stay in cache.
+    - The tree is padded to a complete one, so every search takes exactly the same number of steps and
+      the descent has no data-dependent branch: k = 2k + (tree[k] <= key). The padding repeats the
+      last boundary, which sends a search to the same value as the boundary itself.
+    - findBatch runs the searches of a group of keys level by level in lock step, so one group has as
+      many loads in flight as it has keys. For 4- and 8-byte integral keys on a CPU with AVX2, a group is
+      a few vector registers, descended with gathers and vector compares; otherwise it is a scalar loop
+      with prefetches. The CPU is checked at run time, so the same binary runs anywhere.
+
+    After the descent, the last step that went right is the last boundary <= key, whose value holds
+    from there on: k >> (trailing zeros of k + 1). Values are stored in tree order next to the keys.
+
+    The map is built from the canonical boundaries of IntervalMap or FlatIntervalMap in O(n) and is not
+    modified afterwards; rebuild it when the table changes. Semantics are those of IntervalMap.
+*/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define INTERVAL_MAP_AVX2 1
+#endif
+
+// std::allocator that puts the array on a cache line boundary, so that Eytzinger blocks line up with lines
+template<typename T>
+struct CacheAlignedAllocator {
+    using value_type = T;
+    static constexpr std::align_val_t alignment{64};
+
+    CacheAlignedAllocator() = default;
+    template<typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), alignment));
+    }
+    void deallocate(T* pointer, std::size_t) {
+        ::operator delete(pointer, alignment);
+    }
+
+    template<typename U>
+    bool operator==(const CacheAlignedAllocator<U>&) const {
+        return true;
+    }
+};
+
+// Which code findBatch runs; Scalar forces the fallback, for comparison and testing
+enum class BatchLookupPath {
+    Auto,
+    Scalar,
+};
+
+template<typename K, typename V>
+class EytzingerIntervalMap {
+public:
+    using Boundary = std::pair<K, std::optional<V>>;
+
+    EytzingerIntervalMap() : EytzingerIntervalMap(std::vector<Boundary>{}) {}
+
+    // From canonical boundaries sorted by key, as returned by IntervalMap::boundaries()
+    explicit EytzingerIntervalMap(const std::vector<Boundary>& boundaries) : boundaryCount(boundaries.size()) {
+        if (boundaries.size() >= std::numeric_limits<std::uint32_t>::max() / 2) {
+            throw std::length_error("EytzingerIntervalMap supports fewer than 2^31 boundaries");
+        }
+        depth = static_cast<unsigned>(std::bit_width(boundaries.size()));
+        const std::size_t nodes = std::size_t{1} << depth; // Node 0 is unused, the complete tree is 1..nodes-1
+
+        // Padding repeats the last boundary: a key at or past it gets its value either way
+        tree.assign(nodes, boundaries.empty() ? K{} : boundaries.back().first);
+        nodeValues.assign(nodes, boundaries.empty() ? std::nullopt : boundaries.back().second);
+        nodeValues[0] = std::nullopt; // Where a search ends when no boundary is <= key
+        std::size_t next = 0;
+        fill(boundaries, 1, next);
+    }
+
+    // Throws std::out_of_range if no interval contains key
+    const V& get(const K& key) const {
+        const std::optional<V>& value = nodeValues[nodeOf(key)];
+        if (!value) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return *value;
+    }
+
+    std::optional<V> find(const K& key) const {
+        return nodeValues[nodeOf(key)];
+    }
+
+    // out[i] = find(keys[i]); out must be at least as long as keys
+    void findBatch(std::span<const K> keys, std::span<std::optional<V>> out,
+                   BatchLookupPath path = BatchLookupPath::Auto) const {
+        forEachNode(keys, out.size(), path,
+                    [&](std::size_t index, std::uint32_t node) { out[index] = nodeValues[node]; });
+    }
+
+    // out[i] = get(keys[i]); throws std::out_of_range, after filling the rest, if a key is in no interval
+    void getBatch(std::span<const K> keys, std::span<V> out, BatchLookupPath path = BatchLookupPath::Auto) const {
+        bool uncovered = false;
+        forEachNode(keys, out.size(), path, [&](std::size_t index, std::uint32_t node) {
+            if (nodeValues[node]) {
+                out[index] = *nodeValues[node];
+            } else {
+                uncovered = true;
+            }
+        });
+        if (uncovered) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+    }
+
+    // Whether findBatch takes the AVX2 path for this key type on this CPU
+    static bool vectorized() {
+#ifdef INTERVAL_MAP_AVX2
+        if constexpr (vectorizable) {
+            return __builtin_cpu_supports("avx2");
+        }
+#endif
+        return false;
+    }
+
+    // Number of boundaries, as in IntervalMap::size
+    std::size_t size() const {
+        return boundaryCount;
+    }
+
+    // Heap bytes held, padding included
+    std::size_t memoryBytes() const {
+        return tree.capacity() * sizeof(K) + nodeValues.capacity() * sizeof(std::optional<V>);
+    }
+
+private:
+    static constexpr bool vectorizable =
+        std::integral<K> && !std::same_as<K, bool> && (sizeof(K) == 4 || sizeof(K) == 8);
+
+    // Keys per group searched in lock step
+    static constexpr std::size_t groupSize = 32;
+
+    // Nodes one cache line below: the descendants four levels down of 4-byte keys
+    static constexpr std::size_t prefetchStride = sizeof(K) <= 64 ? 64 / sizeof(K) : 1;
+
+    // In-order walk of the complete tree assigns the sorted boundaries, then the padding
+    void fill(const std::vector<Boundary>& boundaries, std::size_t node, std::size_t& next) {
+        if (node >= tree.size()) {
+            return;
+        }
+        fill(boundaries, 2 * node, next);
+        if (next < boundaries.size()) {
+            tree[node] = boundaries[next].first;
+            nodeValues[node] = boundaries[next].second;
+        }
+        ++next;
+        fill(boundaries, 2 * node + 1, next);
+    }
+
+    // Node after `depth` steps to the node of the last boundary <= key, or 0 if there is none
+    static std::uint32_t lastRightTurn(std::uint32_t node) {
+        return node >> (std::countr_zero(node) + 1);
+    }
+
+    std::uint32_t nodeOf(const K& key) const {
+        std::uint32_t node = 1;
+        for (unsigned level = 0; level < depth; ++level) {
+            node = 2 * node + (key < tree[node] ? 0 : 1);
+        }
+        return lastRightTurn(node);
+    }
+
+    // Calls visit(index, node) for every key, searching a group of keys at a time
+    template<typename Visit>
+    void forEachNode(std::span<const K> keys, std::size_t outSize, BatchLookupPath path, Visit&& visit) const {
+        if (outSize < keys.size()) {
+            throw std::invalid_argument("Batch output is shorter than the keys");
+        }
+        const bool vector = path == BatchLookupPath::Auto && vectorized();
+        std::array<std::uint32_t, groupSize> nodes;
+        for (std::size_t first = 0; first < keys.size(); first += groupSize) {
+            const std::size_t count = std::min(groupSize, keys.size() - first);
+            const std::span<const K> group = keys.subspan(first, count);
+            if (vector && count == groupSize) {
+                vectorGroup(group.data(), nodes.data());
+            } else {
+                scalarGroup(group, nodes.data());
+            }
+            for (std::size_t index = 0; index < count; ++index) {
+                visit(first + index, nodes[index]);
+            }
+        }
+    }
+
+    // The descent of every key of the group, one level at a time, each level prefetching the line that
+    // holds the nodes a few levels further down
+    void scalarGroup(std::span<const K> group, std::uint32_t* nodes) const {
+        for (std::size_t index = 0; index < group.size(); ++index) {
+            nodes[index] = 1;
+        }
+        const K* base = tree.data();
+        for (unsigned level = 0; level < depth; ++level) {
+            for (std::size_t index = 0; index < group.size(); ++index) {
+                const std::uint32_t node = nodes[index];
+                __builtin_prefetch(base + std::min<std::size_t>(node * prefetchStride, tree.size() - 1));
+                nodes[index] = 2 * node + (group[index] < base[node] ? 0 : 1);
+            }
+        }
+        for (std::size_t index = 0; index < group.size(); ++index) {
+            nodes[index] = lastRightTurn(nodes[index]);
+        }
+    }
+
+    void vectorGroup(const K* group, std::uint32_t* nodes) const {
+#ifdef INTERVAL_MAP_AVX2
+        if constexpr (vectorizable) {
+            if constexpr (sizeof(K) == 4) {
+                vectorGroup32(group, nodes);
+            } else {
+                vectorGroup64(group, nodes);
+            }
+            return;
+        }
+#endif
+        scalarGroup(std::span<const K>(group, groupSize), nodes);
+    }
+
+#ifdef INTERVAL_MAP_AVX2
+    // AVX2 compares are signed: unsigned keys are compared with their top bit flipped
+    static constexpr bool flipSign = std::unsigned_integral<K>;
+
+    // 8 keys per register, 4 registers per group: node = 2 * node + 1 + (tree[node] > key ? -1 : 0)
+    __attribute__((target("avx2"))) void vectorGroup32(const K* group, std::uint32_t* nodes) const {
+        constexpr std::size_t lanes = 8;
+        constexpr std::size_t registers = groupSize / lanes;
+        const __m256i sign = _mm256_set1_epi32(flipSign ? static_cast<int>(0x8000'0000u) : 0);
+        const __m256i one = _mm256_set1_epi32(1);
+        const int* base = reinterpret_cast<const int*>(tree.data());
+        __m256i key[registers];
+        __m256i node[registers];
+        for (std::size_t lane = 0; lane < registers; ++lane) {
+            const __m256i loaded = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(group + lane * lanes));
+            key[lane] = _mm256_xor_si256(loaded, sign);
+            node[lane] = one;
+        }
+        for (unsigned level = 0; level < depth; ++level) {
+            for (std::size_t lane = 0; lane < registers; ++lane) {
+                const __m256i boundary = _mm256_xor_si256(_mm256_i32gather_epi32(base, node[lane], 4), sign);
+                const __m256i greater = _mm256_cmpgt_epi32(boundary, key[lane]);
+                const __m256i right = _mm256_add_epi32(_mm256_add_epi32(node[lane], node[lane]), one);
+                node[lane] = _mm256_add_epi32(right, greater);
+            }
+        }
+        for (std::size_t lane = 0; lane < registers; ++lane) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(nodes + lane * lanes), node[lane]);
+        }
+        for (std::size_t index = 0; index < groupSize; ++index) {
+            nodes[index] = lastRightTurn(nodes[index]);
+        }
+    }
+
+    // 4 keys per register, 8 registers per group, 64-bit node indices for the gather
+    __attribute__((target("avx2"))) void vectorGroup64(const K* group, std::uint32_t* nodes) const {
+        constexpr std::size_t lanes = 4;
+        constexpr std::size_t registers = groupSize / lanes;
+        const __m256i sign = _mm256_set1_epi64x(flipSign ? static_cast<long long>(0x8000'0000'0000'0000ull) : 0);
+        const __m256i one = _mm256_set1_epi64x(1);
+        const long long* base = reinterpret_cast<const long long*>(tree.data());
+        __m256i key[registers];
+        __m256i node[registers];
+        for (std::size_t lane = 0; lane < registers; ++lane) {
+            const __m256i loaded = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(group + lane * lanes));
+            key[lane] = _mm256_xor_si256(loaded, sign);
+            node[lane] = one;
+        }
+        for (unsigned level = 0; level < depth; ++level) {
+            for (std::size_t lane = 0; lane < registers; ++lane) {
+                const __m256i boundary = _mm256_xor_si256(_mm256_i64gather_epi64(base, node[lane], 8), sign);
+                const __m256i greater = _mm256_cmpgt_epi64(boundary, key[lane]);
+                const __m256i right = _mm256_add_epi64(_mm256_add_epi64(node[lane], node[lane]), one);
+                node[lane] = _mm256_add_epi64(right, greater);
+            }
+        }
+        alignas(32) std::array<std::uint64_t, groupSize> wide;
+        for (std::size_t lane = 0; lane < registers; ++lane) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(wide.data() + lane * lanes), node[lane]);
+        }
+        for (std::size_t index = 0; index < groupSize; ++index) {
+            nodes[index] = lastRightTurn(static_cast<std::uint32_t>(wide[index]));
+        }
+    }
+#endif
+
+    std::size_t boundaryCount = 0;
+    unsigned depth = 0;                                      // Levels of the padded tree
+    std::vector<K, CacheAlignedAllocator<K>> tree;           // Boundary keys in Eytzinger order, padded
+    std::vector<std::optional<V>> nodeValues;                // Value from tree[k] on, in the same order
+};
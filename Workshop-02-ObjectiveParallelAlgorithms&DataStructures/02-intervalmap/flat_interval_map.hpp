@@ -0,0 +1,205 @@
+#pragma once
+
+/*
+    Flat interval map: the boundaries of IntervalMap in two sorted contiguous arrays.
+
+    std::map spends a heap node per boundary: three pointers and a color next to the key and value,
+    scattered over the heap, so every get() is a chain of dependent cache misses. Policy tables are read
+    far more often than written, so here the boundary keys sit in one sorted array and their values in a
+    parallel one. A lookup is a binary search over the keys alone, which touches the fewest cache lines,
+    written without a data-dependent branch so it costs the same whatever the key.
+
+    The price is on the write side: set() shifts the arrays behind the changed range, O(n) moves in the
+    worst case. Tables loaded in one go avoid that: fromSorted builds the arrays from ranges sorted by start
+    in a single O(n) pass, with the same coalescing as set(), and setMany applies a batch of ranges to a
+    loaded table in one merge pass.
+
+    Semantics and the canonical boundary form are those of IntervalMap (interval_map.hpp).
+*/
+
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "interval_map.hpp"
+
+template<typename K, typename V>
+class FlatIntervalMap {
+public:
+    using Boundary = std::pair<K, std::optional<V>>;
+
+    FlatIntervalMap() = default;
+
+    // O(n) bulk load from IntervalEntry ranges sorted by start; ranges may touch but not overlap, empty ones
+    // are skipped. Throws std::invalid_argument otherwise.
+    template<std::ranges::input_range Range>
+    static FlatIntervalMap fromSorted(const Range& entries) {
+        FlatIntervalMap map;
+        if constexpr (std::ranges::sized_range<Range>) {
+            map.keys.reserve(2 * std::ranges::size(entries));
+            map.values.reserve(2 * std::ranges::size(entries));
+        }
+        for (const IntervalEntry<K, V>& entry : entries) {
+            if (!(entry.start < entry.end)) {
+                continue;
+            }
+            if (!map.keys.empty() && entry.start < map.keys.back()) {
+                throw std::invalid_argument("fromSorted needs ranges sorted by start and not overlapping");
+            }
+            if (!map.keys.empty() && !(map.keys.back() < entry.start)) {
+                // Touches the previous range: its closing boundary becomes this range's start, or goes away
+                map.keys.pop_back();
+                map.values.pop_back();
+                if (map.values.empty() || map.values.back() != entry.value) {
+                    map.keys.push_back(entry.start);
+                    map.values.emplace_back(entry.value);
+                }
+            } else {
+                map.keys.push_back(entry.start);
+                map.values.emplace_back(entry.value);
+            }
+            map.keys.push_back(entry.end);
+            map.values.emplace_back(std::nullopt);
+        }
+        return map;
+    }
+
+    // Same as IntervalMap::set; moves the boundaries after the range
+    void set(const K& start, const K& end, const V& value) {
+        if (!(start < end)) {
+            return;
+        }
+        const std::optional<V> after = find(end);
+        const std::size_t first = lowerBound(start);
+        const bool changesBefore = first == 0 || values[first - 1] != value;
+        const bool changesAfter = after != value;
+        const std::size_t last = upperBound(end);
+
+        // Replace the boundaries in [start, end] by at most two new ones
+        const std::size_t kept = (changesBefore ? 1 : 0) + (changesAfter ? 1 : 0);
+        const std::size_t removed = last - first;
+        if (kept > removed) {
+            keys.insert(keys.begin() + static_cast<std::ptrdiff_t>(first), kept - removed, start);
+            values.insert(values.begin() + static_cast<std::ptrdiff_t>(first), kept - removed, std::nullopt);
+        } else {
+            keys.erase(keys.begin() + static_cast<std::ptrdiff_t>(first + kept),
+                       keys.begin() + static_cast<std::ptrdiff_t>(last));
+            values.erase(values.begin() + static_cast<std::ptrdiff_t>(first + kept),
+                         values.begin() + static_cast<std::ptrdiff_t>(last));
+        }
+        std::size_t position = first;
+        if (changesBefore) {
+            keys[position] = start;
+            values[position] = value;
+            ++position;
+        }
+        if (changesAfter) {
+            keys[position] = end;
+            values[position] = after;
+        }
+    }
+
+    // Same result as set() for each range in order, without the per-range shifts: the new arrays are
+    // built in one merge pass over the old ones (interval_batch.hpp)
+    void setMany(std::span<const IntervalEntry<K, V>> ranges) {
+        const auto segments = resolveBatch(ranges);
+        std::vector<K> mergedKeys;
+        std::vector<std::optional<V>> mergedValues;
+        mergedKeys.reserve(keys.size() + 2 * segments.size());
+        mergedValues.reserve(keys.size() + 2 * segments.size());
+        const auto existing = std::views::iota(std::size_t{0}, keys.size()) |
+                              std::views::transform([this](std::size_t index) {
+                                  return std::pair<const K&, const std::optional<V>&>(keys[index], values[index]);
+                              });
+        overlayBoundaries(existing, segments, [&](const K& key, const std::optional<V>& value) {
+            mergedKeys.push_back(key);
+            mergedValues.push_back(value);
+        });
+        keys.swap(mergedKeys);
+        values.swap(mergedValues);
+    }
+
+    // Throws std::out_of_range if no interval contains key
+    const V& get(const K& key) const {
+        const std::size_t position = upperBound(key);
+        if (position == 0 || !values[position - 1]) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return *values[position - 1];
+    }
+
+    std::optional<V> find(const K& key) const {
+        const std::size_t position = upperBound(key);
+        return position == 0 ? std::nullopt : values[position - 1];
+    }
+
+    bool empty() const {
+        return keys.empty();
+    }
+
+    std::size_t size() const {
+        return keys.size();
+    }
+
+    std::vector<Boundary> boundaries() const {
+        std::vector<Boundary> result;
+        result.reserve(keys.size());
+        for (std::size_t index = 0; index < keys.size(); ++index) {
+            result.emplace_back(keys[index], values[index]);
+        }
+        return result;
+    }
+
+    // Heap bytes held by the two arrays
+    std::size_t memoryBytes() const {
+        return keys.capacity() * sizeof(K) + values.capacity() * sizeof(std::optional<V>);
+    }
+
+    void shrinkToFit() {
+        keys.shrink_to_fit();
+        values.shrink_to_fit();
+    }
+
+    void print() const {
+        for (std::size_t index = 0; index + 1 < keys.size(); ++index) {
+            if (values[index]) {
+                std::cout << "[" << keys[index] << ", " << keys[index + 1] << "): " << *values[index] << "\n";
+            }
+        }
+    }
+
+private:
+    // Index of the first boundary not below key (lowerBound) or above key (upperBound). The loop halves the
+    // range with a conditional move instead of a branch: no mispredictions, and the same number of steps
+    // for every key, so the next probe's address is known as early as possible.
+    std::size_t lowerBound(const K& key) const {
+        return search(key, [](const K& boundary, const K& probe) { return boundary < probe; });
+    }
+
+    std::size_t upperBound(const K& key) const {
+        return search(key, [](const K& boundary, const K& probe) { return !(probe < boundary); });
+    }
+
+    template<typename Before>
+    std::size_t search(const K& key, Before before) const {
+        std::size_t length = keys.size();
+        if (length == 0) {
+            return 0;
+        }
+        const K* base = keys.data();
+        while (length > 1) {
+            const std::size_t half = length / 2;
+            base = before(base[half], key) ? base + half : base;
+            length -= half;
+        }
+        return static_cast<std::size_t>(base - keys.data()) + (before(*base, key) ? 1 : 0);
+    }
+
+    std::vector<K> keys;                  // Sorted boundaries
+    std::vector<std::optional<V>> values; // values[i] holds from keys[i] up to keys[i + 1]
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+/*
+    Batch assignment for the interval maps: many set() calls in one linear merge.
+
+    Loading a policy table by calling set() once per range pays a search, an erase and up to two inserts per
+    range, and for the flat backend a shift of everything behind it. setMany takes the whole batch instead:
+    1. resolveBatch sorts the ranges and resolves their overlaps, later ranges winning as if they had been
+       set one after the other, into sorted, non-overlapping, coalesced segments. A batch that is already
+       sorted and free of overlaps, the usual table reload, skips both the sort and the sweep.
+    2. overlayBoundaries walks the existing boundaries and the segments together once, and emits the
+       boundaries of the result in order: a segment's value where the batch covers a key, the existing one
+       elsewhere, a boundary only where the value changes.
+    The cost is O(n + m log m) for n existing boundaries and m ranges, O(n + m) for a sorted batch, and the
+    backend builds its new storage from the emitted boundaries with appends only.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <vector>
+
+// A range [start, end) and its value, as taken by bulk construction and batch assignment
+template<typename K, typename V>
+struct IntervalEntry {
+    K start;
+    K end;
+    V value;
+};
+
+// Appends [start, end) to sorted segments, extending the last one if it touches with the same value
+template<typename K, typename V>
+void appendSegment(std::vector<IntervalEntry<K, V>>& segments, const K& start, const K& end, const V& value) {
+    if (!segments.empty() && !(segments.back().end < start) && segments.back().value == value) {
+        segments.back().end = end;
+        return;
+    }
+    segments.push_back({start, end, value});
+}
+
+// The batch as sorted, non-overlapping, coalesced segments, with what set() applied in batch order would
+// leave: where ranges overlap, the later one wins. Empty and reversed ranges are ignored.
+template<typename K, typename V>
+std::vector<IntervalEntry<K, V>> resolveBatch(std::span<const IntervalEntry<K, V>> batch) {
+    std::vector<std::size_t> order;
+    order.reserve(batch.size());
+    for (std::size_t index = 0; index < batch.size(); ++index) {
+        if (batch[index].start < batch[index].end) {
+            order.push_back(index);
+        }
+    }
+    const auto byStart = [&](std::size_t left, std::size_t right) { return batch[left].start < batch[right].start; };
+    if (!std::is_sorted(order.begin(), order.end(), byStart)) {
+        std::stable_sort(order.begin(), order.end(), byStart); // Equal starts stay in batch order
+    }
+
+    std::vector<IntervalEntry<K, V>> segments;
+    segments.reserve(order.size());
+    bool overlapping = false;
+    for (std::size_t position = 1; position < order.size() && !overlapping; ++position) {
+        overlapping = batch[order[position]].start < batch[order[position - 1]].end;
+    }
+    if (!overlapping) {
+        for (std::size_t index : order) {
+            appendSegment(segments, batch[index].start, batch[index].end, batch[index].value);
+        }
+        return segments;
+    }
+
+    // Sweep over the range ends: between two consecutive ends, the latest open range holds
+    struct Event {
+        K key;
+        std::size_t index;
+        bool opens;
+    };
+    std::vector<Event> events;
+    events.reserve(2 * order.size());
+    for (std::size_t index : order) {
+        events.push_back({batch[index].start, index, true});
+        events.push_back({batch[index].end, index, false});
+    }
+    std::stable_sort(events.begin(), events.end(), [](const Event& left, const Event& right) { return left.key < right.key; });
+
+    std::vector<std::size_t> open; // Max-heap of batch indices; closed ones are dropped when they surface
+    std::vector<bool> closed(batch.size(), false);
+    for (std::size_t event = 0; event < events.size();) {
+        const K key = events[event].key;
+        for (; event < events.size() && !(key < events[event].key); ++event) {
+            if (events[event].opens) {
+                open.push_back(events[event].index);
+                std::push_heap(open.begin(), open.end());
+            } else {
+                closed[events[event].index] = true;
+            }
+        }
+        while (!open.empty() && closed[open.front()]) {
+            std::pop_heap(open.begin(), open.end());
+            open.pop_back();
+        }
+        if (!open.empty()) {
+            // Something is still open, so a later event exists
+            appendSegment(segments, key, events[event].key, batch[open.front()].value);
+        }
+    }
+    return segments;
+}
+
+// Calls emit(const K&, const std::optional<V>&) for every boundary of existing overlaid with segments, in
+// key order. existing is a range of canonical boundaries with .first (key) and .second (std::optional<V>).
+template<typename K, typename V, typename Boundaries, typename Emit>
+void overlayBoundaries(const Boundaries& existing, const std::vector<IntervalEntry<K, V>>& segments, Emit&& emit) {
+    auto boundary = existing.begin();
+    const auto boundariesEnd = existing.end();
+    std::size_t segment = 0;
+    bool inSegment = false;
+    std::optional<V> existingValue; // Existing value in effect at the current key
+    std::optional<V> emitted;       // Value of the last emitted boundary
+
+    while (boundary != boundariesEnd || segment < segments.size()) {
+        // Next key: the earlier of the next existing boundary and the next segment edge
+        const bool haveSegmentEdge = segment < segments.size();
+        const K* key = nullptr;
+        if (haveSegmentEdge) {
+            key = inSegment ? &segments[segment].end : &segments[segment].start;
+        }
+        if (boundary != boundariesEnd && (key == nullptr || (*boundary).first < *key)) {
+            key = &(*boundary).first;
+        }
+        const K at = *key;
+
+        if (boundary != boundariesEnd && !(at < (*boundary).first)) {
+            existingValue = (*boundary).second;
+            ++boundary;
+        }
+        if (haveSegmentEdge) {
+            if (inSegment && !(at < segments[segment].end)) {
+                ++segment;
+                inSegment = segment < segments.size() && !(at < segments[segment].start);
+            } else if (!inSegment && !(at < segments[segment].start)) {
+                inSegment = true;
+            }
+        }
+
+        const std::optional<V> effective = inSegment ? std::optional<V>(segments[segment].value) : existingValue;
+        if (effective != emitted) {
+            emit(at, effective);
+            emitted = effective;
+        }
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+/*
+    Interval map on std::map: the reference implementation.
+
+    An interval map assigns a value to half-open key ranges [start, end). It is stored as boundaries: each
+    entry says "from this key up to the next entry, the value is ...", so a lookup is the entry at or
+    before the key. Keys never assigned have no value, stored as a boundary holding std::nullopt where an
+    interval ends without another one starting.
+
+    The representation is canonical: two consecutive entries never hold the same value, so adjacent or
+    overlapping ranges of equal values coalesce into one, and a map has exactly one representation for
+    what it contains. That is what lets the other backends be compared against this one entry by entry.
+
+    Every other interval map in this directory has the same set/get semantics and is tested against this
+    one; it is the simplest to convince oneself of, not the fastest.
+*/
+
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "interval_batch.hpp"
+#include "interval_views.hpp"
+
+template<typename K, typename V>
+class IntervalMap {
+public:
+    using Boundary = std::pair<K, std::optional<V>>;
+    using View = BoundaryView<K, V, typename std::map<K, std::optional<V>>::const_iterator>;
+
+    // Assigns value to every key in [start, end); an empty or reversed range changes nothing
+    void set(const K& start, const K& end, const V& value) {
+        if (!(start < end)) {
+            return;
+        }
+        const std::optional<V> after = find(end); // What end and the keys after it keep
+
+        auto first = intervals.lower_bound(start);
+        const bool changesBefore = first == intervals.begin() || std::prev(first)->second != value;
+        auto last = intervals.upper_bound(end);
+        auto hint = intervals.erase(first, last);
+
+        // Boundaries only where the value changes
+        if (after != value) {
+            hint = intervals.emplace_hint(hint, end, after);
+        }
+        if (changesBefore) {
+            intervals.emplace_hint(hint, start, value);
+        }
+    }
+
+    // Same result as set() for each range in order (interval_batch.hpp). A merge pass rebuilds every node,
+    // so a batch that resolves to few segments for the map's size is applied in place instead.
+    void setMany(std::span<const IntervalEntry<K, V>> ranges) {
+        const auto segments = resolveBatch(ranges);
+        if (segments.size() * inPlaceRatio < intervals.size()) {
+            for (const auto& segment : segments) { // Non-overlapping: the order no longer matters
+                set(segment.start, segment.end, segment.value);
+            }
+            return;
+        }
+        std::map<K, std::optional<V>> merged;
+        overlayBoundaries(intervals, segments, [&](const K& key, const std::optional<V>& value) {
+            merged.emplace_hint(merged.end(), key, value);
+        });
+        intervals.swap(merged);
+    }
+
+    // Throws std::out_of_range if no interval contains key
+    const V& get(const K& key) const {
+        const std::optional<V>& value = lookup(key);
+        if (!value) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return *value;
+    }
+
+    std::optional<V> find(const K& key) const {
+        return lookup(key);
+    }
+
+    // Lazy view of every interval overlapping [low, high), whole (interval_views.hpp); valid until the
+    // next set() or setMany()
+    View overlapping(const K& low, const K& high) const {
+        return view(low, high, false);
+    }
+
+    // Same as overlapping(), with each interval cut to [low, high)
+    View within(const K& low, const K& high) const {
+        return view(low, high, true);
+    }
+
+    bool empty() const {
+        return intervals.empty();
+    }
+
+    // Number of boundaries, including the ones closing a gap
+    std::size_t size() const {
+        return intervals.size();
+    }
+
+    // The canonical boundary list, for comparing backends
+    std::vector<Boundary> boundaries() const {
+        return {intervals.begin(), intervals.end()};
+    }
+
+    void print() const {
+        for (auto it = intervals.begin(); it != intervals.end(); ++it) {
+            auto next = std::next(it);
+            if (it->second && next != intervals.end()) {
+                std::cout << "[" << it->first << ", " << next->first << "): " << *it->second << "\n";
+            }
+        }
+    }
+
+private:
+    // Three tree descents per set() against one allocation per node for a rebuild
+    static constexpr std::size_t inPlaceRatio = 8;
+
+    View view(const K& low, const K& high, bool clip) const {
+        if (!(low < high)) {
+            return {};
+        }
+        auto first = intervals.upper_bound(low);
+        if (first != intervals.begin()) {
+            --first; // The piece containing low
+        }
+        return {first, intervals.lower_bound(high), low, high, clip};
+    }
+
+    const std::optional<V>& lookup(const K& key) const {
+        static const std::optional<V> uncovered;
+        auto it = intervals.upper_bound(key);
+        return it == intervals.begin() ? uncovered : std::prev(it)->second;
+    }
+
+    std::map<K, std::optional<V>> intervals;
+};
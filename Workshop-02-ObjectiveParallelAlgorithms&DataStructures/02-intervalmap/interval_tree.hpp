@@ -0,0 +1,293 @@
+#pragma once
+
+/*
+    Interval tree: the multi-valued mode, where overlapping intervals coexist.
+
+    IntervalMap keeps one value per key, so a later set() replaces what it overlaps. Audit and scheduling
+    data is the other kind: every interval stays, overlapping or not, and the questions are "which intervals
+    overlap this window" and "which ones contain this key". IntervalTree stores the intervals themselves, in
+    an augmented search tree:
+
+    - Nodes are ordered by (start, end) and balanced as a treap, like PersistentIntervalMap, but mutable
+      and owning their children.
+    - Each node also keeps maxEnd, the largest end in its subtree. A query skips any subtree whose maxEnd is
+      at or before the window's start, and stops at the first node starting at or after the window's end,
+      so it costs O(log n + k) expected for k results instead of a scan of all n intervals.
+    - overlapping() and containing() return lazy views: the iterator keeps the path of the in-order walk on
+      a small stack and finds the next match only when advanced. Elements are the stored IntervalEntry
+      objects, not copies.
+
+    Equal intervals may be inserted any number of times; erase() removes one with the given bounds and
+    value. Views are valid until the next insert() or erase().
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <ranges>
+#include <utility>
+#include <vector>
+
+#include "interval_batch.hpp"
+
+template<typename K, typename V>
+class IntervalTree {
+    struct Node {
+        IntervalEntry<K, V> entry;
+        K maxEnd;               // Largest end in this subtree
+        std::uint64_t priority; // Heap order: a parent's priority is at least its children's
+        std::unique_ptr<Node> left;
+        std::unique_ptr<Node> right;
+    };
+
+public:
+    // In-order walk over the intervals matching a query, by (start, end)
+    class Iterator {
+    public:
+        using value_type = IntervalEntry<K, V>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        const IntervalEntry<K, V>& operator*() const {
+            return current->entry;
+        }
+
+        const IntervalEntry<K, V>* operator->() const {
+            return &current->entry;
+        }
+
+        Iterator& operator++() {
+            advance();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            advance();
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return current == other.current;
+        }
+
+        bool operator==(std::default_sentinel_t) const {
+            return current == nullptr;
+        }
+
+    private:
+        friend class IntervalTree;
+
+        // Intervals overlapping [low, high), or with point, the ones containing low
+        Iterator(const Node* root, const K& low, const K& high, bool point) : low(low), high(high), point(point) {
+            pushLeft(root);
+            advance();
+        }
+
+        // Down the left spine, leaving out subtrees that end at or before low
+        void pushLeft(const Node* node) {
+            while (node != nullptr && low < node->maxEnd) {
+                path.push_back(node);
+                node = node->left.get();
+            }
+        }
+
+        bool startsAfterQuery(const K& start) const {
+            return point ? low < start : !(start < high);
+        }
+
+        void advance() {
+            current = nullptr;
+            while (!path.empty()) {
+                const Node* node = path.back();
+                path.pop_back();
+                if (startsAfterQuery(node->entry.start)) {
+                    path.clear(); // Every later node starts at or after this one
+                    return;
+                }
+                pushLeft(node->right.get());
+                if (low < node->entry.end) {
+                    current = node;
+                    return;
+                }
+            }
+        }
+
+        std::vector<const Node*> path; // Nodes whose own interval and right subtree are still to visit
+        const Node* current = nullptr;
+        K low{};
+        K high{};
+        bool point = false;
+    };
+
+    class View : public std::ranges::view_interface<View> {
+    public:
+        View() = default;
+
+        Iterator begin() const {
+            return root == nullptr ? Iterator() : Iterator(root, low, high, point);
+        }
+
+        std::default_sentinel_t end() const {
+            return {};
+        }
+
+    private:
+        friend class IntervalTree;
+
+        View(const Node* root, const K& low, const K& high, bool point)
+            : root(root), low(low), high(high), point(point) {}
+
+        const Node* root = nullptr;
+        K low{};
+        K high{};
+        bool point = false;
+    };
+
+    IntervalTree() = default;
+    IntervalTree(IntervalTree&&) noexcept = default;
+    IntervalTree& operator=(IntervalTree&&) noexcept = default;
+
+    // Adds [start, end) with value, next to whatever it overlaps; an empty or reversed range is ignored
+    void insert(const K& start, const K& end, const V& value) {
+        if (!(start < end)) {
+            return;
+        }
+        auto node = std::make_unique<Node>(Node{{start, end, value}, end, nextPriority(), nullptr, nullptr});
+        root = insert(std::move(root), std::move(node));
+        ++count;
+    }
+
+    // Removes one interval equal to [start, end) with value; returns false if there is none
+    bool erase(const K& start, const K& end, const V& value) {
+        if (!erase(root, start, end, value)) {
+            return false;
+        }
+        --count;
+        return true;
+    }
+
+    // Lazy view of the intervals overlapping [low, high), by (start, end)
+    View overlapping(const K& low, const K& high) const {
+        return low < high ? View(root.get(), low, high, false) : View();
+    }
+
+    // Lazy view of the intervals containing key
+    View containing(const K& key) const {
+        return View(root.get(), key, key, true);
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+private:
+    static bool before(const IntervalEntry<K, V>& entry, const K& start, const K& end) {
+        return entry.start < start || (!(start < entry.start) && entry.end < end);
+    }
+
+    static void update(Node& node) {
+        node.maxEnd = node.entry.end;
+        for (const Node* child : {node.left.get(), node.right.get()}) {
+            if (child != nullptr && node.maxEnd < child->maxEnd) {
+                node.maxEnd = child->maxEnd;
+            }
+        }
+    }
+
+    // Splits into the nodes ordered before (start, end) and the rest
+    static std::pair<std::unique_ptr<Node>, std::unique_ptr<Node>> split(std::unique_ptr<Node> node, const K& start,
+                                                                         const K& end) {
+        if (!node) {
+            return {};
+        }
+        if (before(node->entry, start, end)) {
+            auto [first, second] = split(std::move(node->right), start, end);
+            node->right = std::move(first);
+            update(*node);
+            return {std::move(node), std::move(second)};
+        }
+        auto [first, second] = split(std::move(node->left), start, end);
+        node->left = std::move(second);
+        update(*node);
+        return {std::move(first), std::move(node)};
+    }
+
+    // Every node of first is ordered before every node of second
+    static std::unique_ptr<Node> join(std::unique_ptr<Node> first, std::unique_ptr<Node> second) {
+        if (!first) {
+            return second;
+        }
+        if (!second) {
+            return first;
+        }
+        if (first->priority > second->priority) {
+            first->right = join(std::move(first->right), std::move(second));
+            update(*first);
+            return first;
+        }
+        second->left = join(std::move(first), std::move(second->left));
+        update(*second);
+        return second;
+    }
+
+    static std::unique_ptr<Node> insert(std::unique_ptr<Node> node, std::unique_ptr<Node> added) {
+        if (!node) {
+            return added;
+        }
+        if (added->priority > node->priority) {
+            auto [first, second] = split(std::move(node), added->entry.start, added->entry.end);
+            added->left = std::move(first);
+            added->right = std::move(second);
+            update(*added);
+            return added;
+        }
+        if (before(added->entry, node->entry.start, node->entry.end)) {
+            node->left = insert(std::move(node->left), std::move(added));
+        } else {
+            node->right = insert(std::move(node->right), std::move(added));
+        }
+        update(*node);
+        return node;
+    }
+
+    // Equal intervals can sit on both sides of a node with the same bounds, so both are searched
+    static bool erase(std::unique_ptr<Node>& node, const K& start, const K& end, const V& value) {
+        if (!node) {
+            return false;
+        }
+        bool erased;
+        if (before(node->entry, start, end)) {
+            erased = erase(node->right, start, end, value);
+        } else if (start < node->entry.start || end < node->entry.end) {
+            erased = erase(node->left, start, end, value);
+        } else if (node->entry.value == value) {
+            node = join(std::move(node->left), std::move(node->right));
+            return true;
+        } else {
+            erased = erase(node->left, start, end, value) || erase(node->right, start, end, value);
+        }
+        if (erased) {
+            update(*node);
+        }
+        return erased;
+    }
+
+    std::uint64_t nextPriority() {
+        // splitmix64, as in PersistentIntervalMap
+        std::uint64_t mixed = (priorityState += 0x9e37'79b9'7f4a'7c15ull);
+        mixed = (mixed ^ (mixed >> 30)) * 0xbf58'476d'1ce4'e5b9ull;
+        mixed = (mixed ^ (mixed >> 27)) * 0x94d0'49bb'1331'11ebull;
+        return mixed ^ (mixed >> 31);
+    }
+
+    std::unique_ptr<Node> root;
+    std::size_t count = 0;
+    std::uint64_t priorityState = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+    Lazy range views over interval boundaries.
+
+    Range queries on an interval map, "which intervals overlap [low, high)", "walk the ranges between low
+    and high", used to mean copying boundaries() and scanning all of it. A BoundaryView instead holds two
+    iterators into the map's own boundaries: the piece containing low, and the first boundary at or after
+    high. Building one is two O(log n) searches, and iterating it visits only the pieces in between, skipping
+    the gaps. Nothing is copied: each element is an IntervalSlice whose value refers to the value stored in
+    the map.
+
+    A view is valid as long as the map is not modified, like the map iterators it holds.
+*/
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <ranges>
+
+// One interval of a view: [start, end) holds value, which refers into the map
+template<typename K, typename V>
+struct IntervalSlice {
+    K start;
+    K end;
+    const V& value;
+};
+
+// The intervals of a canonical boundary sequence (pairs of key and std::optional<V>, sorted by key, the
+// last one closing the map) that overlap [low, high). With clip, each one is cut to [low, high).
+template<typename K, typename V, typename BoundaryIterator>
+class BoundaryView : public std::ranges::view_interface<BoundaryView<K, V, BoundaryIterator>> {
+public:
+    class Iterator {
+    public:
+        using value_type = IntervalSlice<K, V>;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+
+        IntervalSlice<K, V> operator*() const {
+            const K& start = current->first;
+            const K& end = std::next(current)->first; // A piece with a value always has a next boundary
+            if (!clip) {
+                return {start, end, *current->second};
+            }
+            return {start < low ? low : start, high < end ? high : end, *current->second};
+        }
+
+        Iterator& operator++() {
+            ++current;
+            skipGaps();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return current == other.current;
+        }
+
+    private:
+        friend class BoundaryView;
+
+        Iterator(BoundaryIterator current, BoundaryIterator stop, const K& low, const K& high, bool clip)
+            : current(current), stop(stop), low(low), high(high), clip(clip) {
+            skipGaps();
+        }
+
+        void skipGaps() {
+            while (current != stop && !current->second) {
+                ++current;
+            }
+        }
+
+        BoundaryIterator current{};
+        BoundaryIterator stop{};
+        K low{};
+        K high{};
+        bool clip = false;
+    };
+
+    BoundaryView() = default;
+
+    // first: the boundary of the piece containing low, or the first one after it; stop: the first boundary
+    // at or after high
+    BoundaryView(BoundaryIterator first, BoundaryIterator stop, const K& low, const K& high, bool clip)
+        : first(first), stop(stop), low(low), high(high), clip(clip) {}
+
+    Iterator begin() const {
+        return {first, stop, low, high, clip};
+    }
+
+    Iterator end() const {
+        return {stop, stop, low, high, clip};
+    }
+
+private:
+    BoundaryIterator first{};
+    BoundaryIterator stop{};
+    K low{};
+    K high{};
+    bool clip = false;
+};
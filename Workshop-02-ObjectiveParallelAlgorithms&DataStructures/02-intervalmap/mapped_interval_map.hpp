@@ -0,0 +1,340 @@
+#pragma once
+
+/*
+    Read-only interval map in a memory-mapped file: a table is built offline once and mapped at startup.
+
+    Loading a multi-million range table by replaying set() costs seconds on every start, and every process
+    holds its own copy. Here the canonical boundaries are written to a file in the layout the lookups use,
+    and the reader maps it and searches it in place: nothing is decoded or copied, startup costs the pages
+    the lookups actually touch, and processes mapping the same file share one copy in the page cache.
+
+    Layout, in host byte order (the header records which one), every section starting on a page boundary
+    so that the arrays are aligned for their types straight from the mapping:
+    - MappedIntervalHeader: magic, format version, byte-order tag, key and value sizes, boundary count,
+      section offsets, file size, table version, a checksum of the body and one of the header itself
+    - keys:    boundaryCount sorted K
+    - values:  boundaryCount V, values[i] holding from keys[i] up to keys[i + 1]
+    - present: one bit per boundary, clear where values[i] is std::nullopt (the end of an interval)
+
+    K and V must be trivially copyable; the file records their sizes and a reader of other types rejects it.
+
+    Opening validates the header, its checksum and the section bounds, which touches the first page only.
+    MappedCheck::Full also checksums the body, which reads the whole file: use it where a file arrives, and
+    Header where the same, already verified, file is mapped again for a fast start.
+
+    write() builds the file in memory, writes it next to its final name, flushes it to disk, renames it
+    over the old one and flushes the directory (common/replace_file.hpp), so a reader maps the old table or
+    the new one, never half of one, even across a crash. Without POSIX, the
+    file is read into memory instead of mapped.
+
+    Lookup semantics are those of IntervalMap (interval_map.hpp).
+*/
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "../common/replace_file.hpp"
+
+struct MappedIntervalHeader {
+    static constexpr char expectedMagic[8] = {'I', 'V', 'L', 'M', 'A', 'P', '\0', '\0'};
+    static constexpr std::uint32_t currentFormat = 1;
+    static constexpr std::uint32_t byteOrderTag = 0x01020304;
+    static constexpr std::uint64_t pageSize = 4096;
+
+    char magic[8];
+    std::uint32_t format;
+    std::uint32_t byteOrder;
+    std::uint32_t keySize;
+    std::uint32_t valueSize;
+    std::uint64_t boundaryCount;
+    std::uint64_t keysOffset;
+    std::uint64_t valuesOffset;
+    std::uint64_t presentOffset;
+    std::uint64_t fileSize;
+    std::uint64_t tableVersion;
+    std::uint64_t bodyChecksum;   // mappedChecksum of everything from the first page boundary on
+    std::uint64_t headerChecksum; // mappedChecksum of the header up to this field
+};
+
+static_assert(sizeof(MappedIntervalHeader) == 88, "The file layout has no padding to hide");
+
+// How much of the file opening verifies
+enum class MappedCheck {
+    Header, // Header and section bounds: first page only
+    Full,   // Also the body checksum: reads the whole file
+};
+
+// Word-at-a-time multiplicative hash: catches truncation and bit rot at memory speed, not an adversary
+inline std::uint64_t mappedChecksum(std::span<const std::byte> bytes) {
+    std::uint64_t hash = 0x9e3779b97f4a7c15ull ^ bytes.size();
+    std::size_t offset = 0;
+    for (; offset + 8 <= bytes.size(); offset += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes.data() + offset, sizeof(word));
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    for (; offset < bytes.size(); ++offset) {
+        hash = (hash ^ static_cast<std::uint64_t>(bytes[offset])) * 0xc4ceb9fe1a85ec53ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+template<typename K, typename V>
+class MappedIntervalMap {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>,
+                  "Mapped keys and values are used in place and must be trivially copyable");
+
+public:
+    using Boundary = std::pair<K, std::optional<V>>;
+
+    // Writes canonical boundaries sorted by key, as returned by IntervalMap::boundaries(), and atomically and
+    // durably replaces path with them; throws std::system_error if the file cannot be written
+    static void write(const std::string& path, const std::vector<Boundary>& boundaries,
+                      std::uint64_t tableVersion = 0) {
+        const std::uint64_t count = boundaries.size();
+        MappedIntervalHeader header{};
+        std::memcpy(header.magic, MappedIntervalHeader::expectedMagic, sizeof(header.magic));
+        header.format = MappedIntervalHeader::currentFormat;
+        header.byteOrder = MappedIntervalHeader::byteOrderTag;
+        header.keySize = sizeof(K);
+        header.valueSize = sizeof(V);
+        header.boundaryCount = count;
+        header.keysOffset = MappedIntervalHeader::pageSize;
+        header.valuesOffset = pageAligned(header.keysOffset + count * sizeof(K));
+        header.presentOffset = pageAligned(header.valuesOffset + count * sizeof(V));
+        header.fileSize = pageAligned(header.presentOffset + presentWords(count) * sizeof(std::uint64_t));
+        header.tableVersion = tableVersion;
+
+        std::vector<std::byte> file(header.fileSize);
+        std::vector<std::uint64_t> present(presentWords(count), 0);
+        for (std::size_t index = 0; index < boundaries.size(); ++index) {
+            std::memcpy(file.data() + header.keysOffset + index * sizeof(K), &boundaries[index].first, sizeof(K));
+            if (boundaries[index].second) {
+                std::memcpy(file.data() + header.valuesOffset + index * sizeof(V), &*boundaries[index].second,
+                            sizeof(V));
+                present[index / 64] |= std::uint64_t{1} << (index % 64);
+            }
+        }
+        if (!present.empty()) {
+            std::memcpy(file.data() + header.presentOffset, present.data(), present.size() * sizeof(std::uint64_t));
+        }
+
+        header.bodyChecksum = mappedChecksum(std::span<const std::byte>(file).subspan(MappedIntervalHeader::pageSize));
+        header.headerChecksum = headerChecksumOf(header);
+        std::memcpy(file.data(), &header, sizeof(header));
+        replaceFile(path, file);
+    }
+
+    // Maps and validates the file; throws std::system_error if it cannot be read, std::runtime_error if it
+    // is not a valid table of this format and these key and value types
+    explicit MappedIntervalMap(const std::string& path, MappedCheck check = MappedCheck::Full) {
+        load(path);
+        if (bytes.size() < MappedIntervalHeader::pageSize) {
+            throw std::runtime_error(path + ": too short for a mapped interval map");
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, MappedIntervalHeader::expectedMagic, sizeof(header.magic)) != 0) {
+            throw std::runtime_error(path + ": not a mapped interval map");
+        }
+        if (header.byteOrder != MappedIntervalHeader::byteOrderTag) {
+            throw std::runtime_error(path + ": written on a machine of the other byte order");
+        }
+        if (header.format != MappedIntervalHeader::currentFormat) {
+            throw std::runtime_error(path + ": format " + std::to_string(header.format) + ", this build reads format " +
+                                     std::to_string(MappedIntervalHeader::currentFormat));
+        }
+        if (headerChecksumOf(header) != header.headerChecksum) {
+            throw std::runtime_error(path + ": header checksum mismatch");
+        }
+        if (header.keySize != sizeof(K) || header.valueSize != sizeof(V)) {
+            throw std::runtime_error(path + ": written for other key or value types");
+        }
+        const std::uint64_t count = header.boundaryCount;
+        if (header.fileSize != bytes.size() || count > bytes.size() ||
+            header.keysOffset != MappedIntervalHeader::pageSize ||
+            header.valuesOffset != pageAligned(header.keysOffset + count * sizeof(K)) ||
+            header.presentOffset != pageAligned(header.valuesOffset + count * sizeof(V)) ||
+            header.fileSize != pageAligned(header.presentOffset + presentWords(count) * sizeof(std::uint64_t))) {
+            throw std::runtime_error(path + ": truncated or inconsistent file");
+        }
+        if (check == MappedCheck::Full &&
+            mappedChecksum(bytes.subspan(MappedIntervalHeader::pageSize)) != header.bodyChecksum) {
+            throw std::runtime_error(path + ": checksum mismatch");
+        }
+        keys = reinterpret_cast<const K*>(bytes.data() + header.keysOffset);
+        values = reinterpret_cast<const V*>(bytes.data() + header.valuesOffset);
+        present = reinterpret_cast<const std::uint64_t*>(bytes.data() + header.presentOffset);
+    }
+
+    MappedIntervalMap(const MappedIntervalMap&) = delete;
+    MappedIntervalMap& operator=(const MappedIntervalMap&) = delete;
+
+    // Throws std::out_of_range if no interval contains key
+    const V& get(const K& key) const {
+        const std::size_t position = upperBound(key);
+        if (position == 0 || !hasValue(position - 1)) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return values[position - 1];
+    }
+
+    std::optional<V> find(const K& key) const {
+        const std::size_t position = upperBound(key);
+        if (position == 0 || !hasValue(position - 1)) {
+            return std::nullopt;
+        }
+        return values[position - 1];
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    std::size_t size() const {
+        return static_cast<std::size_t>(header.boundaryCount);
+    }
+
+    std::uint64_t tableVersion() const {
+        return header.tableVersion;
+    }
+
+    std::size_t fileBytes() const {
+        return bytes.size();
+    }
+
+    // Decodes the whole table; for comparing against the other backends
+    std::vector<Boundary> boundaries() const {
+        std::vector<Boundary> result;
+        result.reserve(size());
+        for (std::size_t index = 0; index < size(); ++index) {
+            result.emplace_back(keys[index], hasValue(index) ? std::optional<V>(values[index]) : std::nullopt);
+        }
+        return result;
+    }
+
+private:
+    static std::uint64_t pageAligned(std::uint64_t offset) {
+        return (offset + MappedIntervalHeader::pageSize - 1) / MappedIntervalHeader::pageSize *
+               MappedIntervalHeader::pageSize;
+    }
+
+    static std::uint64_t presentWords(std::uint64_t count) {
+        return (count + 63) / 64;
+    }
+
+    static std::uint64_t headerChecksumOf(const MappedIntervalHeader& header) {
+        return mappedChecksum(std::span<const std::byte>(reinterpret_cast<const std::byte*>(&header),
+                                                         offsetof(MappedIntervalHeader, headerChecksum)));
+    }
+
+    bool hasValue(std::size_t index) const {
+        return (present[index / 64] >> (index % 64)) & 1;
+    }
+
+    // Index of the first boundary above key, by the branchless search of FlatIntervalMap
+    std::size_t upperBound(const K& key) const {
+        std::size_t length = size();
+        if (length == 0) {
+            return 0;
+        }
+        const K* base = keys;
+        while (length > 1) {
+            const std::size_t half = length / 2;
+            base = key < base[half] ? base : base + half;
+            length -= half;
+        }
+        return static_cast<std::size_t>(base - keys) + (key < *base ? 0 : 1);
+    }
+
+#if defined(__unix__) || defined(__APPLE__)
+    void load(const std::string& path) {
+        const int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+        }
+        struct stat status;
+        if (::fstat(descriptor, &status) != 0) {
+            const int error = errno;
+            ::close(descriptor);
+            throw std::system_error(error, std::generic_category(), "cannot stat " + path);
+        }
+        const auto size = static_cast<std::size_t>(status.st_size);
+        if (size == 0) {
+            ::close(descriptor);
+            return; // mmap rejects empty mappings; the size check reports the file
+        }
+        // Shared: every process mapping the table reads the same page cache pages
+        void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, descriptor, 0);
+        ::close(descriptor); // The mapping keeps the file open
+        if (mapped == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "cannot map " + path);
+        }
+        mapping.address = mapped;
+        mapping.size = size;
+        bytes = std::span<const std::byte>(static_cast<const std::byte*>(mapped), size);
+    }
+
+    // Unmapped also when the constructor throws after mapping
+    struct Mapping {
+        Mapping() = default;
+        Mapping(const Mapping&) = delete;
+        Mapping& operator=(const Mapping&) = delete;
+
+        ~Mapping() {
+            if (address != nullptr) {
+                ::munmap(address, size);
+            }
+        }
+
+        void* address = nullptr;
+        std::size_t size = 0;
+    };
+
+    Mapping mapping;
+#else
+    void load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::system_error(std::make_error_code(std::errc::no_such_file_or_directory), "cannot open " + path);
+        }
+        // Page-aligned like a mapping, so the arrays stay aligned for their types
+        contents.resize((static_cast<std::size_t>(in.tellg()) + sizeof(Page) - 1) / sizeof(Page));
+        const std::size_t size = static_cast<std::size_t>(in.tellg());
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(contents.data()), static_cast<std::streamsize>(size));
+        bytes = std::span<const std::byte>(reinterpret_cast<const std::byte*>(contents.data()), size);
+    }
+
+    struct alignas(4096) Page {
+        std::byte bytes[4096];
+    };
+
+    std::vector<Page> contents;
+#endif
+
+    std::span<const std::byte> bytes;
+    MappedIntervalHeader header{};
+    const K* keys = nullptr;
+    const V* values = nullptr;
+    const std::uint64_t* present = nullptr;
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+/*
+    Persistent interval map: every set() makes a new version and leaves the old ones intact.
+
+    Readers want a view that holds still for a whole batch, and operators want to ask what the map looked
+    like at version N, while updates keep coming. Copying the map per version costs O(n) each time; here
+    the boundaries live in an immutable balanced search tree (a treap) and set() copies only the nodes on
+    the paths it changes:
+
+    - set(start, end, value) splits the tree at start and after end, drops the boundaries in between and
+      joins the two sides around at most two new boundaries, exactly as IntervalMap does. Split and join
+      copy the nodes along their search paths, O(log n) expected, and share every other subtree with the
+      previous version.
+    - snapshot() is O(1): a Snapshot is the root pointer and the version number. It is immutable, so any
+      number of threads can read it without a lock; copying or dropping one only touches reference counts.
+    - The last historyDepth versions stay reachable through at(version). Nodes are reference counted and a
+      version's nodes are freed as soon as neither the history nor any Snapshot references them, with no
+      collection pass and no pause for the readers.
+
+    Node priorities come from a per-map generator, so the tree shape is that of a random treap whatever the
+    order of updates. set(), snapshot() and at() belong to the writer: call them from one thread, or under
+    the caller's lock, and hand the Snapshot to the readers.
+
+    Semantics and the canonical boundary form are those of IntervalMap (interval_map.hpp).
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+template<typename K, typename V>
+class PersistentIntervalMap {
+    struct Node;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    struct Node {
+        K key;
+        std::optional<V> value; // From key up to the next boundary
+        std::uint64_t priority; // Heap order: a parent's priority is at least its children's
+        std::size_t count;      // Boundaries in this subtree
+        NodePtr left;
+        NodePtr right;
+    };
+
+public:
+    using Boundary = std::pair<K, std::optional<V>>;
+
+    // An immutable version of the map, readable from any thread
+    class Snapshot {
+    public:
+        Snapshot() = default;
+
+        // Throws std::out_of_range if no interval contains key
+        const V& get(const K& key) const {
+            const std::optional<V>* value = lastNotAfter(root.get(), key);
+            if (value == nullptr || !*value) {
+                throw std::out_of_range("Key is not in any interval.");
+            }
+            return **value;
+        }
+
+        std::optional<V> find(const K& key) const {
+            const std::optional<V>* value = lastNotAfter(root.get(), key);
+            return value == nullptr ? std::nullopt : *value;
+        }
+
+        bool empty() const {
+            return root == nullptr;
+        }
+
+        std::size_t size() const {
+            return countOf(root);
+        }
+
+        std::uint64_t version() const {
+            return versionNumber;
+        }
+
+        std::vector<Boundary> boundaries() const {
+            std::vector<Boundary> result;
+            result.reserve(size());
+            appendInOrder(root.get(), result);
+            return result;
+        }
+
+        void print() const {
+            const auto all = boundaries();
+            for (std::size_t index = 0; index + 1 < all.size(); ++index) {
+                if (all[index].second) {
+                    std::cout << "[" << all[index].first << ", " << all[index + 1].first << "): "
+                              << *all[index].second << "\n";
+                }
+            }
+        }
+
+    private:
+        friend class PersistentIntervalMap;
+
+        Snapshot(NodePtr root, std::uint64_t version) : root(std::move(root)), versionNumber(version) {}
+
+        NodePtr root;
+        std::uint64_t versionNumber = 0;
+    };
+
+    // historyDepth: how many versions before the current one at() can still return
+    explicit PersistentIntervalMap(std::size_t historyDepth = 0) : historyDepth(historyDepth) {}
+
+    // Same as IntervalMap::set, as a new version
+    void set(const K& start, const K& end, const V& value) {
+        if (!(start < end)) {
+            return;
+        }
+        const NodePtr& root = current.root;
+        const std::optional<V> after = current.find(end); // What end and the keys after it keep
+        const std::optional<V>* before = lastBefore(root.get(), start);
+        const bool changesBefore = before == nullptr || *before != value;
+
+        auto [left, rest] = split(root, start, false);   // left: boundaries < start
+        auto [inside, right] = split(rest, end, true);   // inside: start <= boundary <= end, dropped
+
+        // Boundaries only where the value changes
+        NodePtr middle;
+        if (changesBefore) {
+            middle = leaf(start, value);
+        }
+        if (after != value) {
+            middle = join(middle, leaf(end, after));
+        }
+        commit(join(join(left, middle), right));
+    }
+
+    // Throws std::out_of_range if no interval contains key
+    const V& get(const K& key) const {
+        return current.get(key);
+    }
+
+    std::optional<V> find(const K& key) const {
+        return current.find(key);
+    }
+
+    bool empty() const {
+        return current.empty();
+    }
+
+    std::size_t size() const {
+        return current.size();
+    }
+
+    std::vector<Boundary> boundaries() const {
+        return current.boundaries();
+    }
+
+    void print() const {
+        current.print();
+    }
+
+    // Versions created so far: one per set() with a non-empty range
+    std::uint64_t version() const {
+        return current.version();
+    }
+
+    // O(1): the current version, unaffected by later set() calls
+    Snapshot snapshot() const {
+        return current;
+    }
+
+    // The map as of version, if it is the current one or still in the history
+    std::optional<Snapshot> at(std::uint64_t version) const {
+        if (version == current.version()) {
+            return current;
+        }
+        if (history.empty() || version < history.front().version() || version > history.back().version()) {
+            return std::nullopt;
+        }
+        return history[static_cast<std::size_t>(version - history.front().version())];
+    }
+
+private:
+    static std::size_t countOf(const NodePtr& node) {
+        return node ? node->count : 0;
+    }
+
+    // Value of the last boundary <= key, nullptr if there is none
+    static const std::optional<V>* lastNotAfter(const Node* node, const K& key) {
+        const std::optional<V>* found = nullptr;
+        while (node != nullptr) {
+            if (key < node->key) {
+                node = node->left.get();
+            } else {
+                found = &node->value;
+                node = node->right.get();
+            }
+        }
+        return found;
+    }
+
+    // Value of the last boundary < key, nullptr if there is none
+    static const std::optional<V>* lastBefore(const Node* node, const K& key) {
+        const std::optional<V>* found = nullptr;
+        while (node != nullptr) {
+            if (node->key < key) {
+                found = &node->value;
+                node = node->right.get();
+            } else {
+                node = node->left.get();
+            }
+        }
+        return found;
+    }
+
+    static void appendInOrder(const Node* node, std::vector<Boundary>& result) {
+        while (node != nullptr) {
+            appendInOrder(node->left.get(), result);
+            result.emplace_back(node->key, node->value);
+            node = node->right.get();
+        }
+    }
+
+    // A copy of node with new children: the only way nodes change
+    static NodePtr withChildren(const Node& node, NodePtr left, NodePtr right) {
+        const std::size_t count = 1 + countOf(left) + countOf(right);
+        return std::make_shared<const Node>(
+            Node{node.key, node.value, node.priority, count, std::move(left), std::move(right)});
+    }
+
+    // Splits into the boundaries before key and the rest; inclusive puts key itself into the first part
+    static std::pair<NodePtr, NodePtr> split(const NodePtr& node, const K& key, bool inclusive) {
+        if (!node) {
+            return {};
+        }
+        const bool inFirst = inclusive ? !(key < node->key) : node->key < key;
+        if (inFirst) {
+            auto [first, second] = split(node->right, key, inclusive);
+            return {withChildren(*node, node->left, std::move(first)), std::move(second)};
+        }
+        auto [first, second] = split(node->left, key, inclusive);
+        return {std::move(first), withChildren(*node, std::move(second), node->right)};
+    }
+
+    // Every key of first is below every key of second
+    static NodePtr join(const NodePtr& first, const NodePtr& second) {
+        if (!first) {
+            return second;
+        }
+        if (!second) {
+            return first;
+        }
+        if (first->priority > second->priority) {
+            return withChildren(*first, first->left, join(first->right, second));
+        }
+        return withChildren(*second, join(first, second->left), second->right);
+    }
+
+    NodePtr leaf(const K& key, const std::optional<V>& value) {
+        // splitmix64: well spread priorities from a counter
+        std::uint64_t mixed = (priorityState += 0x9e37'79b9'7f4a'7c15ull);
+        mixed = (mixed ^ (mixed >> 30)) * 0xbf58'476d'1ce4'e5b9ull;
+        mixed = (mixed ^ (mixed >> 27)) * 0x94d0'49bb'1331'11ebull;
+        mixed ^= mixed >> 31;
+        return std::make_shared<const Node>(Node{key, value, mixed, 1, nullptr, nullptr});
+    }
+
+    void commit(NodePtr root) {
+        if (historyDepth > 0) {
+            history.push_back(current);
+            if (history.size() > historyDepth) {
+                history.pop_front(); // Its nodes go once no Snapshot still holds them
+            }
+        }
+        current = Snapshot(std::move(root), current.version() + 1);
+    }
+
+    Snapshot current;
+    std::deque<Snapshot> history; // The versions before current, oldest first
+    std::size_t historyDepth;
+    std::uint64_t priorityState = 0;
+};
@@ -0,0 +1,567 @@
+#pragma once
+
+/*
+    Longest-prefix-match route tables for IPv4 and IPv6, next to IntervalMap.
+
+    A routing table can be flattened into an IntervalMap: set the prefixes from the shortest to the
+    longest and every address range ends up with its most specific route. But each lookup is then a
+    search over millions of boundaries, and deleting a prefix means flattening again. These tables keep
+    the prefixes themselves and answer a lookup in one to a few memory accesses:
+
+    - Ipv4RouteTable is DIR-24-8. tbl24 has one 32-bit entry per /24, indexed by the top 24 bits of the
+      address: either the route of the longest prefix of at most 24 bits covering it, or the index of a
+      256-entry tbl8 group for the last 8 bits, used where a longer prefix exists. A lookup is one load,
+      or two for the few /24s with longer prefixes. The 64 MB of tbl24 come from calloc, so only the
+      pages that routes were written to are ever backed by memory.
+    - Ipv6RouteTable is a multibit trie with one byte of the address per level. Nodes are compressed with
+      bitmaps, as in Tree Bitmap and Poptrie: a 256-bit mask says which bytes have a child and another
+      which have a route, and the children and routes are stored densely, indexed by the popcount of the
+      mask below the byte. A lookup descends one node per byte and remembers the last route it saw.
+
+    Both expand each prefix over the entries it covers at its own level (controlled prefix expansion),
+    and every entry remembers the length of the prefix that wrote it. Inserting overwrites only entries
+    of shorter prefixes; erasing rewrites the entries of exactly that length with the next shorter
+    covering prefix, so updates are incremental and leave the result of inserting the remaining prefixes
+    from scratch.
+
+    Routes are stored once per prefix in a slot array and the table entries hold slot indices, so
+    re-setting a prefix only replaces its slot. findBatch looks up many addresses per call, issuing the
+    loads of a whole group before using any of them.
+
+    The tables are not synchronized: writes need the caller's lock, or a copy to publish, like the other
+    maps in this directory.
+*/
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using Ipv4Address = std::uint32_t;
+using Ipv6Address = std::array<std::uint8_t, 16>; // Network byte order
+
+// Route values indexed by slot, with slots reused after an erase
+template<typename V>
+class RouteSlots {
+public:
+    std::uint32_t add(const V& value, std::size_t limit) {
+        if (!freeSlots.empty()) {
+            const std::uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            values[slot] = value;
+            return slot;
+        }
+        if (values.size() >= limit) {
+            throw std::length_error("Too many routes for the route table");
+        }
+        values.push_back(value);
+        return static_cast<std::uint32_t>(values.size() - 1);
+    }
+
+    void release(std::uint32_t slot) {
+        freeSlots.push_back(slot);
+    }
+
+    V& operator[](std::uint32_t slot) {
+        return values[slot];
+    }
+
+    const V& operator[](std::uint32_t slot) const {
+        return values[slot];
+    }
+
+private:
+    std::vector<V> values;
+    std::vector<std::uint32_t> freeSlots;
+};
+
+template<typename V>
+class Ipv4RouteTable {
+public:
+    Ipv4RouteTable() : tbl24(static_cast<std::uint32_t*>(std::calloc(tbl24Size, sizeof(std::uint32_t)))) {
+        if (!tbl24) {
+            throw std::bad_alloc();
+        }
+    }
+
+    // Routes addresses matching prefix/length to value; bits of prefix past length are ignored.
+    // Throws std::invalid_argument if length is over 32.
+    void set(Ipv4Address prefix, unsigned length, const V& value) {
+        if (length > 32) {
+            throw std::invalid_argument("IPv4 prefix length over 32");
+        }
+        prefix = masked(prefix, length);
+        auto [rule, inserted] = rules[length].try_emplace(prefix, 0);
+        if (!inserted) {
+            slots[rule->second] = value;
+            return;
+        }
+        rule->second = slots.add(value, indexMask + 1);
+        assign(prefix, length, entryOf(rule->second, length), false);
+        ++ruleCount;
+    }
+
+    // Removes prefix/length; returns false if it was not set
+    bool erase(Ipv4Address prefix, unsigned length) {
+        if (length > 32) {
+            return false;
+        }
+        prefix = masked(prefix, length);
+        auto rule = rules[length].find(prefix);
+        if (rule == rules[length].end()) {
+            return false;
+        }
+        const std::uint32_t slot = rule->second;
+        rules[length].erase(rule);
+
+        // Its entries go back to the next shorter prefix covering it, if any
+        std::uint32_t replacement = 0;
+        for (unsigned shorter = length; shorter-- > 0;) {
+            auto covering = rules[shorter].find(masked(prefix, shorter));
+            if (covering != rules[shorter].end()) {
+                replacement = entryOf(covering->second, shorter);
+                break;
+            }
+        }
+        assign(prefix, length, replacement, true);
+        slots.release(slot);
+        --ruleCount;
+        return true;
+    }
+
+    // Throws std::out_of_range if no prefix matches address
+    const V& get(Ipv4Address address) const {
+        const std::uint32_t entry = entryFor(address);
+        if (!(entry & validBit)) {
+            throw std::out_of_range("Address matches no prefix.");
+        }
+        return slots[entry & indexMask];
+    }
+
+    std::optional<V> find(Ipv4Address address) const {
+        const std::uint32_t entry = entryFor(address);
+        return entry & validBit ? std::optional<V>(slots[entry & indexMask]) : std::nullopt;
+    }
+
+    // out[i] = find(addresses[i]); out must be at least as long as addresses
+    void findBatch(std::span<const Ipv4Address> addresses, std::span<std::optional<V>> out) const {
+        if (out.size() < addresses.size()) {
+            throw std::invalid_argument("Batch output is shorter than the addresses");
+        }
+        constexpr std::size_t groupSize = 16;
+        std::array<std::uint32_t, groupSize> entries;
+        for (std::size_t first = 0; first < addresses.size(); first += groupSize) {
+            const std::size_t count = std::min(groupSize, addresses.size() - first);
+            for (std::size_t index = 0; index < count; ++index) {
+                __builtin_prefetch(tbl24.get() + (addresses[first + index] >> 8));
+            }
+            for (std::size_t index = 0; index < count; ++index) {
+                entries[index] = tbl24[addresses[first + index] >> 8];
+                if (entries[index] & extendedBit) {
+                    __builtin_prefetch(tbl8.data() + tbl8Index(entries[index], addresses[first + index]));
+                }
+            }
+            for (std::size_t index = 0; index < count; ++index) {
+                std::uint32_t entry = entries[index];
+                if (entry & extendedBit) {
+                    entry = tbl8[tbl8Index(entry, addresses[first + index])];
+                }
+                out[first + index] = entry & validBit ? std::optional<V>(slots[entry & indexMask]) : std::nullopt;
+            }
+        }
+    }
+
+    // Number of prefixes
+    std::size_t size() const {
+        return ruleCount;
+    }
+
+    bool empty() const {
+        return ruleCount == 0;
+    }
+
+    // tbl8 groups in use, each 1 KB
+    std::size_t tbl8Groups() const {
+        return tbl8.size() / 256 - freeGroups.size();
+    }
+
+private:
+    // Entry: valid bit, extended bit (tbl24 only: index is a tbl8 group), 6 bits of prefix length and a
+    // 24-bit index, the route slot or the tbl8 group
+    static constexpr std::uint32_t validBit = 1u << 31;
+    static constexpr std::uint32_t extendedBit = 1u << 30;
+    static constexpr unsigned depthShift = 24;
+    static constexpr std::uint32_t indexMask = (1u << 24) - 1;
+    static constexpr std::size_t tbl24Size = std::size_t{1} << 24;
+
+    struct FreeDeleter {
+        void operator()(std::uint32_t* pointer) const {
+            std::free(pointer);
+        }
+    };
+
+    static Ipv4Address masked(Ipv4Address prefix, unsigned length) {
+        return length == 0 ? 0 : prefix & (~std::uint32_t{0} << (32 - length));
+    }
+
+    static std::uint32_t entryOf(std::uint32_t slot, unsigned length) {
+        return validBit | (length << depthShift) | slot;
+    }
+
+    static unsigned depthOf(std::uint32_t entry) {
+        return (entry >> depthShift) & 0x3f;
+    }
+
+    static std::size_t tbl8Index(std::uint32_t entry, Ipv4Address address) {
+        return (static_cast<std::size_t>(entry & indexMask) << 8) | (address & 0xff);
+    }
+
+    std::uint32_t entryFor(Ipv4Address address) const {
+        const std::uint32_t entry = tbl24[address >> 8];
+        return entry & extendedBit ? tbl8[tbl8Index(entry, address)] : entry;
+    }
+
+    // Writes entry over the entries prefix/length covers that belong to it: on insert the ones of shorter
+    // prefixes, on erase the ones of exactly this prefix
+    void assign(Ipv4Address prefix, unsigned length, std::uint32_t entry, bool erasing) {
+        const auto owned = [&](std::uint32_t current) {
+            return erasing ? (current & validBit) && depthOf(current) == length : depthOf(current) <= length;
+        };
+        if (length <= 24) {
+            const std::size_t first = prefix >> 8;
+            const std::size_t count = std::size_t{1} << (24 - length);
+            for (std::size_t index = first; index < first + count; ++index) {
+                const std::uint32_t current = tbl24[index];
+                if (current & extendedBit) {
+                    const std::size_t group = current & indexMask;
+                    for (std::size_t offset = 0; offset < 256; ++offset) {
+                        if (owned(tbl8[group * 256 + offset])) {
+                            tbl8[group * 256 + offset] = entry;
+                        }
+                    }
+                    collapse(index);
+                } else if (owned(current)) {
+                    tbl24[index] = entry;
+                }
+            }
+            return;
+        }
+
+        const std::size_t index = prefix >> 8;
+        if (!(tbl24[index] & extendedBit)) {
+            tbl24[index] = extendedBit | allocateGroup(tbl24[index]);
+        }
+        const std::size_t group = tbl24[index] & indexMask;
+        const std::size_t first = prefix & 0xff;
+        const std::size_t count = std::size_t{1} << (32 - length);
+        for (std::size_t offset = first; offset < first + count; ++offset) {
+            if (owned(tbl8[group * 256 + offset])) {
+                tbl8[group * 256 + offset] = entry;
+            }
+        }
+        collapse(index);
+    }
+
+    // A group filled with the tbl24 entry it replaces
+    std::uint32_t allocateGroup(std::uint32_t entry) {
+        std::size_t group;
+        if (freeGroups.empty()) {
+            group = tbl8.size() / 256;
+            if (group > indexMask) {
+                throw std::length_error("Too many tbl8 groups for the route table");
+            }
+            tbl8.resize(tbl8.size() + 256);
+        } else {
+            group = freeGroups.back();
+            freeGroups.pop_back();
+        }
+        std::fill_n(tbl8.begin() + static_cast<std::ptrdiff_t>(group * 256), 256, entry);
+        return static_cast<std::uint32_t>(group);
+    }
+
+    // Puts the group of tbl24[index] back into tbl24 once no prefix longer than 24 bits is left in it
+    void collapse(std::size_t index) {
+        const std::size_t group = tbl24[index] & indexMask;
+        const auto begin = tbl8.begin() + static_cast<std::ptrdiff_t>(group * 256);
+        const std::uint32_t first = *begin;
+        const bool uniform = std::all_of(begin, begin + 256, [first](std::uint32_t entry) { return entry == first; });
+        if (!uniform || depthOf(first) > 24) {
+            return;
+        }
+        tbl24[index] = first;
+        freeGroups.push_back(static_cast<std::uint32_t>(group));
+    }
+
+    std::unique_ptr<std::uint32_t[], FreeDeleter> tbl24;
+    std::vector<std::uint32_t> tbl8;
+    std::vector<std::uint32_t> freeGroups;
+    std::array<std::unordered_map<Ipv4Address, std::uint32_t>, 33> rules; // By length: prefix -> slot
+    RouteSlots<V> slots;
+    std::size_t ruleCount = 0;
+};
+
+template<typename V>
+class Ipv6RouteTable {
+public:
+    // Routes addresses matching prefix/length to value; bits of prefix past length are ignored.
+    // Throws std::invalid_argument if length is over 128.
+    void set(const Ipv6Address& address, unsigned length, const V& value) {
+        if (length > 128) {
+            throw std::invalid_argument("IPv6 prefix length over 128");
+        }
+        const Ipv6Address prefix = masked(address, length);
+        auto [rule, inserted] = rules.try_emplace({prefix, length}, 0);
+        if (!inserted) {
+            slots[rule->second] = value;
+            return;
+        }
+        rule->second = slots.add(value, std::numeric_limits<std::uint32_t>::max());
+
+        Node* node = &root;
+        const unsigned level = levelOf(length);
+        for (unsigned depth = 0; depth < level; ++depth) {
+            node = &node->child(prefix[depth]);
+        }
+        const auto [first, count] = expansion(prefix, length);
+        for (unsigned byte = first; byte < first + count; ++byte) {
+            const Route* current = node->route(byte);
+            if (current == nullptr || current->length <= length) {
+                node->setRoute(byte, {rule->second, static_cast<std::uint8_t>(length)});
+            }
+        }
+    }
+
+    // Removes prefix/length; returns false if it was not set
+    bool erase(const Ipv6Address& address, unsigned length) {
+        if (length > 128) {
+            return false;
+        }
+        const Ipv6Address prefix = masked(address, length);
+        auto rule = rules.find({prefix, length});
+        if (rule == rules.end()) {
+            return false;
+        }
+        const std::uint32_t slot = rule->second;
+        rules.erase(rule);
+
+        const unsigned level = levelOf(length);
+        std::vector<Node*> path{&root};
+        for (unsigned depth = 0; depth < level; ++depth) {
+            path.push_back(path.back()->findChild(prefix[depth]));
+        }
+
+        // Only prefixes expanded in the same node can take its entries over; shorter ones are found on
+        // the way down
+        std::optional<Route> replacement;
+        const unsigned shortest = level == 0 ? 0 : 8 * level + 1;
+        for (unsigned shorter = length; shorter-- > shortest;) {
+            auto covering = rules.find({masked(prefix, shorter), shorter});
+            if (covering != rules.end()) {
+                replacement = Route{covering->second, static_cast<std::uint8_t>(shorter)};
+                break;
+            }
+        }
+        Node* node = path.back();
+        const auto [first, count] = expansion(prefix, length);
+        for (unsigned byte = first; byte < first + count; ++byte) {
+            const Route* current = node->route(byte);
+            if (current != nullptr && current->length == length) {
+                if (replacement) {
+                    node->setRoute(byte, *replacement);
+                } else {
+                    node->clearRoute(byte);
+                }
+            }
+        }
+        // Drop nodes left with neither routes nor children, bottom up
+        for (unsigned depth = level; depth > 0 && path[depth]->empty(); --depth) {
+            path[depth - 1]->removeChild(prefix[depth - 1]);
+        }
+        slots.release(slot);
+        return true;
+    }
+
+    // Throws std::out_of_range if no prefix matches address
+    const V& get(const Ipv6Address& address) const {
+        const std::optional<std::uint32_t> slot = slotFor(address);
+        if (!slot) {
+            throw std::out_of_range("Address matches no prefix.");
+        }
+        return slots[*slot];
+    }
+
+    std::optional<V> find(const Ipv6Address& address) const {
+        const std::optional<std::uint32_t> slot = slotFor(address);
+        return slot ? std::optional<V>(slots[*slot]) : std::nullopt;
+    }
+
+    // out[i] = find(addresses[i]); the addresses of a group descend level by level together, each
+    // prefetching its next node before the group moves on
+    void findBatch(std::span<const Ipv6Address> addresses, std::span<std::optional<V>> out) const {
+        if (out.size() < addresses.size()) {
+            throw std::invalid_argument("Batch output is shorter than the addresses");
+        }
+        constexpr std::size_t groupSize = 8;
+        std::array<const Node*, groupSize> nodes;
+        std::array<std::optional<std::uint32_t>, groupSize> best;
+        for (std::size_t first = 0; first < addresses.size(); first += groupSize) {
+            const std::size_t count = std::min(groupSize, addresses.size() - first);
+            std::size_t active = count;
+            for (std::size_t index = 0; index < count; ++index) {
+                nodes[index] = &root;
+                best[index].reset();
+            }
+            for (unsigned depth = 0; depth < 16 && active > 0; ++depth) {
+                for (std::size_t index = 0; index < count; ++index) {
+                    if (nodes[index] == nullptr) {
+                        continue;
+                    }
+                    const std::uint8_t byte = addresses[first + index][depth];
+                    if (const Route* route = nodes[index]->route(byte)) {
+                        best[index] = route->slot;
+                    }
+                    nodes[index] = nodes[index]->findChild(byte);
+                    if (nodes[index] == nullptr) {
+                        --active;
+                    } else {
+                        __builtin_prefetch(nodes[index]);
+                    }
+                }
+            }
+            for (std::size_t index = 0; index < count; ++index) {
+                out[first + index] = best[index] ? std::optional<V>(slots[*best[index]]) : std::nullopt;
+            }
+        }
+    }
+
+    // Number of prefixes
+    std::size_t size() const {
+        return rules.size();
+    }
+
+    bool empty() const {
+        return rules.empty();
+    }
+
+private:
+    struct Route {
+        std::uint32_t slot;
+        std::uint8_t length; // Of the prefix that wrote this entry
+    };
+
+    // 256 entries, one per value of this level's byte, stored densely behind two bitmaps
+    struct Node {
+        std::array<std::uint64_t, 4> childMask{};
+        std::array<std::uint64_t, 4> routeMask{};
+        std::vector<std::unique_ptr<Node>> children; // In byte order
+        std::vector<Route> routes;                   // In byte order
+
+        static bool has(const std::array<std::uint64_t, 4>& mask, unsigned byte) {
+            return (mask[byte / 64] >> (byte % 64)) & 1;
+        }
+
+        // Entries before byte in the dense array
+        static std::size_t rank(const std::array<std::uint64_t, 4>& mask, unsigned byte) {
+            std::size_t count = 0;
+            for (unsigned word = 0; word < byte / 64; ++word) {
+                count += static_cast<std::size_t>(std::popcount(mask[word]));
+            }
+            const std::uint64_t below = (std::uint64_t{1} << (byte % 64)) - 1;
+            return count + static_cast<std::size_t>(std::popcount(mask[byte / 64] & below));
+        }
+
+        const Route* route(unsigned byte) const {
+            return has(routeMask, byte) ? &routes[rank(routeMask, byte)] : nullptr;
+        }
+
+        const Node* findChild(unsigned byte) const {
+            return has(childMask, byte) ? children[rank(childMask, byte)].get() : nullptr;
+        }
+
+        Node* findChild(unsigned byte) {
+            return has(childMask, byte) ? children[rank(childMask, byte)].get() : nullptr;
+        }
+
+        Node& child(unsigned byte) {
+            const std::size_t position = rank(childMask, byte);
+            if (!has(childMask, byte)) {
+                children.insert(children.begin() + static_cast<std::ptrdiff_t>(position), std::make_unique<Node>());
+                childMask[byte / 64] |= std::uint64_t{1} << (byte % 64);
+            }
+            return *children[position];
+        }
+
+        void removeChild(unsigned byte) {
+            children.erase(children.begin() + static_cast<std::ptrdiff_t>(rank(childMask, byte)));
+            childMask[byte / 64] &= ~(std::uint64_t{1} << (byte % 64));
+        }
+
+        void setRoute(unsigned byte, Route route) {
+            const std::size_t position = rank(routeMask, byte);
+            if (has(routeMask, byte)) {
+                routes[position] = route;
+                return;
+            }
+            routes.insert(routes.begin() + static_cast<std::ptrdiff_t>(position), route);
+            routeMask[byte / 64] |= std::uint64_t{1} << (byte % 64);
+        }
+
+        void clearRoute(unsigned byte) {
+            routes.erase(routes.begin() + static_cast<std::ptrdiff_t>(rank(routeMask, byte)));
+            routeMask[byte / 64] &= ~(std::uint64_t{1} << (byte % 64));
+        }
+
+        bool empty() const {
+            return children.empty() && routes.empty();
+        }
+    };
+
+    static Ipv6Address masked(const Ipv6Address& address, unsigned length) {
+        Ipv6Address result{};
+        for (unsigned byte = 0; byte < 16 && 8 * byte < length; ++byte) {
+            const unsigned bits = std::min(8u, length - 8 * byte);
+            result[byte] = static_cast<std::uint8_t>(address[byte] & (0xff00u >> bits));
+        }
+        return result;
+    }
+
+    // The node level a prefix is expanded in: /1 to /8 in the root, /9 to /16 one below, and so on
+    static unsigned levelOf(unsigned length) {
+        return length == 0 ? 0 : (length - 1) / 8;
+    }
+
+    // First byte and number of entries the prefix covers in its node
+    static std::pair<unsigned, unsigned> expansion(const Ipv6Address& prefix, unsigned length) {
+        const unsigned level = levelOf(length);
+        const unsigned bits = length - 8 * level;
+        return {length == 0 ? 0u : prefix[level], 1u << (8 - bits)};
+    }
+
+    std::optional<std::uint32_t> slotFor(const Ipv6Address& address) const {
+        std::optional<std::uint32_t> best;
+        const Node* node = &root;
+        for (unsigned depth = 0; depth < 16 && node != nullptr; ++depth) {
+            if (const Route* route = node->route(address[depth])) {
+                best = route->slot;
+            }
+            node = node->findChild(address[depth]);
+        }
+        return best;
+    }
+
+    Node root;
+    std::map<std::pair<Ipv6Address, unsigned>, std::uint32_t> rules; // (prefix, length) -> slot
+    RouteSlots<V> slots;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+/*
+    Static interval table: an interval map built by the compiler.
+
+    Some range tables are fixed when the program is built: port ranges to service classes, status code
+    bands to descriptions. Building them at startup with IntervalMap::set costs a heap node per boundary and
+    time before the first lookup, for a result that never changes. makeIntervalTable does that work in a
+    consteval function instead, the way ErrorCodeLookup (Workshop-01, 07_final_exercise.cpp and
+    08_final_project.cpp) fills its array in a constexpr constructor:
+
+    - The ranges are validated: an empty or reversed range, or two overlapping ranges with different
+      values, is a compile error rather than a silent last-writer-wins.
+    - They are sorted and coalesced (touching or overlapping ranges of equal value become one) into the
+      canonical boundaries of IntervalMap.
+    - The boundaries go into fixed-size std::arrays, 2N entries for N ranges, with the unused tail padded
+      with copies of the last boundary. The whole table is a literal value: declared constexpr, it sits in
+      read-only data, with no constructor to run and no heap.
+
+    find() and get() are constexpr, so a static_assert can check the table. At run time the lookup is the
+    branchless binary search of FlatIntervalMap, over a compile-time length, so its loop has a fixed trip
+    count the compiler can unroll.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+
+#include "interval_batch.hpp"
+
+template<typename K, typename V, std::size_t N>
+class StaticIntervalTable {
+public:
+    static constexpr std::size_t capacity = 2 * N;
+
+    // Validates, sorts and coalesces ranges; any error stops compilation
+    static consteval StaticIntervalTable fromRanges(const IntervalEntry<K, V> (&ranges)[N]) {
+        std::array<IntervalEntry<K, V>, N> sorted{};
+        for (std::size_t index = 0; index < N; ++index) {
+            if (!(ranges[index].start < ranges[index].end)) {
+                throw std::invalid_argument("Static interval table range is empty or reversed");
+            }
+            sorted[index] = ranges[index];
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const auto& left, const auto& right) {
+            return left.start < right.start;
+        });
+
+        StaticIntervalTable table;
+        IntervalEntry<K, V> run = sorted[0]; // The coalesced range being extended
+        for (std::size_t index = 1; index < N; ++index) {
+            const IntervalEntry<K, V>& range = sorted[index];
+            if (range.start < run.end && !(range.value == run.value)) {
+                throw std::invalid_argument("Static interval table ranges overlap with different values");
+            }
+            if (!(run.end < range.start) && range.value == run.value) {
+                run.end = run.end < range.end ? range.end : run.end;
+                continue;
+            }
+            table.append(run.start, run.value);
+            if (run.end < range.start) {
+                table.append(run.end, std::nullopt); // A gap
+            }
+            run = range;
+        }
+        table.append(run.start, run.value);
+        table.append(run.end, std::nullopt);
+
+        for (std::size_t index = table.count; index < capacity; ++index) {
+            table.keys[index] = table.keys[table.count - 1];
+        }
+        return table;
+    }
+
+    // Throws std::out_of_range if no interval contains key; at compile time that is an error
+    constexpr const V& get(const K& key) const {
+        const std::size_t index = upperBound(key);
+        if (index == 0 || !values[index - 1]) {
+            throw std::out_of_range("Key is not in any interval.");
+        }
+        return *values[index - 1];
+    }
+
+    constexpr std::optional<V> find(const K& key) const {
+        const std::size_t index = upperBound(key);
+        if (index == 0 || !values[index - 1]) {
+            return std::nullopt;
+        }
+        return *values[index - 1];
+    }
+
+    // Number of boundaries after coalescing, including the ones closing a gap
+    constexpr std::size_t size() const {
+        return count;
+    }
+
+private:
+    constexpr StaticIntervalTable() = default;
+
+    constexpr void append(const K& key, const std::optional<V>& value) {
+        keys[count] = key;
+        values[count] = value;
+        ++count;
+    }
+
+    // Index of the first boundary after key; the padding repeats the last boundary, which holds no value
+    constexpr std::size_t upperBound(const K& key) const {
+        std::size_t base = 0;
+        std::size_t length = capacity;
+        while (length > 1) {
+            const std::size_t half = length / 2;
+            base = key < keys[base + half] ? base : base + half;
+            length -= half;
+        }
+        return base + (key < keys[base] ? 0 : 1);
+    }
+
+    std::array<K, capacity> keys{};
+    std::array<std::optional<V>, capacity> values{};
+    std::size_t count = 0;
+};
+
+// makeIntervalTable<K, V>({{start, end, value}, ...}), the number of ranges deduced
+template<typename K, typename V, std::size_t N>
+consteval StaticIntervalTable<K, V, N> makeIntervalTable(const IntervalEntry<K, V> (&ranges)[N]) {
+    return StaticIntervalTable<K, V, N>::fromRanges(ranges);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+    Replacing a file atomically and durably, for the snapshot and table files of the examples.
+
+    The new contents are written next to the final name, flushed to disk and renamed over the old file, so
+    a reader opens the old file or the new one, never half of one. The rename itself is only a change to
+    the directory: until the directory is flushed too, a power loss can undo it and bring the old file
+    back, or, for a first write, leave no file at all. So the parent directory is flushed after the rename,
+    and replaceFile returns only once the new file will survive a crash.
+
+    Without POSIX there is no portable way to flush a directory, nor to rename over an existing file: the
+    old file is removed first, and the replacement is neither atomic nor durable.
+*/
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+// Atomically and durably replaces path with bytes; throws std::system_error if any step fails
+inline void replaceFile(const std::string& path, std::span<const std::byte> bytes) {
+    const std::string temporary = path + ".tmp";
+    const int descriptor = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot create " + temporary);
+    }
+    for (std::size_t written = 0; written < bytes.size();) {
+        const ssize_t result = ::write(descriptor, bytes.data() + written, bytes.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            const int error = errno;
+            ::close(descriptor);
+            throw std::system_error(error, std::generic_category(), "cannot write " + temporary);
+        }
+        written += static_cast<std::size_t>(result);
+    }
+    // On disk before it gets the final name, or a crash could leave an empty file under that name
+    if (::fsync(descriptor) != 0) {
+        const int error = errno;
+        ::close(descriptor);
+        throw std::system_error(error, std::generic_category(), "cannot flush " + temporary);
+    }
+    ::close(descriptor);
+    if (::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot rename " + temporary);
+    }
+
+    // The rename is durable only once the directory entry is on disk
+    std::string directory = std::filesystem::path(path).parent_path().string();
+    if (directory.empty()) {
+        directory = ".";
+    }
+    const int directoryDescriptor = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (directoryDescriptor < 0) {
+        throw std::system_error(errno, std::generic_category(), "cannot open directory " + directory);
+    }
+    if (::fsync(directoryDescriptor) != 0) {
+        const int error = errno;
+        ::close(directoryDescriptor);
+        throw std::system_error(error, std::generic_category(), "cannot flush directory " + directory);
+    }
+    ::close(directoryDescriptor);
+}
+#else
+// Replaces path with bytes, neither atomically nor durably; throws std::system_error if it fails
+inline void replaceFile(const std::string& path, std::span<const std::byte> bytes) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!out.flush()) {
+            throw std::system_error(std::make_error_code(std::errc::io_error), "cannot write " + temporary);
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        throw std::system_error(std::make_error_code(std::errc::io_error), "cannot rename " + temporary);
+    }
+}
+#endif